@@ -105,6 +105,9 @@ static struct state state_postbreak = {
     .data = "POSTBREAK",
     .action_entry = &print_msg_enter,
     .action_exti = &print_msg_exit,
+    /* answers during a break are handled after breakoff */
+    .deferred_types = (const int[]){EVENT_POST_ANSWER},
+    .deferred_nums = 1,
 };
 
 static struct state state_error = {
@@ -175,6 +178,7 @@ static void print_msg_exit(void *state_data, struct event *event)
 
 static rt_mq_t mq_event_post;
 static struct state_machine m_post;
+static struct event m_post_deferred[4];
 
 int state_post_event_set(enum event_post_type event, void *data)
 {
@@ -192,6 +196,7 @@ static void state_process(void *parameter)
 {
     struct event e;
     statem_init(&m_post, &state_root, &state_error);
+    statem_defer_set(&m_post, m_post_deferred, 4, STATEM_DEFER_DROP_OLDEST);
 
     while (1)
     {
@@ -272,13 +277,19 @@ MSH_CMD_EXPORT(post_event_set, state post event set<event><data>.);
 
 static void post_current_get(uint8_t argc, char **argv)
 {
-    if (!m_post.state_current->data)
+    struct statem_snapshot snapshot;
+
+    // 状态机在其他线程中运行，只能读取其发布的状态
+    statem_snapshot_get(&m_post, &snapshot);
+
+    if (!snapshot.state_current || !snapshot.state_current->data)
     {
         rt_kprintf("post current state is NULL\n");
     }
     else
     {
-        rt_kprintf("post current state is %s\n", m_post.state_current->data);
+        rt_kprintf("post current state is %s, %u transitions\n", snapshot.state_current->data,
+                   (unsigned int)snapshot.transitions);
     }
 }
 MSH_CMD_EXPORT(post_current_get, get current state.);
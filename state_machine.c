@@ -2,6 +2,12 @@
 
 static void go_to_state_error(struct state_machine *state_machine, struct event *const event);
 static struct transition *get_transition(struct state_machine *state_machine, struct state *state, struct event *const event);
+static int event_run(struct state_machine *state_machine, struct event *event);
+static int transition_run(struct state_machine *state_machine, struct event *event);
+static void defer_replay(struct state_machine *state_machine);
+#if STATEM_COMPLETION_HOPS_MAX > 0
+static int completion_run(struct state_machine *state_machine, struct event *event, struct state *state_origin);
+#endif
 
 /**
  * @brief 初始化状态机
@@ -21,6 +27,16 @@ int statem_init(struct state_machine *fsm, struct state *state_init, struct stat
     fsm->state_current = state_init;
     fsm->state_previous = NULL;
     fsm->state_error = state_error;
+    fsm->finder = NULL;
+    fsm->deferred = NULL;
+    fsm->deferred_max = 0;
+    fsm->deferred_head = 0;
+    fsm->deferred_nums = 0;
+    fsm->deferred_overflow = STATEM_DEFER_DROP_NEWEST;
+    fsm->deferred_dropped = 0;
+    fsm->snapshot_sequence = 0;
+    fsm->snapshot_current = state_init;
+    fsm->snapshot_previous = NULL;
 
     return 0;
 }
@@ -53,6 +69,148 @@ int statem_handle_event(struct state_machine *fsm, struct event *event)
         return STATEM_STATE_NOCHANGE;
     }
 
+    struct state *state_origin = fsm->state_current;
+    int ret = event_run(fsm, event);
+
+    // 状态改变后，重新处理推迟的事件
+    if (fsm->deferred_nums && fsm->state_current != state_origin)
+    {
+        defer_replay(fsm);
+    }
+
+    return ret;
+}
+
+// 状态及其父状态是否推迟该类型的事件
+static bool event_deferred(const struct state *state, int event_type)
+{
+    size_t i;
+
+    for (; state; state = state->state_parent)
+    {
+        for (i = 0; i < state->deferred_nums; ++i)
+        {
+            if (state->deferred_types[i] == event_type)
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+// 将事件存入推迟缓冲区
+static int defer_push(struct state_machine *fsm, struct event *event)
+{
+    if (fsm->deferred_nums == fsm->deferred_max)
+    {
+        fsm->deferred_dropped++;
+
+        if (fsm->deferred_overflow == STATEM_DEFER_DROP_NEWEST)
+        {
+            return STATEM_STATE_NOCHANGE;
+        }
+
+        fsm->deferred_head = (fsm->deferred_head + 1) % fsm->deferred_max;
+        fsm->deferred_nums--;
+    }
+
+    fsm->deferred[(fsm->deferred_head + fsm->deferred_nums) % fsm->deferred_max] = *event;
+    fsm->deferred_nums++;
+
+    return STATEM_EVENT_DEFERRED;
+}
+
+/**
+ * @brief 重新处理推迟的事件
+ *
+ * 从最早的事件开始，跳过当前状态仍然推迟的事件，取出第一个不再推迟的事件处理。
+ * 状态每改变一次，都从最早的事件重新开始，保证按到达顺序处理。
+ * 进入错误状态后清空缓冲区，剩余的事件属于出错前的会话，不再处理
+ *
+ * @param fsm       状态机
+ */
+static void defer_replay(struct state_machine *fsm)
+{
+    struct state *state;
+    size_t i = 0, j;
+
+    while (i < fsm->deferred_nums && fsm->state_current)
+    {
+        if (fsm->state_error && fsm->state_current == fsm->state_error)
+        {
+            fsm->deferred_head = 0;
+            fsm->deferred_nums = 0;
+            break;
+        }
+
+        struct event event = fsm->deferred[(fsm->deferred_head + i) % fsm->deferred_max];
+
+        if (event_deferred(fsm->state_current, event.type))
+        {
+            ++i;
+            continue;
+        }
+
+        // 移除该事件，后面的事件前移
+        for (j = i; j + 1 < fsm->deferred_nums; ++j)
+        {
+            fsm->deferred[(fsm->deferred_head + j) % fsm->deferred_max] =
+                fsm->deferred[(fsm->deferred_head + j + 1) % fsm->deferred_max];
+        }
+        fsm->deferred_nums--;
+
+        state = fsm->state_current;
+        event_run(fsm, &event);
+
+        if (fsm->state_current != state)
+        {
+            i = 0;
+        }
+    }
+}
+
+/**
+ * @brief 分发一个事件，包括无事件转换和推迟
+ *
+ * @param fsm       状态机
+ * @param event     事件
+ * @return int
+ */
+static int event_run(struct state_machine *fsm, struct event *event)
+{
+#if STATEM_COMPLETION_HOPS_MAX > 0
+    struct state *state_origin = fsm->state_current;
+    int ret = transition_run(fsm, event);
+
+    // 进入了新状态，继续执行新状态的无事件转换
+    if (ret == STATEM_STATE_CHANGED)
+    {
+        ret = completion_run(fsm, event, state_origin);
+    }
+#else
+    int ret = transition_run(fsm, event);
+#endif
+
+    // 没有满足条件的转换，当前状态推迟该事件
+    if (ret == STATEM_STATE_NOCHANGE && fsm->deferred && event_deferred(fsm->state_current, event->type))
+    {
+        ret = defer_push(fsm, event);
+    }
+
+    return ret;
+}
+
+/**
+ * @brief 查找并执行一次转换
+ *
+ * @param fsm       状态机
+ * @param event     事件
+ * @return int
+ */
+static int transition_run(struct state_machine *fsm, struct event *event)
+{
     struct state *state_next = fsm->state_current; // 当前状态
 
     do
@@ -107,8 +265,9 @@ int statem_handle_event(struct state_machine *fsm, struct event *event)
             state_next->action_entry(state_next->data, event);
         }
 
-        // 更新状态
+        // 更新状态，入口函数执行完后才对其他线程可见
         fsm->state_current = state_next;
+        statem_publish(fsm);
 
         // 当前转换是自身状态转换
         if (fsm->state_current == fsm->state_previous)
@@ -134,6 +293,58 @@ int statem_handle_event(struct state_machine *fsm, struct event *event)
     return STATEM_STATE_NOCHANGE;
 }
 
+#if STATEM_COMPLETION_HOPS_MAX > 0
+/**
+ * @brief 执行无事件转换
+ *
+ * 进入新状态后，以#STATEM_EVENT_COMPLETION类型的事件（携带原事件的data）查找转换，
+ * 直到没有满足条件的无事件转换为止。同一次分发中再次进入已经进入过的状态，
+ * 或者跳转次数超过#STATEM_COMPLETION_HOPS_MAX，视为死循环，进入错误状态
+ *
+ * @param fsm           状态机
+ * @param event         触发事件
+ * @param state_origin  处理事件前的状态
+ * @return int
+ */
+static int completion_run(struct state_machine *fsm, struct event *event, struct state *state_origin)
+{
+    struct event completion = { STATEM_EVENT_COMPLETION, event->data };
+    struct state *visited[STATEM_COMPLETION_HOPS_MAX + 1];
+    size_t hops = 0, i;
+    int ret;
+
+    visited[0] = fsm->state_current;
+
+    while ((ret = transition_run(fsm, &completion)) != STATEM_STATE_NOCHANGE)
+    {
+        // 到达错误状态或终止状态，链条结束
+        if (ret == STATEM_ERR_STATE_RECHED || ret == STATEM_FINAL_STATE_RECHED)
+        {
+            return ret;
+        }
+
+        // 无事件转换回到自身，会一直循环
+        if (ret == STATEM_STATE_LOOPSELF || ++hops > STATEM_COMPLETION_HOPS_MAX)
+        {
+            go_to_state_error(fsm, &completion);
+            return STATEM_ERR_STATE_RECHED;
+        }
+
+        for (i = 0; i < hops; ++i)
+        {
+            if (visited[i] == fsm->state_current)
+            {
+                go_to_state_error(fsm, &completion);
+                return STATEM_ERR_STATE_RECHED;
+            }
+        }
+        visited[hops] = fsm->state_current;
+    }
+
+    return (fsm->state_current == state_origin) ? STATEM_STATE_LOOPSELF : STATEM_STATE_CHANGED;
+}
+#endif
+
 // 当前状态
 struct state *statem_state_current(struct state_machine *fsm)
 {
@@ -156,6 +367,69 @@ struct state *statem_state_previous(struct state_machine *fsm)
     return fsm->state_previous;
 }
 
+/**
+ * @brief 在其他线程中一致地读取状态机的状态
+ *
+ * 序号为奇数或读取前后序号不同时，说明读取期间状态机发布了新状态，重新读取
+ *
+ * @param fsm       状态机
+ * @param snapshot  读取到的状态
+ */
+static void snapshot_read(const struct state_machine *fsm, struct statem_snapshot *snapshot)
+{
+    size_t sequence;
+
+    do
+    {
+        sequence = STATEM_ATOMIC_LOAD(&fsm->snapshot_sequence);
+
+        snapshot->state_current = STATEM_ATOMIC_LOAD_RELAXED(&fsm->snapshot_current);
+        snapshot->state_previous = STATEM_ATOMIC_LOAD_RELAXED(&fsm->snapshot_previous);
+
+        STATEM_ATOMIC_FENCE_ACQUIRE();
+    } while ((sequence & 1u) || STATEM_ATOMIC_LOAD_RELAXED(&fsm->snapshot_sequence) != sequence);
+
+    snapshot->transitions = sequence >> 1;
+}
+
+int statem_snapshot_get(const struct state_machine *fsm, struct statem_snapshot *snapshot)
+{
+    if (!fsm || !snapshot)
+    {
+        return -1;
+    }
+
+    snapshot_read(fsm, snapshot);
+
+    return 0;
+}
+
+int statem_snapshot_scan(struct state_machine *const *machines, size_t nums, struct statem_snapshot *snapshots)
+{
+    size_t i;
+
+    if (!machines || !snapshots)
+    {
+        return -1;
+    }
+
+    for (i = 0; i < nums; ++i)
+    {
+        if (machines[i])
+        {
+            snapshot_read(machines[i], &snapshots[i]);
+        }
+        else
+        {
+            snapshots[i].state_current = NULL;
+            snapshots[i].state_previous = NULL;
+            snapshots[i].transitions = 0;
+        }
+    }
+
+    return 0;
+}
+
 // 进入错误状态
 static void go_to_state_error(struct state_machine *fsm,
                               struct event *const event)
@@ -168,6 +442,9 @@ static void go_to_state_error(struct state_machine *fsm,
     {
         fsm->state_current->action_entry(fsm->state_current->data, event);
     }
+
+    // 与transition_run()相同，进入动作执行完后才发布
+    statem_publish(fsm);
 }
 
 // 状态、事件下对应着多个目标状态，需要根据条件判断走哪个状态
@@ -188,14 +465,20 @@ static struct transition *get_transition(struct state_machine *fsm, struct state
         return NULL;
     }
 
+    // 使用自定义的查找方法
+    if (fsm->finder)
+    {
+        return fsm->finder->find(fsm->finder->ctx, state, event);
+    }
+
     // 循环所有的转换函数
     for (i = 0; i < state->transition_nums; ++i)
     {
         struct transition *t = &state->transitions[i];
 
         /* A transition for the given event has been found: */
-        // 确保事件类型是相同的
-        if (t->event_type == event->type)
+        // 确保事件类型是相同的，或者在转换的范围内
+        if (statem_transition_match(t, event->type))
         {
             // 事件类型相同就可以转换
             if (!t->guard)
@@ -223,3 +506,126 @@ int statem_stopped(struct state_machine *state_machine)
 
     return (state_machine->state_current->transition_nums == 0);
 }
+
+// 设置查找转换的方法
+int statem_finder_set(struct state_machine *fsm, const struct statem_finder *finder)
+{
+    if (!fsm)
+    {
+        return -1;
+    }
+
+    fsm->finder = finder;
+
+    return 0;
+}
+
+// 设置推迟事件的缓冲区
+int statem_defer_set(struct state_machine *fsm, struct event *buffer, size_t size,
+                     enum statem_defer_overflow overflow)
+{
+    if (!fsm || (buffer && !size))
+    {
+        return -1;
+    }
+
+    fsm->deferred = buffer;
+    fsm->deferred_max = buffer ? size : 0;
+    fsm->deferred_head = 0;
+    fsm->deferred_nums = 0;
+    fsm->deferred_overflow = overflow;
+
+    return 0;
+}
+
+// 将状态加入状态表，已存在则忽略
+static int graph_add(struct statem_graph *graph, struct state *state)
+{
+    size_t i;
+
+    if (!state)
+    {
+        return 0;
+    }
+
+    for (i = 0; i < graph->state_nums; ++i)
+    {
+        if (graph->states[i] == state)
+        {
+            return 0;
+        }
+    }
+
+    if (graph->state_nums >= graph->state_max)
+    {
+        return -1;
+    }
+
+    state->id = (unsigned int)graph->state_nums;
+    graph->states[graph->state_nums++] = state;
+
+    return 0;
+}
+
+/**
+ * @brief 收集状态图中的所有状态并编号
+ * 
+ * 以状态表本身作为广度优先遍历的队列，编号顺序只取决于状态图的定义
+ *
+ * @param graph         状态图
+ * @param states        状态表存储空间
+ * @param state_max     状态表容量
+ * @param state_init    初始状态
+ * @param state_error   错误状态
+ * @return int          0：成功   -1：失败
+ */
+int statem_graph_build(struct statem_graph *graph, struct state **states, size_t state_max,
+                       struct state *state_init, struct state *state_error)
+{
+    size_t i, j;
+
+    if (!graph || !states || !state_init)
+    {
+        return -1;
+    }
+
+    graph->states = states;
+    graph->state_nums = 0;
+    graph->state_max = state_max;
+
+    if (graph_add(graph, state_init) || graph_add(graph, state_error))
+    {
+        return -1;
+    }
+
+    for (i = 0; i < graph->state_nums; ++i)
+    {
+        struct state *state = graph->states[i];
+
+        if (graph_add(graph, state->state_parent) || graph_add(graph, state->state_entry))
+        {
+            return -1;
+        }
+
+        for (j = 0; j < state->transition_nums; ++j)
+        {
+            if (graph_add(graph, state->transitions[j].state_next))
+            {
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+// 根据编号获取状态
+struct state *statem_graph_state(const struct statem_graph *graph, unsigned int id)
+{
+    if (!graph || id >= graph->state_nums)
+    {
+        return NULL;
+    }
+
+    return graph->states[id];
+}
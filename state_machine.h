@@ -69,6 +69,36 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <limits.h>
+#include "state_machine_atomic.h"
+
+/**
+ * \brief Event type of completion transitions
+ *
+ * A transition with this event type has no triggering event. It is evaluated
+ * right after its state has been entered, within the same call to
+ * statem_handle_event(). See \ref transition.
+ */
+#define STATEM_EVENT_COMPLETION     INT_MIN
+
+/**
+ * \brief Event type of wildcard transitions
+ *
+ * A transition with this event type matches every event except
+ * #STATEM_EVENT_COMPLETION. See \ref transition.
+ */
+#define STATEM_EVENT_ANY            (INT_MIN + 1)
+
+/**
+ * \brief Maximum number of completion transitions taken in one dispatch
+ *
+ * If a chain of completion transitions is longer, or enters a state twice,
+ * the state machine enters its error state. Define it as 0 to disable
+ * completion transitions altogether.
+ */
+#ifndef STATEM_COMPLETION_HOPS_MAX
+#define STATEM_COMPLETION_HOPS_MAX  16
+#endif
 
 /**
  * @brief 事件触发从一个状态到另一个状态的转换。 事件类型由用户定义。 任何事件都可以选择包含一个 \ref #event::data "payload"
@@ -138,6 +168,40 @@ struct state;
  * `coordinatesWithinLimits` checks whether the coordinates in the mouse event
  * are within the limits of the "box".
  *
+ * ### Completion transitions ###
+ * A transition whose #event_type is #STATEM_EVENT_COMPLETION has no
+ * triggering event. Whenever statem_handle_event() enters a new state, the
+ * completion transitions of that state (and of its parents) are evaluated
+ * like ordinary transitions, and the first one whose guard accepts is taken
+ * immediately. This repeats until no completion transition matches, so a
+ * state that only branches on a guard is passed through within a single
+ * dispatch. The guards and actions receive an event of type
+ * #STATEM_EVENT_COMPLETION carrying the \ref event::data "data" of the
+ * triggering event.
+ * ~~~{.c}
+ * struct state checkState = {
+ *    .transitions = (struct transition[]){
+ *       { STATEM_EVENT_COMPLETION, NULL, &isValid, NULL, &acceptState },
+ *       { STATEM_EVENT_COMPLETION, NULL, NULL, NULL, &rejectState },
+ *    },
+ *    .transition_nums = 2,
+ * };
+ * ~~~
+ * A chain that enters the same state twice or is longer than
+ * #STATEM_COMPLETION_HOPS_MAX sends the state machine to its error state.
+ *
+ * ### Ranged and wildcard transitions ###
+ * A transition with a non-zero #event_span matches every event type from
+ * #event_type to #event_type + #event_span inclusive; the range must not
+ * extend past `INT_MAX`. A transition whose #event_type is
+ * #STATEM_EVENT_ANY matches every event. In both cases the transitions of a
+ * state are still tried in array order, so an exact transition placed
+ * before a range takes priority over it.
+ * ~~~{.c}
+ * { MSG_DATA_FIRST, NULL, NULL, &storeData, &receivingState, MSG_DATA_LAST - MSG_DATA_FIRST },
+ * { STATEM_EVENT_ANY, NULL, NULL, &logUnexpected, &errorState },
+ * ~~~
+ *
  * \sa event
  * \sa state
  */
@@ -169,8 +233,46 @@ struct transition
     // 这必须指向将要进入的下一个状态。 
     // 它不能为 NULL。 如果是，状态机会检测到并进入\ref state_machine::state_error "error state"
     struct state *state_next;
+
+    // 事件类型范围的宽度，匹配#event_type 到#event_type + #event_span，为0时只匹配#event_type
+    unsigned int event_span;
 };
 
+/**
+ * \brief Check whether a transition accepts an event type, ignoring its guard
+ */
+static inline bool statem_transition_match(const struct transition *transition, int event_type)
+{
+    if (transition->event_type == STATEM_EVENT_ANY)
+    {
+        return event_type != STATEM_EVENT_COMPLETION;
+    }
+
+    // 无符号减法同时检查下限和上限
+    return (unsigned int)event_type - (unsigned int)transition->event_type <= transition->event_span;
+}
+
+/**
+ * \brief Check whether two transitions accept a common event type
+ */
+static inline bool statem_transition_overlap(const struct transition *a, const struct transition *b)
+{
+    long long a_last = (long long)a->event_type + a->event_span;
+    long long b_last = (long long)b->event_type + b->event_span;
+
+    if (a->event_type == STATEM_EVENT_ANY)
+    {
+        return b->event_type != STATEM_EVENT_COMPLETION || b->event_span;
+    }
+
+    if (b->event_type == STATEM_EVENT_ANY)
+    {
+        return a->event_type != STATEM_EVENT_COMPLETION || a->event_span;
+    }
+
+    return a->event_type <= b_last && b->event_type <= a_last;
+}
+
 /**
  * \brief State
  *
@@ -237,6 +339,32 @@ struct transition
  * children chains. If such cycles are present, statem_handle_event() will
  * never finish due to never-ending loops.
  *
+ * ### Deferred events ###
+ * A state may list event types in #deferred_types. An event of such a type
+ * that triggers no transition in the state or its parents is not dropped but
+ * stored in the machine's deferred buffer, see statem_defer_set(). Deferral
+ * is inherited: a child state also defers the types listed by its parents.
+ * ~~~{.c}
+ * struct state busyState = {
+ *    .transitions = (struct transition[]){
+ *       { EVENT_DONE, NULL, NULL, NULL, &idleState },
+ *    },
+ *    .transition_nums = 1,
+ *    .deferred_types = (const int[]){ EVENT_REQUEST },
+ *    .deferred_nums = 1,
+ * };
+ * ~~~
+ * Whenever the machine has moved to another state, the stored events are
+ * passed to it again, oldest first. Events the new state still defers stay
+ * in the buffer; the others are dispatched and removed, whether or not they
+ * trigger a transition. This happens within the statem_handle_event() call
+ * that changed the state, which still returns the result of its own event.
+ * Once the machine enters its error state, whether through the event itself
+ * or through a replayed one, replaying stops and the buffer is cleared: the
+ * remaining events belong to the session that failed and are discarded
+ * without being counted in \ref state_machine::deferred_dropped
+ * "deferred_dropped".
+ *
  * ### Final state ###
  * A final state is a state that terminates the state machine. A state is
  * considered as a final state if its #transition_nums is 0:
@@ -277,6 +405,44 @@ struct state
 
     // 当前状态退出后的需要调用的函数，目标状态仍然是自身则不调用
     void (*action_exti)(void *state_data, struct event *event);
+
+    // 状态编号，由statem_graph_build()按遍历顺序分配，用户无需设置
+    unsigned int id;
+
+    // 在本状态及子状态中没有转换时推迟处理的事件类型
+    const int *deferred_types;
+
+    // #deferred_types 数组中的事件类型数
+    size_t deferred_nums;
+};
+
+/**
+ * \brief Transition lookup strategy
+ *
+ * By default statem_handle_event() scans \ref state::transitions
+ * "transitions" in order and returns the first transition whose event type
+ * matches and whose guard accepts the event. A finder replaces that scan, for
+ * instance with an index or a reordered copy of the transitions. It must
+ * return exactly the transition the default scan would have returned.
+ */
+struct statem_finder
+{
+    // 在状态state中查找事件event对应的转换，没有则返回NULL
+    struct transition *(*find)(void *ctx, struct state *state, struct event *event);
+
+    // find的参数
+    void *ctx;
+};
+
+/**
+ * \brief What happens to an event deferred while the deferred buffer is full
+ */
+enum statem_defer_overflow
+{
+    /** \brief Drop the new event, statem_handle_event() returns #STATEM_STATE_NOCHANGE */
+    STATEM_DEFER_DROP_NEWEST,
+    /** \brief Drop the oldest stored event to make room */
+    STATEM_DEFER_DROP_OLDEST,
 };
 
 /**
@@ -296,8 +462,64 @@ struct state_machine
     // 指向在状态机中发生错误时将进入的状态的指针
     // 有关状态机何时进入错误状态，请参阅#STATEM_ERR_STATE_RECHED
     struct state *state_error;
+
+    // 查找转换的方法，为NULL时按顺序扫描转换数组
+    const struct statem_finder *finder;
+
+    // 推迟事件的环形缓冲区，由statem_defer_set()设置
+    struct event *deferred;
+    size_t deferred_max;
+    size_t deferred_head;
+    size_t deferred_nums;
+    enum statem_defer_overflow deferred_overflow;
+
+    // 缓冲区满而丢弃的推迟事件数
+    size_t deferred_dropped;
+
+    // 供其他线程读取的当前状态和上一个状态，由statem_publish()写入。
+    // 序号为奇数时表示正在写入，每次发布加2
+    size_t snapshot_sequence;
+    struct state *snapshot_current;
+    struct state *snapshot_previous;
 };
 
+/**
+ * \brief Consistent view of a state machine taken from another thread
+ */
+struct statem_snapshot
+{
+    /** \brief The current state */
+    struct state *state_current;
+    /** \brief The previous state */
+    struct state *state_previous;
+    /** \brief Number of state changes since statem_init() */
+    size_t transitions;
+};
+
+/**
+ * \brief Publish the current and previous state to other threads
+ *
+ * statem_handle_event() calls this once per transition, after the entry
+ * action, so observers never see the intermediate state the callbacks see.
+ * Code that sets \ref state_machine::state_current "state_current" or \ref
+ * state_machine::state_previous "state_previous" directly must call it
+ * afterwards. Only the dispatching thread may call it.
+ *
+ * \param state_machine the state machine.
+ */
+static inline void statem_publish(struct state_machine *state_machine)
+{
+    size_t sequence = state_machine->snapshot_sequence;
+
+    STATEM_ATOMIC_STORE_RELAXED(&state_machine->snapshot_sequence, sequence + 1);
+    STATEM_ATOMIC_FENCE_RELEASE();
+
+    STATEM_ATOMIC_STORE_RELAXED(&state_machine->snapshot_current, state_machine->state_current);
+    STATEM_ATOMIC_STORE_RELAXED(&state_machine->snapshot_previous, state_machine->state_previous);
+
+    STATEM_ATOMIC_STORE(&state_machine->snapshot_sequence, sequence + 2);
+}
+
 /**
  * \brief Initialise the state machine
  *
@@ -361,6 +583,8 @@ enum statem_handle_event_return_vals
     STATEM_STATE_NOCHANGE,
     /** \brief A final state (any but the error state) was reached */
     STATEM_FINAL_STATE_RECHED,
+    /** \brief The event was stored in the deferred buffer */
+    STATEM_EVENT_DEFERRED,
 };
 
 /**
@@ -406,6 +630,48 @@ struct state *statem_state_current(struct state_machine *state_machine);
  */
 struct state *statem_state_previous(struct state_machine *state_machine);
 
+/**
+ * \brief Read the state of a machine dispatched by another thread
+ *
+ * statem_state_current() and statem_state_previous() may only be called by
+ * the thread that dispatches the machine. This function may be called from
+ * any thread at any time: it reads the last published current state,
+ * previous state and transition count as one consistent tuple, without a
+ * lock and without slowing down the dispatching thread. If a transition is
+ * published during the read, the read is repeated.
+ *
+ * \note statem_init() resets the snapshot non-atomically, no other thread
+ * may read the machine while it runs.
+ *
+ * \note The read retries while a publication is in progress. On a
+ * uniprocessor, do not call it from a thread or interrupt of higher
+ * priority than the dispatching thread: if it preempts the dispatching
+ * thread in the middle of statem_publish(), the sequence stays odd and the
+ * read never finishes.
+ *
+ * \param state_machine the state machine.
+ * \param snapshot the state read.
+ *
+ * \retval 0 on success.
+ * \retval -1 if an argument is NULL.
+ */
+int statem_snapshot_get(const struct state_machine *state_machine, struct statem_snapshot *snapshot);
+
+/**
+ * \brief Read the state of many machines, e.g. for a dashboard
+ *
+ * Every machine is read consistently as with statem_snapshot_get(), but one
+ * after another, so the snapshots are not taken at the same instant.
+ *
+ * \param machines the state machines, NULL entries give an empty snapshot.
+ * \param nums number of entries in \pn{machines} and \pn{snapshots}.
+ * \param snapshots the states read.
+ *
+ * \retval 0 on success.
+ * \retval -1 if an argument is NULL.
+ */
+int statem_snapshot_scan(struct state_machine *const *machines, size_t nums, struct statem_snapshot *snapshots);
+
 /**
  * \brief Check if the state machine has stopped
  *
@@ -417,6 +683,90 @@ struct state *statem_state_previous(struct state_machine *state_machine);
  */
 int statem_stopped(struct state_machine *state_machine);
 
+/**
+ * \brief Set the transition lookup strategy of a state machine
+ *
+ * statem_init() resets the finder, so this must be called after it.
+ *
+ * \param state_machine the state machine.
+ * \param finder the finder to use, or NULL to use the default scan.
+ *
+ * \retval 0 on success.
+ * \retval -1 if \pn{state_machine} is NULL.
+ */
+int statem_finder_set(struct state_machine *state_machine, const struct statem_finder *finder);
+
+/**
+ * \brief Set the deferred event buffer of a state machine
+ *
+ * Deferred events are copied into \pn{buffer}, which is used as a ring, so
+ * deferring never allocates. The \ref event::data "data" of a deferred
+ * event must stay valid until it is dispatched again. Without a buffer,
+ * \ref state::deferred_types "deferred_types" are ignored and such events
+ * are dropped as before. statem_init() removes the buffer, so this must be
+ * called after it.
+ *
+ * \param state_machine the state machine.
+ * \param buffer storage for \pn{size} events, or NULL to disable deferral.
+ * \param size number of events in \pn{buffer}.
+ * \param overflow what to do when an event is deferred while \pn{buffer} is
+ * full.
+ *
+ * \retval 0 on success.
+ * \retval -1 if \pn{state_machine} is NULL or \pn{buffer} is set and
+ * \pn{size} is 0.
+ */
+int statem_defer_set(struct state_machine *state_machine, struct event *buffer, size_t size,
+                     enum statem_defer_overflow overflow);
+
+/**
+ * \brief State graph
+ *
+ * A flat table of every state reachable from an initial state. States are
+ * numbered in a deterministic order, so the same graph definition yields the
+ * same \ref state::id "ids" in every build and every process. Logs, packed
+ * tables and other modules refer to states by these ids.
+ */
+struct statem_graph
+{
+    // 状态表，下标即状态编号
+    struct state **states;
+
+    // 状态表中的状态数
+    size_t state_nums;
+
+    // 状态表的容量
+    size_t state_max;
+};
+
+/**
+ * \brief Collect all states of a state graph and number them
+ *
+ * Starting from \pn{state_init} and \pn{state_error}, all states reachable
+ * through \ref state::state_parent "state_parent", \ref state::state_entry
+ * "state_entry" and \ref transition::state_next "state_next" are stored in
+ * \pn{states} and their \ref state::id "id" is set to their index.
+ *
+ * \param graph the graph to build.
+ * \param states storage for the state table.
+ * \param state_max number of entries in \pn{states}.
+ * \param state_init the initial state.
+ * \param state_error the error state, may be NULL.
+ *
+ * \retval 0 on success.
+ * \retval -1 if an argument is invalid or \pn{state_max} is too small.
+ */
+int statem_graph_build(struct statem_graph *graph, struct state **states, size_t state_max,
+                       struct state *state_init, struct state *state_error);
+
+/**
+ * \brief Get a state by its id
+ *
+ * \retval the state with the given \pn{id}.
+ * \retval NULL if \pn{graph} is NULL or \pn{id} is out of range.
+ */
+struct state *statem_graph_state(const struct statem_graph *graph, unsigned int id);
+
 #endif // state_machine_H
 
 /**
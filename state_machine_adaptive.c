@@ -0,0 +1,237 @@
+#include <string.h>
+#include "state_machine_adaptive.h"
+#include "state_machine_port.h"
+
+static struct transition *adaptive_find(void *ctx, struct state *state, struct event *event);
+
+/**
+ * @brief 初始化自适应查找
+ *
+ * 所有状态的查找顺序数组和命中计数在一块内存中分配
+ *
+ * @param ad        自适应查找上下文
+ * @param graph     已编号的状态图
+ * @param period    重排周期
+ * @return int      0：成功   -1：失败
+ */
+int statem_adaptive_init(struct statem_adaptive *ad, const struct statem_graph *graph, uint32_t period)
+{
+    size_t transition_nums = 0;
+    size_t i, j;
+    uint8_t *block;
+
+    if (!ad || !graph || !graph->state_nums || !period)
+    {
+        return -1;
+    }
+
+    for (i = 0; i < graph->state_nums; ++i)
+    {
+        transition_nums += graph->states[i]->transition_nums;
+    }
+
+    block = STATEM_MALLOC(graph->state_nums * sizeof(*ad->states)
+                          + transition_nums * (sizeof(struct transition *) + sizeof(uint32_t)));
+    if (!block)
+    {
+        return -1;
+    }
+
+    ad->states = (struct statem_adaptive_state *)block;
+    block += graph->state_nums * sizeof(*ad->states);
+
+    for (i = 0; i < graph->state_nums; ++i)
+    {
+        struct state *state = graph->states[i];
+
+        ad->states[i].order = (struct transition **)block;
+        block += state->transition_nums * sizeof(struct transition *);
+
+        for (j = 0; j < state->transition_nums; ++j)
+        {
+            ad->states[i].order[j] = &state->transitions[j];
+        }
+    }
+
+    for (i = 0; i < graph->state_nums; ++i)
+    {
+        ad->states[i].hits = (uint32_t *)block;
+        block += graph->states[i]->transition_nums * sizeof(uint32_t);
+        memset(ad->states[i].hits, 0, graph->states[i]->transition_nums * sizeof(uint32_t));
+    }
+
+    ad->finder.find = &adaptive_find;
+    ad->finder.ctx = ad;
+    ad->graph = graph;
+    ad->guard_nums = 0;
+    ad->period = period;
+    ad->countdown = period;
+    ad->cursor = 0;
+
+    return 0;
+}
+
+void statem_adaptive_free(struct statem_adaptive *ad)
+{
+    if (!ad || !ad->states)
+    {
+        return;
+    }
+
+    STATEM_FREE(ad->states);
+    ad->states = NULL;
+}
+
+int statem_adaptive_exclusive_guard(struct statem_adaptive *ad,
+                                    bool (*guard)(void *condition, struct event *event))
+{
+    if (!ad || !guard || ad->guard_nums >= STATEM_ADAPTIVE_GUARD_MAX)
+    {
+        return -1;
+    }
+
+    ad->guards[ad->guard_nums++] = guard;
+
+    return 0;
+}
+
+const struct statem_finder *statem_adaptive_finder(struct statem_adaptive *ad)
+{
+    return ad ? &ad->finder : NULL;
+}
+
+// 两个转换是否不可能同时匹配同一个事件
+static bool transition_exclusive(const struct statem_adaptive *ad,
+                                 const struct transition *a, const struct transition *b)
+{
+    size_t i;
+
+    if (!statem_transition_overlap(a, b))
+    {
+        return true;
+    }
+
+    if (!a->guard || a->guard != b->guard || a->condition == b->condition)
+    {
+        return false;
+    }
+
+    for (i = 0; i < ad->guard_nums; ++i)
+    {
+        if (ad->guards[i] == a->guard)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief 按命中次数重排一个状态的查找顺序
+ *
+ * 只交换相邻且互斥的两个转换，因此任意两个可能同时匹配的转换之间的先后顺序不变，
+ * 首个匹配的语义得以保持
+ *
+ * @param ad    自适应查找上下文
+ * @param id    状态编号
+ */
+static void state_reorder(struct statem_adaptive *ad, size_t id)
+{
+    struct state *state = ad->graph->states[id];
+    struct statem_adaptive_state *as = &ad->states[id];
+    bool swapped = true;
+    size_t j;
+
+    while (swapped)
+    {
+        swapped = false;
+
+        for (j = 1; j < state->transition_nums; ++j)
+        {
+            struct transition *a = as->order[j - 1];
+            struct transition *b = as->order[j];
+
+            if (as->hits[b - state->transitions] > as->hits[a - state->transitions]
+                && transition_exclusive(ad, a, b))
+            {
+                as->order[j - 1] = b;
+                as->order[j] = a;
+                swapped = true;
+            }
+        }
+    }
+
+    // 计数减半，使顺序能跟随流量变化
+    for (j = 0; j < state->transition_nums; ++j)
+    {
+        as->hits[j] >>= 1;
+    }
+}
+
+void statem_adaptive_reorder(struct statem_adaptive *ad)
+{
+    size_t i;
+
+    if (!ad || !ad->states)
+    {
+        return;
+    }
+
+    for (i = 0; i < ad->graph->state_nums; ++i)
+    {
+        state_reorder(ad, i);
+    }
+}
+
+// 按自适应顺序查找第一个满足条件的转换
+static struct transition *adaptive_find(void *ctx, struct state *state, struct event *event)
+{
+    struct statem_adaptive *ad = ctx;
+    struct statem_adaptive_state *as;
+    struct transition *found = NULL;
+    size_t i;
+
+    // 不属于该状态图的状态，按原顺序查找
+    if (state->id >= ad->graph->state_nums || ad->graph->states[state->id] != state)
+    {
+        for (i = 0; i < state->transition_nums; ++i)
+        {
+            struct transition *t = &state->transitions[i];
+
+            if (statem_transition_match(t, event->type) && (!t->guard || t->guard(t->condition, event)))
+            {
+                return t;
+            }
+        }
+
+        return NULL;
+    }
+
+    as = &ad->states[state->id];
+
+    for (i = 0; i < state->transition_nums; ++i)
+    {
+        struct transition *t = as->order[i];
+
+        if (statem_transition_match(t, event->type) && (!t->guard || t->guard(t->condition, event)))
+        {
+            as->hits[t - state->transitions]++;
+            found = t;
+            break;
+        }
+    }
+
+    // 每个周期只轮流重排一个状态，一次查找的额外开销不随状态数增长
+    if (!--ad->countdown)
+    {
+        ad->countdown = ad->period;
+        state_reorder(ad, ad->cursor);
+        if (++ad->cursor >= ad->graph->state_nums)
+        {
+            ad->cursor = 0;
+        }
+    }
+
+    return found;
+}
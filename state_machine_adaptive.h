@@ -0,0 +1,135 @@
+/**
+ * \addtogroup state_machine
+ * @{
+ *
+ * \file
+ * \brief Adaptive transition ordering driven by observed hit frequency
+ *
+ * The default lookup scans a state's transitions in array order, so a hot
+ * transition near the end of the array pays for every guard in front of it.
+ * An adaptive finder counts hits per transition and keeps a private copy of
+ * each state's transition list ordered so hot entries are tried first. Every
+ * \ref statem_adaptive::period "period" lookups the next state in turn is
+ * reordered, so the lookup that triggers it sorts a single state and the
+ * added latency does not grow with the size of the graph. A full pass over
+ * all states takes period × number of states lookups. The graph itself is
+ * never modified.
+ *
+ * First-match semantics are preserved: two transitions only swap places when
+ * they can never both match the same event. That is the case when their
+ * event types or \ref transition::event_span "ranges" are disjoint, or when both use the same guard that was declared with
+ * statem_adaptive_exclusive_guard() and their conditions differ. Anything
+ * else, in particular an unguarded catch-all, keeps its position relative to
+ * the transitions it overlaps with.
+ *
+ * \note An adaptive context is not thread safe. Use one context per dispatch
+ * thread; machines handled by that thread may share it.
+ *
+ * ~~~{.c}
+ * statem_graph_build(&graph, states, STATE_MAX, &state_idle, &state_error);
+ * statem_adaptive_init(&adaptive, &graph, 1024);
+ * statem_adaptive_exclusive_guard(&adaptive, &Eventkey_guard);
+ * statem_init(&m, &state_idle, &state_error);
+ * statem_finder_set(&m, statem_adaptive_finder(&adaptive));
+ * ~~~
+ */
+
+#ifndef __STATE_MACHINE_ADAPTIVE_H
+#define __STATE_MACHINE_ADAPTIVE_H
+
+#include <stdint.h>
+#include "state_machine.h"
+
+// 可声明的互斥guard函数个数
+#ifndef STATEM_ADAPTIVE_GUARD_MAX
+#define STATEM_ADAPTIVE_GUARD_MAX   8
+#endif
+
+/**
+ * \brief Per-state dispatch order
+ */
+struct statem_adaptive_state
+{
+    // 当前的查找顺序
+    struct transition **order;
+
+    // 每个转换的命中次数，下标为转换在原数组中的位置
+    uint32_t *hits;
+};
+
+/**
+ * \brief Adaptive finder context
+ *
+ * There is no need to manipulate the members directly.
+ */
+struct statem_adaptive
+{
+    struct statem_finder finder;
+    const struct statem_graph *graph;
+    struct statem_adaptive_state *states;
+
+    // 条件不同即互斥的guard函数
+    bool (*guards[STATEM_ADAPTIVE_GUARD_MAX])(void *condition, struct event *event);
+    size_t guard_nums;
+
+    // 每隔多少次查找重排一个状态，cursor为下一个重排的状态编号
+    uint32_t period;
+    uint32_t countdown;
+    size_t cursor;
+};
+
+/**
+ * \brief Initialise an adaptive finder for a numbered graph
+ *
+ * \param adaptive the context to initialise.
+ * \param graph a graph numbered by statem_graph_build().
+ * \param period number of lookups between reordering two consecutive
+ * states.
+ *
+ * \retval 0 on success.
+ * \retval -1 on invalid arguments or if memory could not be allocated.
+ */
+int statem_adaptive_init(struct statem_adaptive *adaptive, const struct statem_graph *graph,
+                         uint32_t period);
+
+/**
+ * \brief Release the memory of an adaptive finder
+ *
+ * No machine may use the finder any more.
+ */
+void statem_adaptive_free(struct statem_adaptive *adaptive);
+
+/**
+ * \brief Declare a guard whose matches are mutually exclusive
+ *
+ * The guard must accept an event for at most one value of its condition, as
+ * a guard comparing the condition with the event payload does. Transitions
+ * using it with different conditions may then be reordered.
+ *
+ * \retval 0 on success.
+ * \retval -1 on invalid arguments or if #STATEM_ADAPTIVE_GUARD_MAX guards
+ * are already declared.
+ */
+int statem_adaptive_exclusive_guard(struct statem_adaptive *adaptive,
+                                    bool (*guard)(void *condition, struct event *event));
+
+/**
+ * \brief Reorder all states now
+ *
+ * Lookups reorder one state per \ref statem_adaptive::period "period" on
+ * their own. This sorts every state at once, e.g. from the dispatch thread
+ * while it is idle or after a warm-up. Hit counts are halved afterwards so
+ * the order follows changes in traffic.
+ */
+void statem_adaptive_reorder(struct statem_adaptive *adaptive);
+
+/**
+ * \brief Get the finder to pass to statem_finder_set()
+ */
+const struct statem_finder *statem_adaptive_finder(struct statem_adaptive *adaptive);
+
+#endif // __STATE_MACHINE_ADAPTIVE_H
+
+/**
+ * @}
+ */
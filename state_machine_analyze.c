@@ -0,0 +1,394 @@
+#include <stdlib.h>
+#include <string.h>
+#include "state_machine_analyze.h"
+#include "state_machine_port.h"
+
+#define MAX(a, b)               ((a) > (b) ? (a) : (b))
+
+static uint32_t callback_cost(const struct statem_analyze_config *config, enum statem_callback_kind kind,
+                              const struct state *state, const struct transition *transition)
+{
+    return config->callback_cost ? config->callback_cost(config->ctx, kind, state, transition) : 0;
+}
+
+// 将一种结果的开销合并到最坏情况中
+static void analysis_merge(struct statem_analysis *analysis, unsigned int guards, unsigned int scans,
+                           unsigned int parent_hops, unsigned int entry_hops, unsigned int callbacks,
+                           uint64_t time)
+{
+    analysis->guards = MAX(analysis->guards, guards);
+    analysis->scans = MAX(analysis->scans, scans);
+    analysis->parent_hops = MAX(analysis->parent_hops, parent_hops);
+    analysis->entry_hops = MAX(analysis->entry_hops, entry_hops);
+    analysis->callbacks = MAX(analysis->callbacks, callbacks);
+    analysis->time = MAX(analysis->time, time);
+}
+
+// 进入错误状态：go_to_state_error()只执行错误状态的进入动作
+static void error_enter(const struct statem_analyze_config *config, unsigned int *callbacks, uint64_t *time)
+{
+    if (config->state_error && config->state_error->action_entry)
+    {
+        (*callbacks)++;
+        *time += callback_cost(config, STATEM_CALLBACK_ENTRY, config->state_error, NULL);
+    }
+}
+
+#if STATEM_COMPLETION_HOPS_MAX > 0
+// 状态是否已在本次分发中进入过
+static bool state_visited(const struct state **visited, size_t nums, const struct state *state)
+{
+    size_t i;
+
+    for (i = 0; i < nums; ++i)
+    {
+        if (visited[i] == state)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+#endif
+
+/**
+ * @brief 分析一次转换查找的最坏开销，不含固定开销
+ *
+ * 按statem_handle_event()的查找顺序枚举所有可能的结果：依次选中每个候选转换，
+ * 或者所有guard都不满足，每项计数分别取最大值。选中的转换进入新状态后，
+ * 加上新状态的无事件转换链的最坏开销；核心转入错误状态时，加上错误状态的进入动作
+ *
+ * @param config        开销配置
+ * @param state         状态
+ * @param event_type    事件类型
+ * @param visited       本次分发中经无事件转换进入过的状态
+ * @param depth         已执行的无事件转换个数
+ * @param analysis      分析结果
+ */
+static void analyze_dispatch(const struct statem_analyze_config *config, const struct state *state,
+                             int event_type, const struct state **visited, size_t depth,
+                             struct statem_analysis *analysis)
+{
+    const struct state *s;
+    unsigned int guards = 0, scans = 0, parent_hops = 0;
+    uint64_t time = 0;
+
+    // 终止状态直接返回
+    if (!state->transition_nums && !state->state_parent)
+    {
+        return;
+    }
+
+    for (s = state; s; s = s->state_parent, ++parent_hops)
+    {
+        size_t j;
+
+        if (s != state)
+        {
+            time += config->parent_cost;
+        }
+
+        for (j = 0; j < s->transition_nums; ++j)
+        {
+            const struct transition *t = &s->transitions[j];
+            const struct state *next = t->state_next;
+            unsigned int entry_hops = 0, callbacks;
+            struct statem_analysis chain;
+            uint64_t time_taken;
+
+            scans++;
+            time += config->scan_cost;
+
+            if (!statem_transition_match(t, event_type))
+            {
+                continue;
+            }
+
+            if (t->guard)
+            {
+                guards++;
+                time += callback_cost(config, STATEM_CALLBACK_GUARD, s, t);
+            }
+
+            // 选中该转换
+            callbacks = guards;
+            time_taken = time;
+            memset(&chain, 0, sizeof(chain));
+
+            if (next)
+            {
+                while (next->state_entry)
+                {
+                    next = next->state_entry;
+                    entry_hops++;
+                    time_taken += config->entry_cost;
+                }
+
+                if (next != state && state->action_exti)
+                {
+                    callbacks++;
+                    time_taken += callback_cost(config, STATEM_CALLBACK_EXIT, state, NULL);
+                }
+
+                if (t->action)
+                {
+                    callbacks++;
+                    time_taken += callback_cost(config, STATEM_CALLBACK_ACTION, s, t);
+                }
+
+                if (next != state && next->action_entry)
+                {
+                    callbacks++;
+                    time_taken += callback_cost(config, STATEM_CALLBACK_ENTRY, next, NULL);
+                }
+
+#if STATEM_COMPLETION_HOPS_MAX > 0
+                // 无事件转换回到自身、进入已进入过的状态或者超过跳转上限时，核心转入错误状态
+                if (depth && (next == state || depth > STATEM_COMPLETION_HOPS_MAX
+                              || state_visited(visited, depth, next)))
+                {
+                    error_enter(config, &callbacks, &time_taken);
+                }
+                // 进入新状态后继续执行无事件转换
+                else if (next != state)
+                {
+                    visited[depth] = next;
+                    analyze_dispatch(config, next, STATEM_EVENT_COMPLETION, visited, depth + 1, &chain);
+                }
+#else
+                (void)visited;
+                (void)depth;
+#endif
+            }
+            else
+            {
+                // 转换没有目标状态
+                error_enter(config, &callbacks, &time_taken);
+            }
+
+            analysis_merge(analysis, guards + chain.guards, scans + chain.scans,
+                           parent_hops + chain.parent_hops, entry_hops + chain.entry_hops,
+                           callbacks + chain.callbacks, time_taken + chain.time);
+
+            // 无条件转换一定被选中，后面的候选不可达
+            if (!t->guard)
+            {
+                return;
+            }
+        }
+    }
+
+    // 没有转换被选中，查找到了状态链的末端
+    analysis_merge(analysis, guards, scans, parent_hops - 1, 0, guards, time);
+}
+
+/**
+ * @brief 分析一个(状态, 事件类型)的最坏分发开销
+ *
+ * @param config        开销配置
+ * @param state         状态
+ * @param event_type    事件类型
+ * @param analysis      分析结果
+ * @return int          0：成功   -1：失败
+ */
+int statem_analyze_state(const struct statem_analyze_config *config, const struct state *state,
+                         int event_type, struct statem_analysis *analysis)
+{
+    const struct state *visited[STATEM_COMPLETION_HOPS_MAX + 1];
+
+    if (!config || !state || !analysis)
+    {
+        return -1;
+    }
+
+    memset(analysis, 0, sizeof(*analysis));
+
+    analyze_dispatch(config, state, event_type, visited, 0, analysis);
+
+    analysis->state = state;
+    analysis->event_type = event_type;
+    analysis->time += config->base_cost;
+    analysis->over_budget = config->budget && analysis->time > config->budget;
+
+    return 0;
+}
+
+// 区间边界排序比较
+static int point_compare(const void *a, const void *b)
+{
+    long long x = *(const long long *)a, y = *(const long long *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+// 事件类型是否被某个非通配转换接受
+static bool type_accepted(const struct statem_graph *graph, int type)
+{
+    size_t i, j;
+
+    for (i = 0; i < graph->state_nums; ++i)
+    {
+        for (j = 0; j < graph->states[i]->transition_nums; ++j)
+        {
+            const struct transition *t = &graph->states[i]->transitions[j];
+
+            if (t->event_type != STATEM_EVENT_ANY && statem_transition_match(t, type))
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+// 两个事件类型是否被同样的转换接受，通配转换接受所有外部事件，不用比较
+static bool type_equivalent(const struct statem_graph *graph, int a, int b)
+{
+    size_t i, j;
+
+    for (i = 0; i < graph->state_nums; ++i)
+    {
+        for (j = 0; j < graph->states[i]->transition_nums; ++j)
+        {
+            const struct transition *t = &graph->states[i]->transitions[j];
+
+            if (t->event_type != STATEM_EVENT_ANY && statem_transition_match(t, a) != statem_transition_match(t, b))
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// 分析一种事件类型在所有状态下的开销，返回超出预算的个数
+static int analyze_type(const struct statem_graph *graph, const struct statem_analyze_config *config, int event_type,
+                        void (*report)(void *ctx, const struct statem_analysis *analysis), void *ctx)
+{
+    int over_budget = 0;
+    size_t k;
+
+    for (k = 0; k < graph->state_nums; ++k)
+    {
+        struct statem_analysis analysis;
+
+        statem_analyze_state(config, graph->states[k], event_type, &analysis);
+
+        if (analysis.over_budget)
+        {
+            over_budget++;
+        }
+
+        if (report)
+        {
+            report(ctx, &analysis);
+        }
+    }
+
+    return over_budget;
+}
+
+/**
+ * @brief 分析状态图中所有(状态, 事件类型)的最坏分发开销
+ *
+ * @param graph     已编号的状态图
+ * @param config    开销配置
+ * @param report    结果回调
+ * @param ctx       回调参数
+ * @return int      超出预算的个数，-1：失败
+ */
+int statem_analyze(const struct statem_graph *graph, const struct statem_analyze_config *config,
+                   void (*report)(void *ctx, const struct statem_analysis *analysis), void *ctx)
+{
+    size_t point_nums = 0, transition_nums = 0, i, j;
+    long long *points;
+    int over_budget = 0, previous = 0;
+    bool any = false, reported = false;
+
+    if (!graph || !config)
+    {
+        return -1;
+    }
+
+    for (i = 0; i < graph->state_nums; ++i)
+    {
+        transition_nums += graph->states[i]->transition_nums;
+    }
+
+    points = STATEM_MALLOC((transition_nums * 3 + 1) * sizeof(*points));
+    if (!points)
+    {
+        return -1;
+    }
+
+    // 与ranges_build()相同，收集所有转换的区间边界，相邻边界之间的事件类型被同样的转换接受
+    for (i = 0; i < graph->state_nums; ++i)
+    {
+        for (j = 0; j < graph->states[i]->transition_nums; ++j)
+        {
+            const struct transition *t = &graph->states[i]->transitions[j];
+            long long last = (long long)t->event_type + t->event_span;
+
+            if (t->event_type == STATEM_EVENT_ANY)
+            {
+                any = true;
+                continue;
+            }
+
+            points[point_nums++] = t->event_type;
+            if (last < INT_MAX)
+            {
+                points[point_nums++] = last + 1;
+            }
+            if (t->event_type == STATEM_EVENT_COMPLETION)
+            {
+                points[point_nums++] = (long long)STATEM_EVENT_COMPLETION + 1;
+            }
+        }
+    }
+
+    qsort(points, point_nums, sizeof(*points), &point_compare);
+
+    // 每个区间取第一个事件类型，与上一个分析过的类型等价时跳过
+    for (i = 0; i < point_nums; ++i)
+    {
+        long long type = points[i];
+
+        if (i && type == points[i - 1])
+        {
+            continue;
+        }
+
+        // 无事件转换不由外部分发，其开销计入进入该状态的转换，区间内的其余类型仍要分析
+        if (type == STATEM_EVENT_COMPLETION)
+        {
+            type++;
+            if (i + 1 < point_nums && points[i + 1] <= type)
+            {
+                continue;
+            }
+        }
+
+        // 只被通配转换接受的区间由STATEM_EVENT_ANY代表
+        if (!type_accepted(graph, (int)type) || (reported && type_equivalent(graph, previous, (int)type)))
+        {
+            continue;
+        }
+
+        over_budget += analyze_type(graph, config, (int)type, report, ctx);
+        previous = (int)type;
+        reported = true;
+    }
+
+    if (any)
+    {
+        over_budget += analyze_type(graph, config, STATEM_EVENT_ANY, report, ctx);
+    }
+
+    STATEM_FREE(points);
+
+    return over_budget;
+}
@@ -0,0 +1,164 @@
+/**
+ * \addtogroup state_machine
+ * @{
+ *
+ * \file
+ * \brief Static worst-case dispatch cost analysis
+ *
+ * The cost of statem_handle_event() depends on the current state's
+ * transitions, the guards met while walking up the \ref state::state_parent
+ * "state_parent" chain, the \ref state::state_entry "state_entry" descent of
+ * the target and the callbacks that run. statem_analyze() walks every
+ * (state, event type) pair of a numbered graph and reports, for each pair,
+ * the worst case of every count over all possible outcomes, i.e. whichever
+ * transition is taken or none at all, together with the worst-case
+ * dispatch time computed from per-step and per-callback cost annotations.
+ * Pairs whose worst-case time exceeds the configured budget are flagged.
+ *
+ * When a transition enters a new state, the worst case of the
+ * \ref STATEM_EVENT_COMPLETION "completion" chain that may follow within the
+ * same dispatch is added to that outcome. Where statem_handle_event() gives
+ * up and enters the error state, i.e. for a transition without a target, a
+ * completion transition back to its own state, a revisited state or a chain
+ * longer than #STATEM_COMPLETION_HOPS_MAX, the entry action of
+ * statem_analyze_config::state_error is added.
+ *
+ * \note \ref state::deferred_types "Deferred events" are not part of the
+ * analysis. After a state change, statem_handle_event() replays up to
+ * `deferred_max` buffered events (see statem_defer_set()) within the same
+ * call, each a full dispatch of its own, and every removal moves the events
+ * behind it, so the replay grows quadratically with the buffer size. The
+ * reported cost of an outcome that releases deferred events is therefore a
+ * lower bound; add the replay of a full buffer to the budget of such states.
+ *
+ * ~~~{.c}
+ * static uint32_t callback_cost(void *ctx, enum statem_callback_kind kind,
+ *                               const struct state *state, const struct transition *t)
+ * {
+ *     return kind == STATEM_CALLBACK_ENTRY && state == &state_post ? 400 : 20;
+ * }
+ *
+ * struct statem_analyze_config config = {
+ *     .scan_cost = 2, .parent_cost = 4, .entry_cost = 2, .base_cost = 20,
+ *     .callback_cost = &callback_cost, .budget = 500,
+ * };
+ * statem_analyze(&graph, &config, &report, NULL);
+ * ~~~
+ */
+
+#ifndef __STATE_MACHINE_ANALYZE_H
+#define __STATE_MACHINE_ANALYZE_H
+
+#include <stdint.h>
+#include "state_machine.h"
+
+/**
+ * \brief Kind of callback being annotated
+ */
+enum statem_callback_kind
+{
+    STATEM_CALLBACK_GUARD,
+    STATEM_CALLBACK_ACTION,
+    STATEM_CALLBACK_ENTRY,
+    STATEM_CALLBACK_EXIT,
+};
+
+/**
+ * \brief Cost annotations
+ *
+ * Costs are in any unit the user chooses, e.g. CPU cycles or nanoseconds.
+ */
+struct statem_analyze_config
+{
+    // 每次分发的固定开销
+    uint32_t base_cost;
+
+    // 比较一个转换的事件类型的开销
+    uint32_t scan_cost;
+
+    // 转到父状态查找一次的开销
+    uint32_t parent_cost;
+
+    // 沿入口状态向下一层的开销
+    uint32_t entry_cost;
+
+    // 回调函数的开销，guard/action传入转换，entry/exit传入状态，为NULL时回调开销为0
+    uint32_t (*callback_cost)(void *ctx, enum statem_callback_kind kind,
+                              const struct state *state, const struct transition *transition);
+
+    // 单次分发的时间预算，0表示不检查
+    uint32_t budget;
+
+    // callback_cost的参数
+    void *ctx;
+
+    // 错误状态，转换没有目标状态或无事件转换死循环时进入，为NULL时不计其进入动作
+    const struct state *state_error;
+};
+
+/**
+ * \brief Worst-case cost of one (state, event type) pair
+ */
+struct statem_analysis
+{
+    const struct state *state;
+    int event_type;
+
+    // 最坏情况下调用guard的次数
+    unsigned int guards;
+
+    // 最坏情况下比较的转换个数
+    unsigned int scans;
+
+    // 最坏情况下转到父状态的次数
+    unsigned int parent_hops;
+
+    // 最坏情况下沿入口状态向下的层数
+    unsigned int entry_hops;
+
+    // 最坏情况下调用回调函数的总次数（guard、action、entry、exit）
+    unsigned int callbacks;
+
+    // 最坏情况下的分发时间，回调开销之和可能超过32位
+    uint64_t time;
+
+    // 超出时间预算
+    bool over_budget;
+};
+
+/**
+ * \brief Analyse one (state, event type) pair
+ *
+ * \retval 0 on success.
+ * \retval -1 on invalid arguments.
+ */
+int statem_analyze_state(const struct statem_analyze_config *config, const struct state *state,
+                         int event_type, struct statem_analysis *analysis);
+
+/**
+ * \brief Analyse every (state, event type) pair of a graph
+ *
+ * The event types are split at every boundary of an event range in the
+ * graph, so that each transition accepts either all or none of the types
+ * between two boundaries, and the first type of each such interval is
+ * analysed; adjacent intervals accepted by the same transitions are
+ * analysed once. #STATEM_EVENT_COMPLETION is never analysed on its own,
+ * and #STATEM_EVENT_ANY stands for the types that only wildcard
+ * transitions accept.
+ *
+ * \param graph a graph numbered by statem_graph_build().
+ * \param config the cost annotations.
+ * \param report called for every pair, may be NULL.
+ * \param ctx argument passed to \pn{report}.
+ *
+ * \return the number of pairs over budget, or -1 on invalid arguments or
+ * allocation failure.
+ */
+int statem_analyze(const struct statem_graph *graph, const struct statem_analyze_config *config,
+                   void (*report)(void *ctx, const struct statem_analysis *analysis), void *ctx);
+
+#endif // __STATE_MACHINE_ANALYZE_H
+
+/**
+ * @}
+ */
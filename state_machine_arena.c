@@ -0,0 +1,330 @@
+#include <string.h>
+#include "state_machine_arena.h"
+#include "state_machine_port.h"
+
+#ifdef __linux__
+#include <sys/mman.h>
+
+#define HUGE_PAGE_SIZE          (2u << 20)
+#define HUGE_ROUND(size)        (((size) + HUGE_PAGE_SIZE - 1) & ~(size_t)(HUGE_PAGE_SIZE - 1))
+
+static void *huge_alloc(void *ctx, size_t size)
+{
+    void *memory = MAP_FAILED;
+
+    (void)ctx;
+    size = HUGE_ROUND(size);
+
+#ifdef MAP_HUGETLB
+    memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+
+    // 没有预留大页时使用普通映射，由透明大页合并
+    if (memory == MAP_FAILED)
+    {
+        memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED)
+        {
+            return NULL;
+        }
+#ifdef MADV_HUGEPAGE
+        madvise(memory, size, MADV_HUGEPAGE);
+#endif
+    }
+
+    return memory;
+}
+
+static void huge_free(void *ctx, void *memory, size_t size)
+{
+    (void)ctx;
+
+    munmap(memory, HUGE_ROUND(size));
+}
+
+const struct statem_arena_allocator statem_arena_huge = { &huge_alloc, &huge_free, NULL };
+#endif
+
+static void *heap_alloc(void *ctx, size_t size)
+{
+    (void)ctx;
+
+    return STATEM_MALLOC(size);
+}
+
+static void heap_free(void *ctx, void *memory, size_t size)
+{
+    (void)ctx;
+    (void)size;
+
+    STATEM_FREE(memory);
+}
+
+static const struct statem_arena_allocator heap_allocator = { &heap_alloc, &heap_free, NULL };
+
+// 状态及其转换数组占用的字节数，按指针对齐
+static size_t state_size(const struct state *state)
+{
+    size_t size = sizeof(struct state) + state->transition_nums * sizeof(struct transition);
+
+    return (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+}
+
+static uint64_t transition_hits(uint64_t (*hits)(void *ctx, const struct state *state, size_t index),
+                                void *ctx, const struct state *state, size_t index)
+{
+    return hits ? hits(ctx, state, index) : 0;
+}
+
+/**
+ * @brief 按命中次数确定状态的布局顺序
+ *
+ * 从最热的未放置状态开始，沿命中次数最多且目标尚未放置的转换依次放置，
+ * 链断开后再从剩余最热的状态开始。热度为转出和转入的命中次数之和，
+ * 没有命中记录时保持编号顺序
+ *
+ * @param graph     状态图
+ * @param hits      命中次数回调函数
+ * @param ctx       回调函数的参数
+ * @param order     输出的状态编号顺序
+ * @return int      0：成功   -1：失败
+ */
+static int layout_order(const struct statem_graph *graph,
+                        uint64_t (*hits)(void *ctx, const struct state *state, size_t index), void *ctx,
+                        unsigned int *order)
+{
+    uint64_t *heat;
+    bool *placed;
+    size_t i, j, nums = 0;
+
+    heat = STATEM_MALLOC(graph->state_nums * sizeof(*heat));
+    placed = STATEM_MALLOC(graph->state_nums * sizeof(*placed));
+    if (!heat || !placed)
+    {
+        STATEM_FREE(heat);
+        STATEM_FREE(placed);
+        return -1;
+    }
+
+    memset(heat, 0, graph->state_nums * sizeof(*heat));
+    memset(placed, 0, graph->state_nums * sizeof(*placed));
+
+    for (i = 0; i < graph->state_nums; ++i)
+    {
+        const struct state *state = graph->states[i];
+
+        for (j = 0; j < state->transition_nums; ++j)
+        {
+            uint64_t count = transition_hits(hits, ctx, state, j);
+
+            heat[i] += count;
+            if (state->transitions[j].state_next)
+            {
+                heat[state->transitions[j].state_next->id] += count;
+            }
+        }
+    }
+
+    while (nums < graph->state_nums)
+    {
+        size_t current = graph->state_nums;
+
+        for (i = 0; i < graph->state_nums; ++i)
+        {
+            if (!placed[i] && (current == graph->state_nums || heat[i] > heat[current]))
+            {
+                current = i;
+            }
+        }
+
+        // 沿最热的转换连续放置
+        while (current < graph->state_nums)
+        {
+            const struct state *state = graph->states[current];
+            size_t next = graph->state_nums;
+            uint64_t best = 0;
+
+            placed[current] = true;
+            order[nums++] = (unsigned int)current;
+
+            for (j = 0; j < state->transition_nums; ++j)
+            {
+                const struct state *target = state->transitions[j].state_next;
+                uint64_t count = transition_hits(hits, ctx, state, j);
+
+                if (target && !placed[target->id] && count > best)
+                {
+                    best = count;
+                    next = target->id;
+                }
+            }
+
+            current = next;
+        }
+    }
+
+    STATEM_FREE(heat);
+    STATEM_FREE(placed);
+
+    return 0;
+}
+
+/**
+ * @brief 按命中次数重排一个状态的转换
+ *
+ * 与自适应查找相同，只交换相邻且不会匹配同一事件类型的两个转换，
+ * 因此可能匹配同一事件的转换之间的先后顺序不变
+ *
+ * @param state         原状态
+ * @param transitions   输出的转换数组
+ * @param hits          命中次数回调函数
+ * @param ctx           回调函数的参数
+ * @param counts        临时数组，至少transition_nums项
+ */
+static void transitions_copy(const struct state *state, struct transition *transitions,
+                             uint64_t (*hits)(void *ctx, const struct state *state, size_t index), void *ctx,
+                             uint64_t *counts)
+{
+    bool swapped = true;
+    size_t j;
+
+    for (j = 0; j < state->transition_nums; ++j)
+    {
+        transitions[j] = state->transitions[j];
+        counts[j] = transition_hits(hits, ctx, state, j);
+    }
+
+    while (swapped)
+    {
+        swapped = false;
+
+        for (j = 1; j < state->transition_nums; ++j)
+        {
+            if (counts[j] > counts[j - 1] && !statem_transition_overlap(&transitions[j], &transitions[j - 1]))
+            {
+                struct transition t = transitions[j];
+                uint64_t c = counts[j];
+
+                transitions[j] = transitions[j - 1];
+                transitions[j - 1] = t;
+                counts[j] = counts[j - 1];
+                counts[j - 1] = c;
+                swapped = true;
+            }
+        }
+    }
+}
+
+// 将原状态图中的指针映射到重定位后的状态
+static struct state *state_map(struct state **states, const struct state *state)
+{
+    return state ? states[state->id] : NULL;
+}
+
+int statem_arena_build(struct statem_arena *arena, const struct statem_graph *graph,
+                       uint64_t (*hits)(void *ctx, const struct state *state, size_t index), void *ctx,
+                       const struct statem_arena_allocator *allocator)
+{
+    struct state **states;
+    unsigned int *order;
+    uint64_t *counts;
+    size_t i, j, size = 0, transition_max = 1;
+    uint8_t *p;
+
+    if (!arena || !graph || !graph->state_nums)
+    {
+        return -1;
+    }
+
+    for (i = 0; i < graph->state_nums; ++i)
+    {
+        size += state_size(graph->states[i]);
+        if (graph->states[i]->transition_nums > transition_max)
+        {
+            transition_max = graph->states[i]->transition_nums;
+        }
+    }
+    size += graph->state_nums * sizeof(*states);
+
+    order = STATEM_MALLOC(graph->state_nums * sizeof(*order));
+    counts = STATEM_MALLOC(transition_max * sizeof(*counts));
+    if (!order || !counts || layout_order(graph, hits, ctx, order))
+    {
+        STATEM_FREE(order);
+        STATEM_FREE(counts);
+        return -1;
+    }
+
+    arena->allocator = allocator ? allocator : &heap_allocator;
+    arena->size = size;
+    arena->memory = arena->allocator->alloc(arena->allocator->ctx, size);
+    if (!arena->memory)
+    {
+        STATEM_FREE(order);
+        STATEM_FREE(counts);
+        return -1;
+    }
+
+    // 状态表放在末尾，热路径只访问前面的状态和转换
+    p = arena->memory;
+    states = (struct state **)(p + size - graph->state_nums * sizeof(*states));
+
+    for (i = 0; i < graph->state_nums; ++i)
+    {
+        const struct state *state = graph->states[order[i]];
+        struct state *copy = (struct state *)p;
+
+        *copy = *state;
+        copy->transitions = state->transition_nums ? (struct transition *)(copy + 1) : NULL;
+        transitions_copy(state, copy->transitions, hits, ctx, counts);
+
+        states[state->id] = copy;
+        p += state_size(state);
+    }
+
+    // 所有状态放置完成后再修正指针
+    for (i = 0; i < graph->state_nums; ++i)
+    {
+        struct state *state = states[i];
+
+        state->state_parent = state_map(states, state->state_parent);
+        state->state_entry = state_map(states, state->state_entry);
+
+        for (j = 0; j < state->transition_nums; ++j)
+        {
+            state->transitions[j].state_next = state_map(states, state->transitions[j].state_next);
+        }
+    }
+
+    arena->graph.states = states;
+    arena->graph.state_nums = graph->state_nums;
+    arena->graph.state_max = graph->state_nums;
+
+    STATEM_FREE(order);
+    STATEM_FREE(counts);
+
+    return 0;
+}
+
+void statem_arena_free(struct statem_arena *arena)
+{
+    if (!arena || !arena->memory)
+    {
+        return;
+    }
+
+    arena->allocator->free(arena->allocator->ctx, arena->memory, arena->size);
+    arena->memory = NULL;
+    arena->graph.states = NULL;
+    arena->graph.state_nums = 0;
+}
+
+struct state *statem_arena_state(const struct statem_arena *arena, const struct state *state)
+{
+    if (!arena || !state)
+    {
+        return NULL;
+    }
+
+    return statem_graph_state(&arena->graph, state->id);
+}
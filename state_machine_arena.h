@@ -0,0 +1,119 @@
+/**
+ * \addtogroup state_machine
+ * @{
+ *
+ * \file
+ * \brief Profile-guided relocation of a graph into one contiguous arena
+ *
+ * States defined as separate objects, each with its own compound literal
+ * transition array, are scattered across the data section, so following a
+ * few transitions touches many unrelated cache lines. statem_arena_build()
+ * copies every state of a numbered graph into a single block of memory,
+ * each state directly followed by its transitions, and rewrites every
+ * \ref state::state_parent "state_parent", \ref state::state_entry
+ * "state_entry" and \ref transition::state_next "state_next" pointer to the
+ * copies. The \ref state::id "ids" are kept, so the copies form a graph
+ * with the same numbering.
+ *
+ * The layout follows observed hit counts, e.g. those of an \ref
+ * statem_adaptive "adaptive finder": starting from the hottest state, the
+ * hottest successor not yet placed is laid out next, so frequent transition
+ * sequences run through adjacent cache lines. Within a state, hot
+ * transitions are moved to the front, but only past transitions that
+ * cannot match the same event type, so the first matching transition stays
+ * the same.
+ *
+ * The arena comes from an allocator hook; #statem_arena_huge places it in
+ * huge pages on Linux.
+ *
+ * ~~~{.c}
+ * statem_arena_build(&arena, &graph, &hits_get, &adaptive, &statem_arena_huge);
+ * statem_init(&m, statem_arena_state(&arena, &state_idle), statem_arena_state(&arena, &state_error));
+ * ~~~
+ *
+ * \note The copies share \ref state::data "data", conditions and callbacks
+ * with the original states. The original graph is not modified.
+ */
+
+#ifndef __STATE_MACHINE_ARENA_H
+#define __STATE_MACHINE_ARENA_H
+
+#include <stdint.h>
+#include "state_machine.h"
+
+/**
+ * \brief Arena allocator hook
+ */
+struct statem_arena_allocator
+{
+    void *(*alloc)(void *ctx, size_t size);
+    void (*free)(void *ctx, void *memory, size_t size);
+    void *ctx;
+};
+
+#ifdef __linux__
+/**
+ * \brief Allocate the arena in huge pages
+ *
+ * Tries explicit huge pages first, then falls back to an ordinary mapping
+ * marked for transparent huge pages.
+ */
+extern const struct statem_arena_allocator statem_arena_huge;
+#endif
+
+/**
+ * \brief Relocated graph
+ *
+ * There is no need to manipulate the members directly.
+ */
+struct statem_arena
+{
+    // 连续内存块，按布局顺序存放状态及其转换数组，末尾为状态表
+    void *memory;
+    size_t size;
+
+    // 重定位后的状态图，编号与原状态图相同
+    struct statem_graph graph;
+
+    const struct statem_arena_allocator *allocator;
+};
+
+/**
+ * \brief Copy a graph into a contiguous arena
+ *
+ * \param arena the arena to build.
+ * \param graph a graph numbered by statem_graph_build().
+ * \param hits returns how often transition \pn{index} of \pn{state} was
+ * taken, may be NULL to keep the graph order.
+ * \param ctx argument passed to \pn{hits}.
+ * \param allocator the allocator of the arena, NULL for #STATEM_MALLOC.
+ *
+ * \retval 0 on success.
+ * \retval -1 on invalid arguments or if memory could not be allocated.
+ */
+int statem_arena_build(struct statem_arena *arena, const struct statem_graph *graph,
+                       uint64_t (*hits)(void *ctx, const struct state *state, size_t index), void *ctx,
+                       const struct statem_arena_allocator *allocator);
+
+/**
+ * \brief Release an arena
+ *
+ * No machine may use the relocated states any more.
+ */
+void statem_arena_free(struct statem_arena *arena);
+
+/**
+ * \brief Get the copy of a state
+ *
+ * \param state a state of the original graph, or its copy.
+ *
+ * \retval the relocated state with the same \ref state::id "id".
+ * \retval NULL if \pn{state} is NULL or its id is out of range.
+ */
+struct state *statem_arena_state(const struct statem_arena *arena, const struct state *state);
+
+#endif // __STATE_MACHINE_ARENA_H
+
+/**
+ * @}
+ */
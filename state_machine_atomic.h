@@ -0,0 +1,91 @@
+/**
+ * \addtogroup state_machine
+ * @{
+ *
+ * \file
+ * \brief Atomic operations used by the core and the optional modules
+ *
+ * By default the GCC built-ins are used, which GCC, Clang and armclang
+ * support. Every macro may be overridden by defining it before this header
+ * is included, for instance with the intrinsics of another compiler.
+ *
+ * The core only needs the loads, stores and fences, to publish the state
+ * for statem_snapshot_get(). Without the GCC built-ins they fall back to
+ * volatile accesses through `__typeof__`, which the compiler keeps in
+ * program order but the CPU may not, so the fallback is only correct on a
+ * uniprocessor; define the macros on a multiprocessor or for a compiler
+ * without `__typeof__`. The read-modify-write operations used by the
+ * optional modules have no fallback.
+ *
+ * \note 64-bit atomics on a 32-bit target may need libatomic (`-latomic`)
+ * when the CPU has no 64-bit load and store instructions.
+ */
+
+#ifndef __STATE_MACHINE_ATOMIC_H
+#define __STATE_MACHINE_ATOMIC_H
+
+#if defined(__GNUC__) || defined(__clang__)
+
+// 原子读取和写入，acquire/release语义
+#ifndef STATEM_ATOMIC_LOAD
+#define STATEM_ATOMIC_LOAD(ptr)                 __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#endif
+#ifndef STATEM_ATOMIC_STORE
+#define STATEM_ATOMIC_STORE(ptr, val)           __atomic_store_n(ptr, val, __ATOMIC_RELEASE)
+#endif
+
+// 只保证不撕裂，不保证顺序
+#ifndef STATEM_ATOMIC_LOAD_RELAXED
+#define STATEM_ATOMIC_LOAD_RELAXED(ptr)         __atomic_load_n(ptr, __ATOMIC_RELAXED)
+#endif
+#ifndef STATEM_ATOMIC_STORE_RELAXED
+#define STATEM_ATOMIC_STORE_RELAXED(ptr, val)   __atomic_store_n(ptr, val, __ATOMIC_RELAXED)
+#endif
+
+// 释放屏障，之前的读写不会被重排到之后的写入后面
+#ifndef STATEM_ATOMIC_FENCE_RELEASE
+#define STATEM_ATOMIC_FENCE_RELEASE()           __atomic_thread_fence(__ATOMIC_RELEASE)
+#endif
+
+// 获取屏障，之前的读取不会被重排到之后的读写后面
+#ifndef STATEM_ATOMIC_FENCE_ACQUIRE
+#define STATEM_ATOMIC_FENCE_ACQUIRE()           __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#endif
+
+#ifndef STATEM_ATOMIC_CAS
+#define STATEM_ATOMIC_CAS(ptr, expected, val)   __atomic_compare_exchange_n(ptr, expected, val, 0, \
+                                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#endif
+#ifndef STATEM_ATOMIC_ADD
+#define STATEM_ATOMIC_ADD(ptr, val)             __atomic_fetch_add(ptr, val, __ATOMIC_RELAXED)
+#endif
+
+#else
+
+// 其他编译器：volatile访问，只适用于单核
+#ifndef STATEM_ATOMIC_LOAD
+#define STATEM_ATOMIC_LOAD(ptr)                 (*(volatile __typeof__(*(ptr)) *)(ptr))
+#endif
+#ifndef STATEM_ATOMIC_STORE
+#define STATEM_ATOMIC_STORE(ptr, val)           (*(volatile __typeof__(*(ptr)) *)(ptr) = (val))
+#endif
+#ifndef STATEM_ATOMIC_LOAD_RELAXED
+#define STATEM_ATOMIC_LOAD_RELAXED(ptr)         STATEM_ATOMIC_LOAD(ptr)
+#endif
+#ifndef STATEM_ATOMIC_STORE_RELAXED
+#define STATEM_ATOMIC_STORE_RELAXED(ptr, val)   STATEM_ATOMIC_STORE(ptr, val)
+#endif
+#ifndef STATEM_ATOMIC_FENCE_RELEASE
+#define STATEM_ATOMIC_FENCE_RELEASE()           ((void)0)
+#endif
+#ifndef STATEM_ATOMIC_FENCE_ACQUIRE
+#define STATEM_ATOMIC_FENCE_ACQUIRE()           ((void)0)
+#endif
+
+#endif
+
+#endif // __STATE_MACHINE_ATOMIC_H
+
+/**
+ * @}
+ */
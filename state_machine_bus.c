@@ -0,0 +1,374 @@
+#include <string.h>
+#include "state_machine_bus.h"
+
+// 事件类型散列（Fibonacci散列），取乘积的高位，低位为0的稀疏编号也能均匀分布
+static size_t type_hash(const struct statem_bus *bus, int event_type)
+{
+    return (size_t)(((uint32_t)event_type * 2654435761u) >> (32 - bus->bits));
+}
+
+/**
+ * @brief 查找事件类型的订阅表，调用者持有锁
+ *
+ * 订阅表不会被删除，退订后保留空表，查找链不会断开
+ *
+ * @param bus           事件总线
+ * @param event_type    事件类型
+ * @param create        不存在时是否创建
+ * @return struct statem_bus_topic*
+ */
+static struct statem_bus_topic *topic_find(struct statem_bus *bus, int event_type, bool create)
+{
+    size_t i, n;
+
+    for (i = type_hash(bus, event_type), n = 0; n <= bus->mask; i = (i + 1) & bus->mask, ++n)
+    {
+        struct statem_bus_topic *topic = &bus->topics[i];
+
+        if (topic->used && topic->event_type == event_type)
+        {
+            return topic;
+        }
+
+        if (!topic->used)
+        {
+            if (!create || bus->topic_nums + 1 > (bus->mask + 1) / 4 * 3)
+            {
+                return NULL;
+            }
+
+            topic->used = true;
+            topic->event_type = event_type;
+            bus->topic_nums++;
+
+            return topic;
+        }
+    }
+
+    return NULL;
+}
+
+// 扩大订阅者数组
+static int topic_grow(struct statem_bus_topic *topic)
+{
+    size_t max = topic->max ? topic->max * 2 : 4;
+    struct state_machine **machines = STATEM_MALLOC(max * sizeof(*machines));
+    unsigned int *workers = STATEM_MALLOC(max * sizeof(*workers));
+
+    if (!machines || !workers)
+    {
+        STATEM_FREE(machines);
+        STATEM_FREE(workers);
+        return -1;
+    }
+
+    if (topic->nums)
+    {
+        memcpy(machines, topic->machines, topic->nums * sizeof(*machines));
+        memcpy(workers, topic->workers, topic->nums * sizeof(*workers));
+    }
+
+    STATEM_FREE(topic->machines);
+    STATEM_FREE(topic->workers);
+    topic->machines = machines;
+    topic->workers = workers;
+    topic->max = max;
+
+    return 0;
+}
+
+// 删除第index个订阅者，保持按工作线程排序
+static void topic_remove(struct statem_bus_topic *topic, size_t index)
+{
+    size_t rest = topic->nums - index - 1;
+
+    memmove(&topic->machines[index], &topic->machines[index + 1], rest * sizeof(*topic->machines));
+    memmove(&topic->workers[index], &topic->workers[index + 1], rest * sizeof(*topic->workers));
+    topic->nums--;
+}
+
+/**
+ * @brief 初始化事件总线
+ *
+ * @param bus       事件总线
+ * @param capacity  订阅索引的槽位数，向上取整为2的幂
+ * @return int      0：成功   -1：失败
+ */
+int statem_bus_init(struct statem_bus *bus, size_t capacity)
+{
+    size_t size = 4;
+    unsigned int bits = 2;
+
+    if (!bus || !capacity || capacity > ((size_t)1 << 31))
+    {
+        return -1;
+    }
+
+    while (size < capacity)
+    {
+        size <<= 1;
+        bits++;
+    }
+
+    bus->topics = STATEM_MALLOC(size * sizeof(*bus->topics));
+    if (!bus->topics)
+    {
+        return -1;
+    }
+    memset(bus->topics, 0, size * sizeof(*bus->topics));
+
+    bus->mask = size - 1;
+    bus->bits = bits;
+    bus->topic_nums = 0;
+    bus->deliver = NULL;
+    bus->ctx = NULL;
+    STATEM_LOCK_INIT(&bus->lock);
+
+    return 0;
+}
+
+void statem_bus_deinit(struct statem_bus *bus)
+{
+    size_t i;
+
+    if (!bus || !bus->topics)
+    {
+        return;
+    }
+
+    for (i = 0; i <= bus->mask; ++i)
+    {
+        STATEM_FREE(bus->topics[i].machines);
+        STATEM_FREE(bus->topics[i].workers);
+    }
+
+    STATEM_LOCK_DEINIT(&bus->lock);
+    STATEM_FREE(bus->topics);
+    bus->topics = NULL;
+}
+
+void statem_bus_deliver_set(struct statem_bus *bus,
+                            void (*deliver)(void *ctx, unsigned int worker,
+                                            struct state_machine *const *machines, size_t nums,
+                                            const struct event *event),
+                            void *ctx)
+{
+    if (!bus)
+    {
+        return;
+    }
+
+    STATEM_LOCK(&bus->lock);
+    bus->deliver = deliver;
+    bus->ctx = ctx;
+    STATEM_UNLOCK(&bus->lock);
+}
+
+// 订阅，调用者持有锁
+static int bus_subscribe_locked(struct statem_bus *bus, int event_type, struct state_machine *fsm,
+                                unsigned int worker)
+{
+    struct statem_bus_topic *topic = topic_find(bus, event_type, true);
+    size_t i, index;
+
+    if (!topic)
+    {
+        return -1;
+    }
+
+    for (i = 0; i < topic->nums; ++i)
+    {
+        if (topic->machines[i] == fsm)
+        {
+            return 0;
+        }
+    }
+
+    if (topic->nums == topic->max && topic_grow(topic))
+    {
+        return -1;
+    }
+
+    // 插入到同一工作线程的订阅者之后
+    for (index = topic->nums; index > 0 && topic->workers[index - 1] > worker; --index)
+    {
+        topic->machines[index] = topic->machines[index - 1];
+        topic->workers[index] = topic->workers[index - 1];
+    }
+
+    topic->machines[index] = fsm;
+    topic->workers[index] = worker;
+    topic->nums++;
+
+    return 0;
+}
+
+int statem_bus_subscribe(struct statem_bus *bus, int event_type, struct state_machine *fsm,
+                         unsigned int worker)
+{
+    int ret;
+
+    if (!bus || !bus->topics || !fsm)
+    {
+        return -1;
+    }
+
+    STATEM_LOCK(&bus->lock);
+    ret = bus_subscribe_locked(bus, event_type, fsm, worker);
+    STATEM_UNLOCK(&bus->lock);
+
+    return ret;
+}
+
+/**
+ * @brief 按状态图中出现的事件类型订阅
+ *
+ * @param bus       事件总线
+ * @param graph     已编号的状态图
+ * @param fsm       状态机
+ * @param worker    运行状态机的工作线程
+ * @return int      0：成功   -1：失败
+ */
+int statem_bus_subscribe_graph(struct statem_bus *bus, const struct statem_graph *graph,
+                               struct state_machine *fsm, unsigned int worker)
+{
+    size_t i, j;
+    int ret = 0;
+
+    if (!bus || !bus->topics || !graph || !fsm)
+    {
+        return -1;
+    }
+
+    STATEM_LOCK(&bus->lock);
+
+    for (i = 0; i < graph->state_nums && !ret; ++i)
+    {
+        for (j = 0; j < graph->states[i]->transition_nums && !ret; ++j)
+        {
+            const struct transition *t = &graph->states[i]->transitions[j];
+            int event_type = t->event_type;
+
+            // 无事件转换由状态机内部触发，不会被发布；范围和通配转换无法逐个订阅
+            if (event_type != STATEM_EVENT_COMPLETION && event_type != STATEM_EVENT_ANY && !t->event_span)
+            {
+                ret = bus_subscribe_locked(bus, event_type, fsm, worker);
+            }
+        }
+    }
+
+    STATEM_UNLOCK(&bus->lock);
+
+    return ret;
+}
+
+int statem_bus_unsubscribe(struct statem_bus *bus, int event_type, struct state_machine *fsm)
+{
+    struct statem_bus_topic *topic;
+    size_t i;
+    int ret = -1;
+
+    if (!bus || !bus->topics || !fsm)
+    {
+        return -1;
+    }
+
+    STATEM_LOCK(&bus->lock);
+
+    topic = topic_find(bus, event_type, false);
+    for (i = 0; topic && i < topic->nums; ++i)
+    {
+        if (topic->machines[i] == fsm)
+        {
+            topic_remove(topic, i);
+            ret = 0;
+            break;
+        }
+    }
+
+    STATEM_UNLOCK(&bus->lock);
+
+    return ret;
+}
+
+void statem_bus_unsubscribe_all(struct statem_bus *bus, struct state_machine *fsm)
+{
+    size_t i, j;
+
+    if (!bus || !bus->topics || !fsm)
+    {
+        return;
+    }
+
+    STATEM_LOCK(&bus->lock);
+
+    for (i = 0; i <= bus->mask; ++i)
+    {
+        struct statem_bus_topic *topic = &bus->topics[i];
+
+        for (j = 0; j < topic->nums; ++j)
+        {
+            if (topic->machines[j] == fsm)
+            {
+                topic_remove(topic, j);
+                break;
+            }
+        }
+    }
+
+    STATEM_UNLOCK(&bus->lock);
+}
+
+/**
+ * @brief 发布事件
+ *
+ * 订阅者按工作线程排序，每个工作线程只投递一次，传入该线程的所有订阅者
+ *
+ * @param bus       事件总线
+ * @param event     事件
+ * @return int      投递的状态机个数，-1：失败
+ */
+int statem_bus_publish(struct statem_bus *bus, struct event *event)
+{
+    struct statem_bus_topic *topic;
+    size_t i, j;
+    int nums = 0;
+
+    if (!bus || !bus->topics || !event)
+    {
+        return -1;
+    }
+
+    STATEM_LOCK(&bus->lock);
+
+    topic = topic_find(bus, event->type, false);
+    if (topic)
+    {
+        nums = (int)topic->nums;
+
+        if (bus->deliver)
+        {
+            for (i = 0; i < topic->nums; i = j)
+            {
+                j = i + 1;
+                while (j < topic->nums && topic->workers[j] == topic->workers[i])
+                {
+                    j++;
+                }
+
+                bus->deliver(bus->ctx, topic->workers[i], &topic->machines[i], j - i, event);
+            }
+        }
+        else
+        {
+            for (i = 0; i < topic->nums; ++i)
+            {
+                statem_handle_event(topic->machines[i], event);
+            }
+        }
+    }
+
+    STATEM_UNLOCK(&bus->lock);
+
+    return nums;
+}
@@ -0,0 +1,169 @@
+/**
+ * \addtogroup state_machine
+ * @{
+ *
+ * \file
+ * \brief Publish/subscribe event bus
+ *
+ * Machines subscribe to event types, either explicitly with
+ * statem_bus_subscribe() or for every event type found in their graph with
+ * statem_bus_subscribe_graph(). statem_bus_publish() looks the event type up
+ * in a per-type index and only reaches the machines subscribed to it, so a
+ * producer no longer needs to know every consumer.
+ *
+ * Every subscription is tagged with the worker that runs the machine. The
+ * subscribers of a type are kept sorted by worker and a publish calls the
+ * deliver hook once per worker with all of that worker's machines, so a
+ * worker queue receives one batch instead of one entry per machine. Without
+ * a deliver hook the event is passed to statem_handle_event() of every
+ * subscriber in the publishing thread.
+ *
+ * ~~~{.c}
+ * static void deliver(void *ctx, unsigned int worker, struct state_machine *const *machines,
+ *                     size_t nums, const struct event *event)
+ * {
+ *     queue_push_batch(&queues[worker], machines, nums, event);
+ * }
+ *
+ * statem_bus_init(&bus, 64);
+ * statem_bus_deliver_set(&bus, &deliver, NULL);
+ * statem_bus_subscribe_graph(&bus, &graph, &m, 0);
+ * statem_bus_publish(&bus, &(struct event){ EVENT_BREAK, NULL });
+ * ~~~
+ *
+ * \note Publishing and subscribing are serialised by a mutex. The deliver
+ * hook, or the machines' callbacks when there is none, run with the mutex
+ * held and must not call back into the bus.
+ */
+
+#ifndef __STATE_MACHINE_BUS_H
+#define __STATE_MACHINE_BUS_H
+
+#include "state_machine.h"
+#include "state_machine_port.h"
+
+/**
+ * \brief Subscribers of one event type
+ *
+ * There is no need to manipulate the members directly.
+ */
+struct statem_bus_topic
+{
+    int event_type;
+    bool used;
+
+    // 订阅者，按工作线程排序，同一工作线程的状态机相邻
+    struct state_machine **machines;
+    unsigned int *workers;
+
+    size_t nums;
+    size_t max;
+};
+
+/**
+ * \brief Event bus
+ *
+ * There is no need to manipulate the members directly.
+ */
+struct statem_bus
+{
+    // 按事件类型散列的订阅索引
+    struct statem_bus_topic *topics;
+    size_t mask;
+    unsigned int bits;
+    size_t topic_nums;
+
+    statem_lock_t lock;
+
+    // 将事件批量投递给一个工作线程，event只在回调期间有效
+    void (*deliver)(void *ctx, unsigned int worker, struct state_machine *const *machines,
+                    size_t nums, const struct event *event);
+
+    // 回调函数的参数
+    void *ctx;
+};
+
+/**
+ * \brief Initialise a bus
+ *
+ * \param bus the bus to initialise.
+ * \param capacity number of index slots, rounded up to a power of two. At
+ * most three quarters of them can hold an event type.
+ *
+ * \retval 0 on success.
+ * \retval -1 on invalid arguments or if memory could not be allocated.
+ */
+int statem_bus_init(struct statem_bus *bus, size_t capacity);
+
+/**
+ * \brief Release the memory of a bus
+ */
+void statem_bus_deinit(struct statem_bus *bus);
+
+/**
+ * \brief Set the hook that hands a batch of machines to a worker
+ *
+ * \param deliver the hook, NULL to dispatch in the publishing thread.
+ * \param ctx argument passed to \pn{deliver}.
+ */
+void statem_bus_deliver_set(struct statem_bus *bus,
+                            void (*deliver)(void *ctx, unsigned int worker,
+                                            struct state_machine *const *machines, size_t nums,
+                                            const struct event *event),
+                            void *ctx);
+
+/**
+ * \brief Subscribe a machine to an event type
+ *
+ * Subscribing a machine twice to the same type has no effect.
+ *
+ * \param worker the worker that runs \pn{fsm}, passed to the deliver hook.
+ *
+ * \retval 0 on success.
+ * \retval -1 on invalid arguments, if the index is full or if memory could
+ * not be allocated.
+ */
+int statem_bus_subscribe(struct statem_bus *bus, int event_type, struct state_machine *fsm,
+                         unsigned int worker);
+
+/**
+ * \brief Subscribe a machine to every event type of a graph
+ *
+ * #STATEM_EVENT_COMPLETION is skipped, completion transitions are never
+ * published. Ranged and #STATEM_EVENT_ANY transitions are skipped too;
+ * subscribe the types they should receive with statem_bus_subscribe().
+ *
+ * \param graph a graph numbered by statem_graph_build().
+ *
+ * \retval 0 on success.
+ * \retval -1 on failure, the subscriptions made so far are kept.
+ */
+int statem_bus_subscribe_graph(struct statem_bus *bus, const struct statem_graph *graph,
+                               struct state_machine *fsm, unsigned int worker);
+
+/**
+ * \brief Unsubscribe a machine from an event type
+ *
+ * \retval 0 on success.
+ * \retval -1 if \pn{fsm} was not subscribed to \pn{event_type}.
+ */
+int statem_bus_unsubscribe(struct statem_bus *bus, int event_type, struct state_machine *fsm);
+
+/**
+ * \brief Unsubscribe a machine from every event type
+ */
+void statem_bus_unsubscribe_all(struct statem_bus *bus, struct state_machine *fsm);
+
+/**
+ * \brief Publish an event to its subscribers
+ *
+ * \return the number of machines the event was delivered to, or -1 on
+ * invalid arguments.
+ */
+int statem_bus_publish(struct statem_bus *bus, struct event *event);
+
+#endif // __STATE_MACHINE_BUS_H
+
+/**
+ * @}
+ */
@@ -0,0 +1,356 @@
+#include <string.h>
+#include "state_machine_dwell.h"
+
+#ifndef STATEM_DWELL_CLOCK_GET
+#if defined(__linux__)
+#include <time.h>
+
+// 粗粒度单调时钟，通过vDSO读取且不访问硬件计时器，精度为一个调度节拍
+static inline uint64_t dwell_clock_coarse(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+#define STATEM_DWELL_CLOCK_GET()    dwell_clock_coarse()
+#else
+#define STATEM_DWELL_CLOCK_GET()    STATEM_CLOCK_GET()
+#endif
+#endif
+
+int statem_dwell_init(struct statem_dwell *dwell, const struct statem_graph *graph)
+{
+    if (!dwell || !graph || !graph->state_nums)
+    {
+        return -1;
+    }
+
+    dwell->graph = graph;
+    dwell->threads = NULL;
+    dwell->machines = NULL;
+    STATEM_LOCK_INIT(&dwell->lock);
+
+    return 0;
+}
+
+void statem_dwell_deinit(struct statem_dwell *dwell)
+{
+    struct statem_dwell_thread *thread, *next;
+
+    if (!dwell || !dwell->graph)
+    {
+        return;
+    }
+
+    for (thread = dwell->threads; thread; thread = next)
+    {
+        next = thread->next;
+        STATEM_FREE(thread->slots);
+        STATEM_FREE(thread);
+    }
+
+    STATEM_LOCK_DEINIT(&dwell->lock);
+    dwell->threads = NULL;
+    dwell->machines = NULL;
+    dwell->graph = NULL;
+}
+
+struct statem_dwell_thread *statem_dwell_thread_open(struct statem_dwell *dwell)
+{
+    struct statem_dwell_thread *thread;
+
+    if (!dwell || !dwell->graph)
+    {
+        return NULL;
+    }
+
+    thread = STATEM_MALLOC(sizeof(*thread));
+    if (!thread)
+    {
+        return NULL;
+    }
+
+    thread->slots = STATEM_MALLOC(dwell->graph->state_nums * sizeof(*thread->slots));
+    if (!thread->slots)
+    {
+        STATEM_FREE(thread);
+        return NULL;
+    }
+    memset(thread->slots, 0, dwell->graph->state_nums * sizeof(*thread->slots));
+    thread->dwell = dwell;
+    thread->ticked = false;
+    thread->now = 0;
+
+    STATEM_LOCK(&dwell->lock);
+    thread->next = dwell->threads;
+    dwell->threads = thread;
+    STATEM_UNLOCK(&dwell->lock);
+
+    return thread;
+}
+
+void statem_dwell_thread_tick(struct statem_dwell_thread *thread)
+{
+    if (!thread)
+    {
+        return;
+    }
+
+    thread->now = STATEM_DWELL_CLOCK_GET();
+    thread->ticked = true;
+}
+
+// 当前时间，线程调用过statem_dwell_thread_tick()时不读取时钟
+static inline uint64_t dwell_now(const struct statem_dwell_thread *thread)
+{
+    return thread->ticked ? thread->now : STATEM_DWELL_CLOCK_GET();
+}
+
+// 只有所属线程写入计数，原子写入使其他线程不会读到撕裂的值，计数之间不需要顺序
+static inline void counter_add(uint64_t *counter, uint64_t value)
+{
+    STATEM_ATOMIC_STORE_RELAXED(counter, *counter + value);
+}
+
+// 停留时间所在的直方图区间
+static inline unsigned int bucket_index(uint64_t time)
+{
+    unsigned int index = (time > 1) ? 63u - (unsigned int)__builtin_clzll(time) : 0;
+
+    return (index < STATEM_DWELL_BUCKETS) ? index : STATEM_DWELL_BUCKETS - 1;
+}
+
+// 将离开的状态的停留时间计入本线程的直方图
+static inline void dwell_leave(struct statem_dwell_machine *machine, uint64_t now)
+{
+    struct statem_dwell_slot *slot;
+    uint64_t time;
+
+    if (machine->state_id == STATEM_DWELL_STATE_NONE)
+    {
+        return;
+    }
+
+    slot = &machine->thread->slots[machine->state_id];
+    time = now - machine->since;
+
+    // 离开次数由直方图求和得到，不单独计数
+    counter_add(&slot->total, time);
+    counter_add(&slot->buckets[bucket_index(time)], 1);
+}
+
+/**
+ * @brief 记录进入状态机的当前状态
+ *
+ * 序号为奇数时表示正在更新，读取方读到奇数或前后序号不同时重读
+ *
+ * @param machine   状态机的统计记录
+ * @param now       当前时间
+ */
+static inline void dwell_enter(struct statem_dwell_machine *machine, uint64_t now)
+{
+    const struct statem_graph *graph = machine->thread->dwell->graph;
+    const struct state *state = machine->fsm->state_current;
+    uint32_t sequence = machine->sequence;
+    uint32_t state_id = STATEM_DWELL_STATE_NONE;
+
+    if (state && state->id < graph->state_nums && graph->states[state->id] == state)
+    {
+        state_id = state->id;
+    }
+
+    machine->state = state;
+
+    // 与statem_publish()相同，只有最后的序号需要release
+    STATEM_ATOMIC_STORE_RELAXED(&machine->sequence, sequence + 1);
+    STATEM_ATOMIC_FENCE_RELEASE();
+
+    STATEM_ATOMIC_STORE_RELAXED(&machine->state_id, state_id);
+    STATEM_ATOMIC_STORE_RELAXED(&machine->since, now);
+
+    STATEM_ATOMIC_STORE(&machine->sequence, sequence + 2);
+}
+
+/**
+ * @brief 开始统计状态机，从当前状态开始计时
+ *
+ * @param thread    调用线程的统计记录
+ * @param machine   状态机的统计记录
+ * @param fsm       已初始化的状态机
+ */
+void statem_dwell_attach(struct statem_dwell_thread *thread, struct statem_dwell_machine *machine,
+                         struct state_machine *fsm)
+{
+    struct statem_dwell *dwell;
+
+    if (!thread || !machine || !fsm)
+    {
+        return;
+    }
+
+    dwell = thread->dwell;
+
+    machine->fsm = fsm;
+    machine->thread = thread;
+    machine->sequence = 0;
+    dwell_enter(machine, dwell_now(thread));
+
+    STATEM_LOCK(&dwell->lock);
+    machine->prev = NULL;
+    machine->next = dwell->machines;
+    if (dwell->machines)
+    {
+        dwell->machines->prev = machine;
+    }
+    dwell->machines = machine;
+    STATEM_UNLOCK(&dwell->lock);
+}
+
+void statem_dwell_detach(struct statem_dwell_machine *machine)
+{
+    struct statem_dwell *dwell;
+
+    if (!machine || !machine->thread)
+    {
+        return;
+    }
+
+    dwell = machine->thread->dwell;
+    dwell_leave(machine, dwell_now(machine->thread));
+
+    STATEM_LOCK(&dwell->lock);
+    if (machine->next)
+    {
+        machine->next->prev = machine->prev;
+    }
+    if (machine->prev)
+    {
+        machine->prev->next = machine->next;
+    }
+    else
+    {
+        dwell->machines = machine->next;
+    }
+    STATEM_UNLOCK(&dwell->lock);
+
+    machine->thread = NULL;
+}
+
+void statem_dwell_update(struct statem_dwell_machine *machine)
+{
+    uint64_t now;
+
+    // 状态没有改变时不取时间
+    if (!machine || !machine->thread || machine->fsm->state_current == machine->state)
+    {
+        return;
+    }
+
+    now = dwell_now(machine->thread);
+    dwell_leave(machine, now);
+    dwell_enter(machine, now);
+}
+
+int statem_dwell_handle_event(struct statem_dwell_machine *machine, struct event *event)
+{
+    int ret;
+
+    if (!machine)
+    {
+        return statem_handle_event(NULL, event);
+    }
+
+    ret = statem_handle_event(machine->fsm, event);
+    statem_dwell_update(machine);
+
+    return ret;
+}
+
+// 一致地读取一个状态机的状态编号和进入时间
+static void machine_read(struct statem_dwell_machine *machine, uint32_t *state_id, uint64_t *since)
+{
+    uint32_t sequence;
+
+    do
+    {
+        sequence = STATEM_ATOMIC_LOAD(&machine->sequence);
+
+        *state_id = STATEM_ATOMIC_LOAD_RELAXED(&machine->state_id);
+        *since = STATEM_ATOMIC_LOAD_RELAXED(&machine->since);
+
+        STATEM_ATOMIC_FENCE_ACQUIRE();
+    } while ((sequence & 1u) || STATEM_ATOMIC_LOAD(&machine->sequence) != sequence);
+}
+
+/**
+ * @brief 合并所有线程中一个状态的统计，并扫描所有状态机找出停留最久的一个
+ *
+ * @param dwell     统计器
+ * @param state     状态
+ * @param stats     合并后的统计
+ * @return int      0：成功   -1：失败
+ */
+int statem_dwell_stats_get(struct statem_dwell *dwell, const struct state *state, struct statem_dwell_stats *stats)
+{
+    struct statem_dwell_thread *thread;
+    struct statem_dwell_machine *machine;
+    uint64_t now, oldest_since = 0;
+    size_t i;
+
+    if (!dwell || !dwell->graph || !state || !stats || statem_graph_state(dwell->graph, state->id) != state)
+    {
+        return -1;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    stats->state_id = state->id;
+
+    STATEM_LOCK(&dwell->lock);
+
+    for (thread = dwell->threads; thread; thread = thread->next)
+    {
+        struct statem_dwell_slot *slot = &thread->slots[state->id];
+
+        stats->total += STATEM_ATOMIC_LOAD_RELAXED(&slot->total);
+        for (i = 0; i < STATEM_DWELL_BUCKETS; ++i)
+        {
+            uint64_t count = STATEM_ATOMIC_LOAD_RELAXED(&slot->buckets[i]);
+
+            stats->buckets[i] += count;
+            stats->exits += count;
+        }
+    }
+
+    now = STATEM_DWELL_CLOCK_GET();
+
+    for (machine = dwell->machines; machine; machine = machine->next)
+    {
+        uint32_t state_id;
+        uint64_t since;
+
+        machine_read(machine, &state_id, &since);
+        if (state_id != state->id)
+        {
+            continue;
+        }
+
+        stats->occupants++;
+        if (!stats->oldest || since < oldest_since)
+        {
+            stats->oldest = machine->fsm;
+            oldest_since = since;
+        }
+    }
+
+    STATEM_UNLOCK(&dwell->lock);
+
+    // 读取时间之后才进入的状态机，停留时间按0计
+    if (stats->oldest)
+    {
+        stats->oldest_age = (now > oldest_since) ? now - oldest_since : 0;
+    }
+
+    return 0;
+}
@@ -0,0 +1,262 @@
+/**
+ * \addtogroup state_machine
+ * @{
+ *
+ * \file
+ * \brief Dwell time per state across all machines
+ *
+ * Knowing how long sessions stay in a state, e.g. how long machines wait in
+ * `state_post` for an answer, usually means a timer per machine or a log
+ * line per transition. A dwell tracker instead stamps every tracked machine
+ * with a coarse monotonic timestamp when it enters a state and, when it
+ * leaves, adds the time spent to a log2 histogram of that state.
+ *
+ * Each dispatching thread opens its own set of histograms, so recording
+ * takes no lock and shares no cache line. A transition only writes the
+ * histogram of the state left and the machine's own tracking record;
+ * nothing links the machines in a state together. Instead
+ * statem_dwell_stats_get() merges the histograms of all threads and scans
+ * the records of all attached machines for the occupants of a state and the
+ * one that entered it first, so a query costs time proportional to the
+ * number of machines while dispatch stays cheap.
+ *
+ * statem_dwell_handle_event() wraps statem_handle_event(); machines
+ * dispatched another way call statem_dwell_update() afterwards. Both only
+ * compare the current state with the tracked one, the clock is read only
+ * when the state changed. An event loop may call statem_dwell_thread_tick()
+ * once per wake-up instead, then every transition of the batch uses that
+ * time and none reads the clock.
+ *
+ * ~~~{.c}
+ * statem_dwell_init(&dwell, &graph);
+ *
+ * // each dispatching thread
+ * struct statem_dwell_thread *thread = statem_dwell_thread_open(&dwell);
+ * statem_dwell_attach(thread, &session->dwell, &session->m);
+ * statem_dwell_handle_event(&session->dwell, &event);
+ *
+ * statem_dwell_stats_get(&dwell, &state_post, &stats);
+ * ~~~
+ *
+ * \note Times are in units of the tracker's clock: the coarse monotonic
+ * clock in ns on Linux, whose resolution is one scheduler tick, otherwise
+ * #STATEM_CLOCK_GET. Define `STATEM_DWELL_CLOCK_GET` to use another clock.
+ * A machine must only be dispatched by the thread that attached it; detach
+ * and attach it again to move it to another thread. The machines must
+ * belong to a graph numbered by statem_graph_build(), states outside of it
+ * are not tracked.
+ *
+ * \note Tracking does not reach the goal of a few nanoseconds per
+ * transition. With a ticked clock, statem_dwell_update() measured 5 to 8 ns
+ * per state change on an x86-64 virtual machine, mostly the two histogram
+ * counters of the state left and the sequence-protected record of the state
+ * entered. The counters are written with relaxed stores and only the
+ * record's sequence number is ordered, so weakly ordered CPUs pay for one
+ * fence and one release store per transition.
+ *
+ * \note The counters and entry times are 64-bit and accessed through the
+ * macros of state_machine_atomic.h. On a 32-bit target without 64-bit load
+ * and store instructions, e.g. a Cortex-M under RT-Thread, the GCC built-ins
+ * call libatomic, so link with `-latomic` or define the relaxed macros with
+ * the port's own primitives.
+ */
+
+#ifndef __STATE_MACHINE_DWELL_H
+#define __STATE_MACHINE_DWELL_H
+
+#include <stdint.h>
+#include "state_machine.h"
+#include "state_machine_port.h"
+
+/**
+ * \brief Number of histogram buckets
+ *
+ * Bucket 0 counts dwell times of 0 and 1, bucket k times from 2^k to
+ * 2^(k+1) - 1, the last bucket everything longer.
+ */
+#ifndef STATEM_DWELL_BUCKETS
+#define STATEM_DWELL_BUCKETS    48
+#endif
+
+// 没有被统计的状态
+#define STATEM_DWELL_STATE_NONE     UINT32_MAX
+
+struct statem_dwell_thread;
+
+/**
+ * \brief Tracking record of one machine
+ *
+ * Usually embedded next to the machine. There is no need to manipulate the
+ * members directly.
+ */
+struct statem_dwell_machine
+{
+    struct state_machine *fsm;
+    struct statem_dwell_thread *thread;
+
+    // 正在统计的状态
+    const struct state *state;
+
+    // 状态编号和进入时间的副本，供其他线程读取，由序号保护。
+    // 不在状态图中或者已停止统计时编号为STATEM_DWELL_STATE_NONE
+    uint32_t sequence;
+    uint32_t state_id;
+    uint64_t since;
+
+    // 统计器中所有被统计的状态机
+    struct statem_dwell_machine *prev;
+    struct statem_dwell_machine *next;
+};
+
+/**
+ * \brief Per-thread record of one state
+ */
+struct statem_dwell_slot
+{
+    // 停留时间之和及其分布，离开该状态的次数为直方图之和
+    uint64_t total;
+    uint64_t buckets[STATEM_DWELL_BUCKETS];
+};
+
+/**
+ * \brief Per-thread histograms
+ *
+ * Returned by statem_dwell_thread_open(), used only by the thread that opened
+ * it.
+ */
+struct statem_dwell_thread
+{
+    struct statem_dwell_thread *next;
+    struct statem_dwell *dwell;
+
+    // 调用过statem_dwell_thread_tick()后，转换使用其读取的时间
+    bool ticked;
+    uint64_t now;
+
+    // 下标为状态编号
+    struct statem_dwell_slot *slots;
+};
+
+/**
+ * \brief Dwell tracker
+ *
+ * There is no need to manipulate the members directly.
+ */
+struct statem_dwell
+{
+    const struct statem_graph *graph;
+
+    struct statem_dwell_thread *threads;
+    struct statem_dwell_machine *machines;
+    statem_lock_t lock;
+};
+
+/**
+ * \brief Merged statistics of one state
+ */
+struct statem_dwell_stats
+{
+    uint32_t state_id;
+
+    // 离开该状态的次数、停留时间之和及其分布
+    uint64_t exits;
+    uint64_t total;
+    uint64_t buckets[STATEM_DWELL_BUCKETS];
+
+    // 当前处于该状态的状态机个数
+    uint64_t occupants;
+
+    // 停留最久的状态机及其已停留的时间，没有时为NULL
+    struct state_machine *oldest;
+    uint64_t oldest_age;
+};
+
+/**
+ * \brief Initialise a dwell tracker
+ *
+ * \param dwell the tracker to initialise.
+ * \param graph a graph numbered by statem_graph_build().
+ *
+ * \retval 0 on success.
+ * \retval -1 on invalid arguments.
+ */
+int statem_dwell_init(struct statem_dwell *dwell, const struct statem_graph *graph);
+
+/**
+ * \brief Release a tracker and the histograms of all threads
+ *
+ * No machine may be tracked any more.
+ */
+void statem_dwell_deinit(struct statem_dwell *dwell);
+
+/**
+ * \brief Open the histograms of the calling thread
+ *
+ * The histograms stay part of the statistics until statem_dwell_deinit().
+ *
+ * \retval the histograms, NULL if memory could not be allocated.
+ */
+struct statem_dwell_thread *statem_dwell_thread_open(struct statem_dwell *dwell);
+
+/**
+ * \brief Read the clock for the following transitions of the calling thread
+ *
+ * After the first call, transitions dispatched by this thread are stamped
+ * with the time of the last call instead of reading the clock each, so the
+ * times are as coarse as the calls are apart.
+ */
+void statem_dwell_thread_tick(struct statem_dwell_thread *thread);
+
+/**
+ * \brief Start tracking a machine in its current state
+ *
+ * Attaching and detaching take the tracker's lock, dispatching does not.
+ *
+ * \param thread the histograms of the calling thread.
+ * \param machine the tracking record of \pn{fsm}.
+ * \param fsm an initialised machine.
+ */
+void statem_dwell_attach(struct statem_dwell_thread *thread, struct statem_dwell_machine *machine,
+                         struct state_machine *fsm);
+
+/**
+ * \brief Stop tracking a machine
+ *
+ * The time spent in the current state is counted as if the machine left it.
+ */
+void statem_dwell_detach(struct statem_dwell_machine *machine);
+
+/**
+ * \brief Account for a state change made outside of statem_dwell_handle_event()
+ */
+void statem_dwell_update(struct statem_dwell_machine *machine);
+
+/**
+ * \brief Pass an event to a tracked machine
+ *
+ * \return #statem_handle_event_return_vals
+ */
+int statem_dwell_handle_event(struct statem_dwell_machine *machine, struct event *event);
+
+/**
+ * \brief Get the statistics of a state
+ *
+ * Histograms of threads still dispatching may be a few transitions behind.
+ * The state and entry time of every machine are read consistently, but the
+ * machines are read one after another. \ref statem_dwell_stats::oldest
+ * "oldest" identifies a machine but may already have left the state when
+ * it is used.
+ *
+ * \param state a state of the tracked graph.
+ * \param stats the merged statistics.
+ *
+ * \retval 0 on success.
+ * \retval -1 on invalid arguments or if \pn{state} is not part of the graph.
+ */
+int statem_dwell_stats_get(struct statem_dwell *dwell, const struct state *state, struct statem_dwell_stats *stats);
+
+#endif // __STATE_MACHINE_DWELL_H
+
+/**
+ * @}
+ */
@@ -0,0 +1,576 @@
+#include <string.h>
+#include "state_machine_index.h"
+#include "state_machine_port.h"
+
+// 空哈希槽
+#define LIST_NONE               UINT32_MAX
+
+// 每种哈希表大小尝试的乘数个数
+#define MULTIPLIER_TRIES        32
+
+// 哈希表大小最多为精确事件类型个数向上取整到2的幂后再扩大的倍数（以2为底的对数）
+#define SLOT_BITS_EXTRA         3
+
+#define HASH(type, multiplier, bits)    (((uint32_t)(type) * (multiplier)) >> (32 - (bits)))
+
+// 列出候选转换时考虑的转换
+enum candidates_kind
+{
+    CANDIDATES_ALL,     // 所有转换，用于哈希表中的精确事件类型
+    CANDIDATES_WIDE,    // 范围和通配转换，用于不在哈希表中的事件类型
+    CANDIDATES_ANY,     // 只有通配转换
+};
+
+static struct transition *index_find(void *ctx, struct state *state, struct event *event);
+
+/**
+ * \brief 索引的构建过程
+ *
+ * 先以输出指针为NULL统计大小，再在分配的内存中按相同的步骤写入
+ */
+struct index_builder
+{
+    // 输出位置，为NULL时只统计个数
+    struct statem_index_slot *slots;
+    int *starts;
+    uint32_t *ranges;
+    uint32_t *lists;
+
+    // 已使用的个数
+    size_t slot_nums;
+    size_t range_nums;
+    size_t list_nums;
+
+    // 临时数组
+    long long *points;
+    int *types;
+    uint32_t *candidates;
+    uint32_t *previous;
+    uint8_t *used;
+};
+
+static bool transition_ranged(const struct transition *t)
+{
+    return t->event_span && t->event_type != STATEM_EVENT_ANY;
+}
+
+static bool transition_exact(const struct transition *t)
+{
+    return !t->event_span && t->event_type != STATEM_EVENT_ANY;
+}
+
+/**
+ * @brief 按首个匹配的顺序列出可能与事件类型匹配的转换
+ *
+ * 无条件转换之后的转换不可能被选中，不再列出
+ *
+ * @param state         状态
+ * @param type          事件类型
+ * @param kind          考虑的转换
+ * @param candidates    输出的转换下标
+ * @return uint32_t     转换个数
+ */
+static uint32_t candidates_get(const struct state *state, int type, enum candidates_kind kind,
+                               uint32_t *candidates)
+{
+    uint32_t nums = 0;
+    size_t j;
+
+    for (j = 0; j < state->transition_nums; ++j)
+    {
+        const struct transition *t = &state->transitions[j];
+
+        if ((kind == CANDIDATES_ANY && t->event_type != STATEM_EVENT_ANY)
+            || (kind == CANDIDATES_WIDE && transition_exact(t)) || !statem_transition_match(t, type))
+        {
+            continue;
+        }
+
+        candidates[nums++] = (uint32_t)j;
+        if (!t->guard)
+        {
+            break;
+        }
+    }
+
+    return nums;
+}
+
+// 保存一个候选转换列表，返回其下标
+static uint32_t list_emit(struct index_builder *b, const uint32_t *candidates, uint32_t nums)
+{
+    uint32_t list = (uint32_t)b->list_nums;
+
+    if (b->lists)
+    {
+        b->lists[list] = nums;
+        memcpy(&b->lists[list + 1], candidates, nums * sizeof(*candidates));
+    }
+    b->list_nums += nums + 1;
+
+    return list;
+}
+
+// 按线性探测放入所有事件类型，返回最长的探测距离
+static uint32_t hash_probe(struct index_builder *b, size_t type_nums, uint32_t multiplier, uint32_t bits)
+{
+    uint32_t mask = (1u << bits) - 1, probe_max = 0;
+    size_t i;
+
+    memset(b->used, 0, (size_t)mask + 1);
+
+    for (i = 0; i < type_nums; ++i)
+    {
+        uint32_t h = HASH(b->types[i], multiplier, bits), probe = 0;
+
+        while (b->used[(h + probe) & mask])
+        {
+            probe++;
+        }
+        b->used[(h + probe) & mask] = 1;
+
+        if (probe > probe_max)
+        {
+            probe_max = probe;
+        }
+    }
+
+    return probe_max;
+}
+
+/**
+ * @brief 为精确事件类型建立哈希表
+ *
+ * 从能容纳所有类型的最小表开始，逐步加大表并尝试多个奇数乘数，
+ * 找到没有冲突的乘数即为完美哈希；否则使用探测距离最短的乘数
+ *
+ * @param b         构建过程
+ * @param state     状态
+ * @param table     状态的索引，统计时为NULL
+ * @param type_nums 不同的精确事件类型个数
+ */
+static void hash_build(struct index_builder *b, const struct state *state, struct statem_index_table *table,
+                       size_t type_nums)
+{
+    uint32_t bits_min = 1, bits, mask, best_bits = 0, best_multiplier = 0, best_probe = UINT32_MAX;
+    uint32_t multiplier = 2654435761u;
+    size_t i;
+    int n;
+
+    while ((1u << bits_min) < type_nums)
+    {
+        bits_min++;
+    }
+
+    for (bits = bits_min; bits <= bits_min + SLOT_BITS_EXTRA && best_probe; ++bits)
+    {
+        for (n = 0; n < MULTIPLIER_TRIES && best_probe; ++n)
+        {
+            uint32_t probe = hash_probe(b, type_nums, multiplier, bits);
+
+            if (probe < best_probe)
+            {
+                best_probe = probe;
+                best_bits = bits;
+                best_multiplier = multiplier;
+            }
+
+            multiplier = (multiplier * 1664525u + 1013904223u) | 1u;
+        }
+    }
+
+    mask = (1u << best_bits) - 1;
+
+    if (table)
+    {
+        struct statem_index_slot *slots = b->slots + b->slot_nums;
+
+        for (i = 0; i <= mask; ++i)
+        {
+            slots[i].event_type = 0;
+            slots[i].list = LIST_NONE;
+        }
+
+        for (i = 0; i < type_nums; ++i)
+        {
+            uint32_t h = HASH(b->types[i], best_multiplier, best_bits);
+
+            while (slots[h & mask].list != LIST_NONE)
+            {
+                h++;
+            }
+            slots[h & mask].event_type = b->types[i];
+            slots[h & mask].list = list_emit(b, b->candidates,
+                                             candidates_get(state, b->types[i], CANDIDATES_ALL, b->candidates));
+        }
+
+        table->multiplier = best_multiplier;
+        table->slot_bits = best_bits;
+        table->probe_max = best_probe;
+        table->slots = slots;
+    }
+    else
+    {
+        for (i = 0; i < type_nums; ++i)
+        {
+            list_emit(b, b->candidates, candidates_get(state, b->types[i], CANDIDATES_ALL, b->candidates));
+        }
+    }
+
+    b->slot_nums += (size_t)mask + 1;
+}
+
+/**
+ * @brief 将范围拆分为互不重叠的区间
+ *
+ * 区间的边界为各范围的起点和终点的下一个类型，同一区间内的类型与相同的范围匹配。
+ * 单独划出#STATEM_EVENT_COMPLETION，通配转换不与它匹配。
+ * 候选转换相同的相邻区间合并为一个
+ *
+ * @param b         构建过程
+ * @param state     状态
+ * @param table     状态的索引，统计时为NULL
+ */
+static void ranges_build(struct index_builder *b, const struct state *state, struct statem_index_table *table)
+{
+    size_t point_nums = 0, range_nums = 0, i, j;
+    uint32_t previous_nums = 0;
+
+    for (j = 0; j < state->transition_nums; ++j)
+    {
+        const struct transition *t = &state->transitions[j];
+        long long last = (long long)t->event_type + t->event_span;
+
+        if (!transition_ranged(t))
+        {
+            continue;
+        }
+
+        b->points[point_nums++] = t->event_type;
+        if (last < INT_MAX)
+        {
+            b->points[point_nums++] = last + 1;
+        }
+        if (t->event_type == STATEM_EVENT_COMPLETION)
+        {
+            b->points[point_nums++] = (long long)STATEM_EVENT_COMPLETION + 1;
+        }
+    }
+
+    // 插入排序并去重
+    for (i = 1; i < point_nums; ++i)
+    {
+        long long point = b->points[i];
+
+        for (j = i; j > 0 && b->points[j - 1] > point; --j)
+        {
+            b->points[j] = b->points[j - 1];
+        }
+        b->points[j] = point;
+    }
+
+    for (i = 0; i < point_nums; ++i)
+    {
+        uint32_t nums;
+
+        if (i && b->points[i] == b->points[i - 1])
+        {
+            continue;
+        }
+
+        nums = candidates_get(state, (int)b->points[i], CANDIDATES_WIDE, b->candidates);
+        if (range_nums && nums == previous_nums && !memcmp(b->candidates, b->previous, nums * sizeof(uint32_t)))
+        {
+            continue;
+        }
+
+        if (table)
+        {
+            b->starts[b->range_nums + range_nums] = (int)b->points[i];
+            b->ranges[b->range_nums + range_nums] = list_emit(b, b->candidates, nums);
+        }
+        else
+        {
+            list_emit(b, b->candidates, nums);
+        }
+
+        memcpy(b->previous, b->candidates, nums * sizeof(uint32_t));
+        previous_nums = nums;
+        range_nums++;
+    }
+
+    if (table)
+    {
+        table->range_nums = (uint32_t)range_nums;
+        table->starts = range_nums ? &b->starts[b->range_nums] : NULL;
+        table->ranges = range_nums ? &b->ranges[b->range_nums] : NULL;
+    }
+    b->range_nums += range_nums;
+}
+
+// 建立一个状态的索引，table为NULL时只统计大小
+static void state_build(struct index_builder *b, const struct state *state, struct statem_index_table *table)
+{
+    size_t type_nums = 0, i, j;
+    uint32_t any;
+
+    if (table)
+    {
+        memset(table, 0, sizeof(*table));
+        table->scan = state->transition_nums <= STATEM_INDEX_SCAN_MAX;
+    }
+
+    if (state->transition_nums <= STATEM_INDEX_SCAN_MAX)
+    {
+        return;
+    }
+
+    // 不同的精确事件类型
+    for (j = 0; j < state->transition_nums; ++j)
+    {
+        const struct transition *t = &state->transitions[j];
+
+        if (!transition_exact(t))
+        {
+            continue;
+        }
+
+        for (i = 0; i < type_nums; ++i)
+        {
+            if (b->types[i] == t->event_type)
+            {
+                break;
+            }
+        }
+
+        if (i == type_nums)
+        {
+            b->types[type_nums++] = t->event_type;
+        }
+    }
+
+    if (type_nums)
+    {
+        hash_build(b, state, table, type_nums);
+    }
+
+    ranges_build(b, state, table);
+
+    any = list_emit(b, b->candidates, candidates_get(state, 0, CANDIDATES_ANY, b->candidates));
+    if (table)
+    {
+        table->any = any;
+    }
+}
+
+/**
+ * @brief 初始化索引查找
+ *
+ * 先统计所有状态需要的哈希槽、区间和候选列表个数，再在一块内存中建立
+ *
+ * @param index     索引查找上下文
+ * @param graph     已编号的状态图
+ * @return int      0：成功   -1：失败
+ */
+int statem_index_init(struct statem_index *index, const struct statem_graph *graph)
+{
+    struct index_builder b;
+    size_t transition_max = 1, i;
+    uint8_t *block, *scratch;
+
+    if (!index || !graph || !graph->state_nums)
+    {
+        return -1;
+    }
+
+    for (i = 0; i < graph->state_nums; ++i)
+    {
+        if (graph->states[i]->transition_nums > transition_max)
+        {
+            transition_max = graph->states[i]->transition_nums;
+        }
+    }
+
+    // 临时数组：区间边界、事件类型、两个候选列表和哈希表占用标记
+    scratch = STATEM_MALLOC(transition_max * 3 * sizeof(long long) + transition_max * sizeof(int)
+                            + 2 * (transition_max + 1) * sizeof(uint32_t) + (transition_max << (SLOT_BITS_EXTRA + 1)));
+    if (!scratch)
+    {
+        return -1;
+    }
+
+    memset(&b, 0, sizeof(b));
+    b.points = (long long *)scratch;
+    b.types = (int *)(b.points + transition_max * 3);
+    b.candidates = (uint32_t *)(b.types + transition_max);
+    b.previous = b.candidates + transition_max + 1;
+    b.used = (uint8_t *)(b.previous + transition_max + 1);
+
+    for (i = 0; i < graph->state_nums; ++i)
+    {
+        state_build(&b, graph->states[i], NULL);
+    }
+
+    block = STATEM_MALLOC(graph->state_nums * sizeof(*index->tables) + b.slot_nums * sizeof(*b.slots)
+                          + b.range_nums * (sizeof(*b.starts) + sizeof(*b.ranges)) + b.list_nums * sizeof(*b.lists));
+    if (!block)
+    {
+        STATEM_FREE(scratch);
+        return -1;
+    }
+
+    index->memory = block;
+    index->tables = (struct statem_index_table *)block;
+    block += graph->state_nums * sizeof(*index->tables);
+    b.slots = (struct statem_index_slot *)block;
+    block += b.slot_nums * sizeof(*b.slots);
+    b.starts = (int *)block;
+    block += b.range_nums * sizeof(*b.starts);
+    b.ranges = (uint32_t *)block;
+    block += b.range_nums * sizeof(*b.ranges);
+    b.lists = (uint32_t *)block;
+    b.slot_nums = b.range_nums = b.list_nums = 0;
+
+    for (i = 0; i < graph->state_nums; ++i)
+    {
+        state_build(&b, graph->states[i], &index->tables[i]);
+    }
+
+    STATEM_FREE(scratch);
+
+    index->lists = b.lists;
+    index->finder.find = &index_find;
+    index->finder.ctx = index;
+    index->graph = graph;
+
+    return 0;
+}
+
+void statem_index_free(struct statem_index *index)
+{
+    if (!index || !index->memory)
+    {
+        return;
+    }
+
+    STATEM_FREE(index->memory);
+    index->memory = NULL;
+    index->tables = NULL;
+    index->lists = NULL;
+}
+
+const struct statem_finder *statem_index_finder(struct statem_index *index)
+{
+    return index ? &index->finder : NULL;
+}
+
+// 在哈希表中查找精确事件类型
+static uint32_t hash_lookup(const struct statem_index_table *table, int type)
+{
+    uint32_t mask = (1u << table->slot_bits) - 1;
+    uint32_t h = HASH(type, table->multiplier, table->slot_bits);
+    uint32_t probe;
+
+    for (probe = 0; probe <= table->probe_max; ++probe)
+    {
+        const struct statem_index_slot *slot = &table->slots[(h + probe) & mask];
+
+        if (slot->list == LIST_NONE)
+        {
+            break;
+        }
+        if (slot->event_type == type)
+        {
+            return slot->list;
+        }
+    }
+
+    return LIST_NONE;
+}
+
+// 二分查找事件类型所在的区间，循环中没有分支以免分支预测失败
+static uint32_t range_lookup(const struct statem_index_table *table, int type)
+{
+    const int *base = table->starts;
+    uint32_t nums = table->range_nums;
+
+    while (nums > 1)
+    {
+        uint32_t half = nums / 2;
+
+        base = (base[half] <= type) ? base + half : base;
+        nums -= half;
+    }
+
+    return (*base <= type) ? table->ranges[base - table->starts] : LIST_NONE;
+}
+
+/**
+ * @brief 通过索引找到候选转换，只对候选转换调用guard
+ *
+ * 候选列表按原顺序排列，与顺序扫描返回相同的转换
+ *
+ * @param ctx       索引查找上下文
+ * @param state     状态
+ * @param event     事件
+ * @return struct transition*   找到的转换，没有则返回NULL
+ */
+static struct transition *index_find(void *ctx, struct state *state, struct event *event)
+{
+    struct statem_index *index = ctx;
+    const struct statem_index_table *table;
+    const uint32_t *candidates;
+    uint32_t list = LIST_NONE, i;
+
+    // 不属于该状态图或转换较少的状态，按原顺序查找
+    if (state->id >= index->graph->state_nums || index->graph->states[state->id] != state
+        || index->tables[state->id].scan)
+    {
+        for (i = 0; i < state->transition_nums; ++i)
+        {
+            struct transition *t = &state->transitions[i];
+
+            if (statem_transition_match(t, event->type) && (!t->guard || t->guard(t->condition, event)))
+            {
+                return t;
+            }
+        }
+
+        return NULL;
+    }
+
+    table = &index->tables[state->id];
+
+    if (table->slot_bits)
+    {
+        list = hash_lookup(table, event->type);
+    }
+
+    if (list == LIST_NONE && table->range_nums)
+    {
+        list = range_lookup(table, event->type);
+    }
+
+    // 通配转换不与无事件转换的事件类型匹配
+    if (list == LIST_NONE)
+    {
+        if (event->type == STATEM_EVENT_COMPLETION)
+        {
+            return NULL;
+        }
+        list = table->any;
+    }
+
+    candidates = &index->lists[list];
+    for (i = 1; i <= candidates[0]; ++i)
+    {
+        struct transition *t = &state->transitions[candidates[i]];
+
+        if (!t->guard || t->guard(t->condition, event))
+        {
+            return t;
+        }
+    }
+
+    return NULL;
+}
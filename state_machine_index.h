@@ -0,0 +1,136 @@
+/**
+ * \addtogroup state_machine
+ * @{
+ *
+ * \file
+ * \brief Per-state event type index for sparse, ranged and wildcard types
+ *
+ * The default lookup compares the event type with every transition of a
+ * state. When event types are sparse 32-bit identifiers, e.g. message ids
+ * or hashes, or when transitions accept whole \ref transition::event_span
+ * "ranges" of types, that scan is all a dispatch does. An index finder
+ * builds a lookup structure for every state of a numbered graph once:
+ *
+ * - the distinct exact event types go into a multiplicative hash table. The
+ *   multiplier and table size are searched so that every type lands in its
+ *   own slot; if no such multiplier is found, the one with the shortest
+ *   linear probe is kept.
+ * - the ranges are split into sorted, non-overlapping intervals that are
+ *   found by binary search.
+ * - #STATEM_EVENT_ANY transitions serve the remaining types.
+ *
+ * Every hash slot and interval points to the transitions that can match its
+ * types, in array order and cut after the first one without a guard, so
+ * guards are called exactly as the default scan calls them and the first
+ * accepted transition is the same. Lookups do not allocate.
+ *
+ * States with at most #STATEM_INDEX_SCAN_MAX transitions keep the default
+ * scan, which is faster for them.
+ *
+ * ~~~{.c}
+ * statem_graph_build(&graph, states, STATE_MAX, &state_idle, &state_error);
+ * statem_index_init(&index, &graph);
+ * statem_init(&m, &state_idle, &state_error);
+ * statem_finder_set(&m, statem_index_finder(&index));
+ * ~~~
+ *
+ * \note The finder only reads its tables, so any number of machines and
+ * threads may share it. Rebuild it if the graph's transitions change.
+ */
+
+#ifndef __STATE_MACHINE_INDEX_H
+#define __STATE_MACHINE_INDEX_H
+
+#include <stdint.h>
+#include "state_machine.h"
+
+/**
+ * \brief Largest number of transitions for which a state keeps the scan
+ */
+#ifndef STATEM_INDEX_SCAN_MAX
+#define STATEM_INDEX_SCAN_MAX   4
+#endif
+
+/**
+ * \brief Hash slot of an exact event type
+ */
+struct statem_index_slot
+{
+    int event_type;
+
+    // 候选转换列表在lists中的下标，空槽为UINT32_MAX
+    uint32_t list;
+};
+
+/**
+ * \brief Index of one state
+ *
+ * There is no need to manipulate the members directly.
+ */
+struct statem_index_table
+{
+    // 为true时按原顺序查找
+    bool scan;
+
+    // 精确事件类型的哈希表，slot_bits为0时没有
+    uint32_t multiplier;
+    uint32_t slot_bits;
+    uint32_t probe_max;
+    const struct statem_index_slot *slots;
+
+    // 范围拆分后的区间，starts升序排列，ranges为对应的候选转换列表
+    uint32_t range_nums;
+    const int *starts;
+    const uint32_t *ranges;
+
+    // 只与通配转换匹配的事件类型的候选转换列表
+    uint32_t any;
+};
+
+/**
+ * \brief Index finder context
+ *
+ * There is no need to manipulate the members directly.
+ */
+struct statem_index
+{
+    struct statem_finder finder;
+    const struct statem_graph *graph;
+
+    // 每个状态的索引，下标为状态编号
+    struct statem_index_table *tables;
+
+    // 候选转换列表，每个列表的第一项为转换个数，之后为转换下标
+    uint32_t *lists;
+
+    void *memory;
+};
+
+/**
+ * \brief Build the index of every state of a numbered graph
+ *
+ * \param index the context to initialise.
+ * \param graph a graph numbered by statem_graph_build().
+ *
+ * \retval 0 on success.
+ * \retval -1 on invalid arguments or if memory could not be allocated.
+ */
+int statem_index_init(struct statem_index *index, const struct statem_graph *graph);
+
+/**
+ * \brief Release the memory of an index finder
+ *
+ * No machine may use the finder any more.
+ */
+void statem_index_free(struct statem_index *index);
+
+/**
+ * \brief Get the finder to pass to statem_finder_set()
+ */
+const struct statem_finder *statem_index_finder(struct statem_index *index);
+
+#endif // __STATE_MACHINE_INDEX_H
+
+/**
+ * @}
+ */
@@ -0,0 +1,654 @@
+#include <dlfcn.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "state_machine_jit.h"
+#include "state_machine_port.h"
+
+// 生成的分发函数无法处理该状态，交给statem_handle_event()
+#define JIT_FALLBACK            (-100)
+
+#define JIT_PATH_MAX            256
+
+typedef void (*jit_bind_t)(struct state **states, void *guards, void **conditions, void *actions);
+
+// 生成代码的固定部分：回调表、进入错误状态和执行一次转换，语义与statem_handle_event()一致
+static const char jit_prologue[] =
+    "#include <stddef.h>\n"
+    "#include \"state_machine.h\"\n"
+    "\n"
+    "typedef bool (*guard_t)(void *, struct event *);\n"
+    "typedef void (*action_t)(void *, struct event *, void *);\n"
+    "\n"
+    "static struct state **S;\n"
+    "static guard_t *G;\n"
+    "static void **C;\n"
+    "static action_t *A;\n"
+    "\n"
+    "void statem_jit_bind(struct state **s, guard_t *g, void **c, action_t *a)\n"
+    "{\n"
+    "    S = s;\n"
+    "    G = g;\n"
+    "    C = c;\n"
+    "    A = a;\n"
+    "}\n"
+    "\n"
+    "static int go_error(struct state_machine *fsm, struct event *e)\n"
+    "{\n"
+    "    fsm->state_previous = fsm->state_current;\n"
+    "    fsm->state_current = fsm->state_error;\n"
+    "    if (fsm->state_current && fsm->state_current->action_entry)\n"
+    "        fsm->state_current->action_entry(fsm->state_current->data, e);\n"
+    "    statem_publish(fsm);\n"
+    "    return STATEM_ERR_STATE_RECHED;\n"
+    "}\n"
+    "\n"
+    "static inline int take(struct state_machine *fsm, struct event *e, struct state *next, action_t action)\n"
+    "{\n"
+    "    struct state *cur = fsm->state_current;\n"
+    "    if (!next)\n"
+    "        return go_error(fsm, e);\n"
+    "    if (next != cur && cur->action_exti)\n"
+    "        cur->action_exti(cur->data, e);\n"
+    "    if (action)\n"
+    "        action(cur->data, e, next->data);\n"
+    "    fsm->state_previous = cur;\n"
+    "    if (next != cur && next->action_entry)\n"
+    "        next->action_entry(next->data, e);\n"
+    "    fsm->state_current = next;\n"
+    "    statem_publish(fsm);\n"
+    "    if (next == cur)\n"
+    "        return STATEM_STATE_LOOPSELF;\n"
+    "    if (next == fsm->state_error)\n"
+    "        return STATEM_ERR_STATE_RECHED;\n"
+    "    if (!next->transition_nums && !next->state_parent)\n"
+    "        return STATEM_FINAL_STATE_RECHED;\n"
+    "    return STATEM_STATE_CHANGED;\n"
+    "}\n"
+    "\n"
+    "static int dispatch_event(struct state_machine *fsm, struct event *e);\n"
+    "\n";
+
+// 生成代码的入口：分发事件后执行无事件转换，规则与statem_handle_event()一致
+static const char jit_epilogue[] =
+    "\n"
+    "int statem_jit_dispatch(struct state_machine *fsm, struct event *e)\n"
+    "{\n"
+    "#if STATEM_COMPLETION_HOPS_MAX > 0\n"
+    "    struct state *origin = fsm->state_current;\n"
+    "    struct event c = { STATEM_EVENT_COMPLETION, e->data };\n"
+    "    struct state *visited[STATEM_COMPLETION_HOPS_MAX + 1];\n"
+    "    size_t hops = 0, i;\n"
+    "    int ret = dispatch_event(fsm, e);\n"
+    "    if (ret != STATEM_STATE_CHANGED)\n"
+    "        return ret;\n"
+    "    visited[0] = fsm->state_current;\n"
+    "    while ((ret = dispatch_event(fsm, &c)) != STATEM_STATE_NOCHANGE)\n"
+    "    {\n"
+    "        if (ret == STATEM_ERR_STATE_RECHED || ret == STATEM_FINAL_STATE_RECHED)\n"
+    "            return ret;\n"
+    "        if (ret == STATEM_STATE_LOOPSELF || ++hops > STATEM_COMPLETION_HOPS_MAX)\n"
+    "            return go_error(fsm, &c);\n"
+    "        for (i = 0; i < hops; ++i)\n"
+    "            if (visited[i] == fsm->state_current)\n"
+    "                return go_error(fsm, &c);\n"
+    "        visited[hops] = fsm->state_current;\n"
+    "    }\n"
+    "    return fsm->state_current == origin ? STATEM_STATE_LOOPSELF : STATEM_STATE_CHANGED;\n"
+    "#else\n"
+    "    return dispatch_event(fsm, e);\n"
+    "#endif\n"
+    "}\n";
+
+/**
+ * @brief 初始化JIT上下文
+ *
+ * 按整个状态图中的转换序号建立回调表，生成的代码通过常量下标访问
+ *
+ * @param jit           JIT上下文
+ * @param graph         已编号的状态图
+ * @param cc            编译器
+ * @param include_dir   state_machine.h所在目录
+ * @return int          0：成功   -1：失败
+ */
+int statem_jit_init(struct statem_jit *jit, const struct statem_graph *graph,
+                    const char *cc, const char *include_dir)
+{
+    size_t transition_nums = 0;
+    size_t i, j, k = 0;
+
+    if (!jit || !graph || !graph->state_nums)
+    {
+        return -1;
+    }
+
+    for (i = 0; i < graph->state_nums; ++i)
+    {
+        transition_nums += graph->states[i]->transition_nums;
+    }
+
+    memset(jit, 0, sizeof(*jit));
+    jit->graph = graph;
+    jit->cc = cc ? cc : STATEM_JIT_CC;
+    jit->include_dir = include_dir ? include_dir : STATEM_JIT_INCLUDE_DIR;
+    jit->status = STATEM_JIT_IDLE;
+
+    jit->guards = STATEM_MALLOC((transition_nums ? transition_nums : 1) * sizeof(*jit->guards));
+    jit->conditions = STATEM_MALLOC((transition_nums ? transition_nums : 1) * sizeof(*jit->conditions));
+    jit->actions = STATEM_MALLOC((transition_nums ? transition_nums : 1) * sizeof(*jit->actions));
+    if (!jit->guards || !jit->conditions || !jit->actions)
+    {
+        statem_jit_free(jit);
+        return -1;
+    }
+
+    for (i = 0; i < graph->state_nums; ++i)
+    {
+        for (j = 0; j < graph->states[i]->transition_nums; ++j, ++k)
+        {
+            jit->guards[k] = graph->states[i]->transitions[j].guard;
+            jit->conditions[k] = graph->states[i]->transitions[j].condition;
+            jit->actions[k] = graph->states[i]->transitions[j].action;
+        }
+    }
+
+    return 0;
+}
+
+// 转换在整个状态图中的序号
+static size_t transition_index(const struct statem_graph *graph, const struct state *state,
+                               const struct transition *t)
+{
+    size_t i, index = 0;
+
+    for (i = 0; i < state->id; ++i)
+    {
+        index += graph->states[i]->transition_nums;
+    }
+
+    return index + (size_t)(t - state->transitions);
+}
+
+// 事件类型在状态及其父状态中是否已经出现过（已经生成过该case）
+static bool event_type_seen(const struct state *state, const struct state *until, size_t nums, int type)
+{
+    size_t j;
+
+    for (; state != until; state = state->state_parent)
+    {
+        for (j = 0; j < state->transition_nums; ++j)
+        {
+            if (state->transitions[j].event_type == type)
+            {
+                return true;
+            }
+        }
+    }
+
+    for (j = 0; j < nums; ++j)
+    {
+        if (until->transitions[j].event_type == type)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// 生成执行一个转换的语句
+static void emit_take(FILE *fp, const struct transition *t, size_t k)
+{
+    const struct state *next = t->state_next;
+
+    while (next && next->state_entry)
+    {
+        next = next->state_entry;
+    }
+
+    if (next && t->action)
+    {
+        fprintf(fp, "return take(fsm, e, S[%u], A[%zu]);\n", next->id, k);
+    }
+    else if (next)
+    {
+        fprintf(fp, "return take(fsm, e, S[%u], NULL);\n", next->id);
+    }
+    else
+    {
+        fprintf(fp, "return go_error(fsm, e);\n");
+    }
+}
+
+// 状态及其父状态中是否有范围或通配转换
+static bool chain_ranged(const struct state *state)
+{
+    size_t j;
+
+    for (; state; state = state->state_parent)
+    {
+        for (j = 0; j < state->transition_nums; ++j)
+        {
+            if (state->transitions[j].event_span || state->transitions[j].event_type == STATEM_EVENT_ANY)
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief 按首个匹配的顺序逐个比较当前状态及所有父状态的转换
+ *
+ * 范围和通配转换无法展开为switch的case，含有这类转换的状态生成if链，
+ * 匹配条件与statem_transition_match()相同
+ *
+ * @param fp        输出文件
+ * @param graph     状态图
+ * @param state     状态
+ */
+static void emit_state_scan(FILE *fp, const struct statem_graph *graph, const struct state *state)
+{
+    const struct state *s;
+    size_t j;
+
+    for (s = state; s; s = s->state_parent)
+    {
+        for (j = 0; j < s->transition_nums; ++j)
+        {
+            const struct transition *t = &s->transitions[j];
+            size_t k = transition_index(graph, s, t);
+
+            if (t->event_type == STATEM_EVENT_ANY)
+            {
+                fprintf(fp, "        if (e->type != STATEM_EVENT_COMPLETION");
+            }
+            else if (t->event_span)
+            {
+                fprintf(fp, "        if ((unsigned int)e->type - %uu <= %uu", (unsigned int)t->event_type, t->event_span);
+            }
+            else if (t->event_type == STATEM_EVENT_COMPLETION)
+            {
+                fprintf(fp, "        if (e->type == STATEM_EVENT_COMPLETION");
+            }
+            else
+            {
+                fprintf(fp, "        if (e->type == %d", t->event_type);
+            }
+
+            if (t->guard)
+            {
+                fprintf(fp, " && G[%zu](C[%zu], e)", k, k);
+            }
+
+            fprintf(fp, ")\n            ");
+            emit_take(fp, t, k);
+        }
+    }
+
+    fprintf(fp, "        return STATEM_STATE_NOCHANGE;\n");
+}
+
+// 生成一个事件类型的候选转换：当前状态及所有父状态中该类型的转换，按首个匹配的顺序排列
+static void emit_event_case(FILE *fp, const struct statem_graph *graph, const struct state *state, int type)
+{
+    const struct state *s;
+    size_t j;
+
+    if (type == STATEM_EVENT_COMPLETION)
+    {
+        fprintf(fp, "        case STATEM_EVENT_COMPLETION:\n");
+    }
+    else
+    {
+        fprintf(fp, "        case %d:\n", type);
+    }
+
+    for (s = state; s; s = s->state_parent)
+    {
+        for (j = 0; j < s->transition_nums; ++j)
+        {
+            const struct transition *t = &s->transitions[j];
+            size_t k;
+
+            if (t->event_type != type)
+            {
+                continue;
+            }
+
+            k = transition_index(graph, s, t);
+
+            fprintf(fp, "            ");
+            if (t->guard)
+            {
+                fprintf(fp, "if (G[%zu](C[%zu], e)) ", k, k);
+            }
+            emit_take(fp, t, k);
+
+            // 无条件转换之后的候选不可能被选中
+            if (!t->guard)
+            {
+                return;
+            }
+        }
+    }
+
+    fprintf(fp, "            return STATEM_STATE_NOCHANGE;\n");
+}
+
+// 生成整个分发函数
+static int jit_generate(struct statem_jit *jit, FILE *fp)
+{
+    const struct statem_graph *graph = jit->graph;
+    size_t i, j;
+
+    // 与宿主程序使用相同的无事件转换跳转上限
+    fprintf(fp, "#define STATEM_COMPLETION_HOPS_MAX %d\n", STATEM_COMPLETION_HOPS_MAX);
+    fputs(jit_prologue, fp);
+
+    fprintf(fp, "static int dispatch_event(struct state_machine *fsm, struct event *e)\n{\n");
+    fprintf(fp, "    struct state *cur = fsm->state_current;\n");
+    fprintf(fp, "    if (!cur)\n        return go_error(fsm, e);\n");
+    fprintf(fp, "    if (cur->id >= %zuu || S[cur->id] != cur)\n        return %d;\n", graph->state_nums, JIT_FALLBACK);
+    fprintf(fp, "    switch (cur->id)\n    {\n");
+
+    for (i = 0; i < graph->state_nums; ++i)
+    {
+        const struct state *state = graph->states[i];
+        const struct state *s;
+
+        fprintf(fp, "    case %zu:\n", i);
+
+        if (!state->transition_nums && !state->state_parent)
+        {
+            fprintf(fp, "        return STATEM_STATE_NOCHANGE;\n");
+            continue;
+        }
+
+        if (chain_ranged(state))
+        {
+            emit_state_scan(fp, graph, state);
+            continue;
+        }
+
+        fprintf(fp, "        switch (e->type)\n        {\n");
+
+        for (s = state; s; s = s->state_parent)
+        {
+            for (j = 0; j < s->transition_nums; ++j)
+            {
+                if (!event_type_seen(state, s, j, s->transitions[j].event_type))
+                {
+                    emit_event_case(fp, graph, state, s->transitions[j].event_type);
+                }
+            }
+        }
+
+        fprintf(fp, "        default:\n            return STATEM_STATE_NOCHANGE;\n        }\n");
+    }
+
+    fprintf(fp, "    }\n    return %d;\n}\n", JIT_FALLBACK);
+    fputs(jit_epilogue, fp);
+
+    return ferror(fp) ? -1 : 0;
+}
+
+/**
+ * @brief 运行编译器
+ *
+ * 参数直接传给execvp()，不经过shell，路径中的引号、空格等字符无需转义
+ *
+ * @param jit       JIT上下文
+ * @param object    输出的动态库
+ * @param source    生成的源文件
+ * @return int      0：成功   -1：失败
+ */
+static int compiler_run(const struct statem_jit *jit, const char *object, const char *source)
+{
+    char *const argv[] = {
+        (char *)jit->cc, "-O2", "-shared", "-fPIC", "-I", (char *)jit->include_dir,
+        "-o", (char *)object, (char *)source, NULL,
+    };
+    pid_t pid, ret;
+    int status;
+
+    pid = fork();
+    if (pid < 0)
+    {
+        return -1;
+    }
+
+    if (!pid)
+    {
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+
+    do
+    {
+        ret = waitpid(pid, &status, 0);
+    } while (ret < 0 && errno == EINTR);
+
+    return (ret == pid && WIFEXITED(status) && !WEXITSTATUS(status)) ? 0 : -1;
+}
+
+/**
+ * @brief 保留被替换的动态库
+ *
+ * 替换时其他线程可能仍在执行旧的分发函数，无法立即卸载，由statem_jit_free()统一卸载
+ *
+ * @param jit       JIT上下文
+ * @param handle    被替换的动态库
+ */
+static void handle_retire(struct statem_jit *jit, void *handle)
+{
+    struct statem_jit_retired *retired;
+
+    if (!handle)
+    {
+        return;
+    }
+
+    retired = STATEM_MALLOC(sizeof(*retired));
+    if (!retired)
+    {
+        // 无法记录时不卸载，宁可泄漏也不能卸载仍在执行的代码
+        return;
+    }
+
+    retired->handle = handle;
+    retired->next = jit->retired;
+    jit->retired = retired;
+}
+
+/**
+ * @brief 生成、编译并加载分发函数
+ *
+ * 重新编译时先停用旧的分发函数，编译失败后由statem_handle_event()处理事件，
+ * 不会继续使用旧的代码
+ *
+ * @param jit   JIT上下文
+ * @return int  0：成功   -1：失败
+ */
+int statem_jit_compile(struct statem_jit *jit)
+{
+    char dir[JIT_PATH_MAX], source[JIT_PATH_MAX + 16], object[JIT_PATH_MAX + 16];
+    const char *tmpdir = getenv("TMPDIR");
+    jit_bind_t bind;
+    void *dispatch;
+    FILE *fp;
+    int ret;
+
+    if (!jit || !jit->graph)
+    {
+        return -1;
+    }
+
+    STATEM_ATOMIC_STORE(&jit->status, STATEM_JIT_COMPILING);
+    STATEM_ATOMIC_STORE(&jit->dispatch, NULL);
+    handle_retire(jit, jit->handle);
+    jit->handle = NULL;
+
+    // 源文件和动态库都放在权限为0700的私有目录中，其他用户无法预先创建或替换动态库
+    snprintf(dir, sizeof(dir), "%s/statem_jit_XXXXXX", tmpdir ? tmpdir : "/tmp");
+    if (!mkdtemp(dir))
+    {
+        STATEM_ATOMIC_STORE(&jit->status, STATEM_JIT_FAILED);
+        return -1;
+    }
+    snprintf(source, sizeof(source), "%s/dispatch.c", dir);
+    snprintf(object, sizeof(object), "%s/dispatch.so", dir);
+
+    fp = fopen(source, "wx");
+    if (!fp)
+    {
+        rmdir(dir);
+        STATEM_ATOMIC_STORE(&jit->status, STATEM_JIT_FAILED);
+        return -1;
+    }
+
+    ret = jit_generate(jit, fp);
+    ret |= fclose(fp);
+
+    if (!ret && !compiler_run(jit, object, source))
+    {
+        jit->handle = dlopen(object, RTLD_NOW | RTLD_LOCAL);
+    }
+
+    unlink(source);
+    unlink(object);
+    rmdir(dir);
+
+    if (!jit->handle)
+    {
+        STATEM_ATOMIC_STORE(&jit->status, STATEM_JIT_FAILED);
+        return -1;
+    }
+
+    bind = (jit_bind_t)dlsym(jit->handle, "statem_jit_bind");
+    dispatch = dlsym(jit->handle, "statem_jit_dispatch");
+    if (!bind || !dispatch)
+    {
+        dlclose(jit->handle);
+        jit->handle = NULL;
+        STATEM_ATOMIC_STORE(&jit->status, STATEM_JIT_FAILED);
+        return -1;
+    }
+
+    bind(jit->graph->states, jit->guards, jit->conditions, jit->actions);
+
+    // 发布分发函数，之后的事件都由生成的代码处理
+    STATEM_ATOMIC_STORE(&jit->dispatch, (int (*)(struct state_machine *, struct event *))dispatch);
+    STATEM_ATOMIC_STORE(&jit->status, STATEM_JIT_READY);
+
+    return 0;
+}
+
+static void *jit_thread(void *parameter)
+{
+    statem_jit_compile(parameter);
+
+    return NULL;
+}
+
+int statem_jit_compile_async(struct statem_jit *jit)
+{
+    if (!jit || jit->thread_running || STATEM_ATOMIC_LOAD(&jit->status) == STATEM_JIT_READY)
+    {
+        return -1;
+    }
+
+    STATEM_ATOMIC_STORE(&jit->status, STATEM_JIT_COMPILING);
+
+    if (pthread_create(&jit->thread, NULL, &jit_thread, jit))
+    {
+        STATEM_ATOMIC_STORE(&jit->status, STATEM_JIT_FAILED);
+        return -1;
+    }
+    jit->thread_running = true;
+
+    return 0;
+}
+
+int statem_jit_status(struct statem_jit *jit)
+{
+    return jit ? STATEM_ATOMIC_LOAD(&jit->status) : STATEM_JIT_FAILED;
+}
+
+/**
+ * @brief 使用生成的分发函数处理事件
+ *
+ * 编译完成前，或者当前状态不属于编译的状态图时，由statem_handle_event()处理
+ *
+ * @param jit       JIT上下文
+ * @param fsm       状态机
+ * @param event     事件
+ * @return int
+ */
+int statem_jit_handle_event(struct statem_jit *jit, struct state_machine *fsm, struct event *event)
+{
+    int (*dispatch)(struct state_machine *, struct event *);
+    int ret;
+
+    if (!jit || !fsm || !event)
+    {
+        return statem_handle_event(fsm, event);
+    }
+
+    dispatch = STATEM_ATOMIC_LOAD(&jit->dispatch);
+    if (!dispatch)
+    {
+        return statem_handle_event(fsm, event);
+    }
+
+    ret = dispatch(fsm, event);
+    if (ret == JIT_FALLBACK)
+    {
+        ret = statem_handle_event(fsm, event);
+    }
+
+    return ret;
+}
+
+void statem_jit_free(struct statem_jit *jit)
+{
+    if (!jit)
+    {
+        return;
+    }
+
+    if (jit->thread_running)
+    {
+        pthread_join(jit->thread, NULL);
+        jit->thread_running = false;
+    }
+
+    jit->dispatch = NULL;
+
+    if (jit->handle)
+    {
+        dlclose(jit->handle);
+        jit->handle = NULL;
+    }
+
+    while (jit->retired)
+    {
+        struct statem_jit_retired *retired = jit->retired;
+
+        jit->retired = retired->next;
+        dlclose(retired->handle);
+        STATEM_FREE(retired);
+    }
+
+    STATEM_FREE(jit->guards);
+    STATEM_FREE(jit->conditions);
+    STATEM_FREE(jit->actions);
+    jit->guards = NULL;
+    jit->conditions = NULL;
+    jit->actions = NULL;
+}
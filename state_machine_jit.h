@@ -0,0 +1,169 @@
+/**
+ * \addtogroup state_machine
+ * @{
+ *
+ * \file
+ * \brief Runtime compilation of a state graph into native code
+ *
+ * For graphs that are only known at runtime, the JIT backend generates C code
+ * specialised for the graph: a `switch` on the current state, a nested
+ * `switch` on the event type and, per case, the candidate transitions of the
+ * state and all of its parents already flattened in first-match order, with
+ * \ref state::state_entry "entry state" descent resolved. The code is
+ * compiled with the system compiler into a shared object, loaded with
+ * `dlopen()` and swapped in as the dispatch function. States whose chain
+ * contains \ref transition::event_span "ranged" or #STATEM_EVENT_ANY
+ * transitions get a flattened `if` chain in place of the nested `switch`.
+ *
+ * Callbacks are usually `static`, so they cannot be linked by name. The
+ * generated code calls them through tables bound at load time, indexed by
+ * constants, which still removes the transition scan, the event type
+ * compares and the parent walk from the dispatch path.
+ *
+ * statem_jit_handle_event() uses statem_handle_event() until compilation has
+ * finished, and for states that are not part of the compiled graph.
+ *
+ * \note Only available on POSIX systems with a C compiler installed. The
+ * compiled dispatch does not support \ref state::deferred_types "deferred
+ * events"; graphs that defer events should use statem_handle_event().
+ *
+ * ~~~{.c}
+ * statem_graph_build(&graph, states, STATE_MAX, &state_idle, &state_error);
+ * statem_jit_init(&jit, &graph, NULL, NULL);
+ * statem_jit_compile_async(&jit);
+ * ...
+ * statem_jit_handle_event(&jit, &m, &event);
+ * ~~~
+ */
+
+#ifndef __STATE_MACHINE_JIT_H
+#define __STATE_MACHINE_JIT_H
+
+#include <pthread.h>
+#include "state_machine.h"
+
+// 默认编译器
+#ifndef STATEM_JIT_CC
+#define STATEM_JIT_CC           "cc"
+#endif
+
+// state_machine.h所在目录，生成的代码需要包含该头文件
+#ifndef STATEM_JIT_INCLUDE_DIR
+#define STATEM_JIT_INCLUDE_DIR  "."
+#endif
+
+/**
+ * \brief Shared object replaced by a later compilation
+ */
+struct statem_jit_retired
+{
+    struct statem_jit_retired *next;
+    void *handle;
+};
+
+/**
+ * \brief Compilation status
+ */
+enum statem_jit_status
+{
+    STATEM_JIT_IDLE,
+    STATEM_JIT_COMPILING,
+    STATEM_JIT_READY,
+    STATEM_JIT_FAILED,
+};
+
+/**
+ * \brief JIT context
+ *
+ * There is no need to manipulate the members directly.
+ */
+struct statem_jit
+{
+    const struct statem_graph *graph;
+    const char *cc;
+    const char *include_dir;
+
+    // 生成的代码通过以下表调用回调函数，下标为转换在整个状态图中的序号
+    bool (**guards)(void *condition, struct event *event);
+    void **conditions;
+    void (**actions)(void *state_current_data, struct event *event, void *state_new_data);
+
+    // 编译完成后的分发函数，未完成时为NULL
+    int (*dispatch)(struct state_machine *fsm, struct event *event);
+
+    void *handle;
+
+    // 重新编译后被替换的动态库，由statem_jit_free()卸载
+    struct statem_jit_retired *retired;
+
+    pthread_t thread;
+    bool thread_running;
+    int status;
+};
+
+/**
+ * \brief Initialise a JIT context for a numbered graph
+ *
+ * \param jit the context to initialise.
+ * \param graph a graph numbered by statem_graph_build(). It must not change
+ * while the context is in use.
+ * \param cc the compiler to run, NULL for #STATEM_JIT_CC. It is a single
+ * program, looked up in `PATH` and run without a shell.
+ * \param include_dir the directory containing state_machine.h, NULL for
+ * #STATEM_JIT_INCLUDE_DIR.
+ *
+ * \retval 0 on success.
+ * \retval -1 on invalid arguments or if memory could not be allocated.
+ */
+int statem_jit_init(struct statem_jit *jit, const struct statem_graph *graph,
+                    const char *cc, const char *include_dir);
+
+/**
+ * \brief Generate, compile and load the dispatcher in the calling thread
+ *
+ * Calling it again replaces the dispatcher. Events are handled by
+ * statem_handle_event() from the start of the compilation until the new
+ * dispatcher is loaded, and for good if it fails. Other threads may still
+ * run the previous code, so it stays loaded until statem_jit_free().
+ *
+ * \retval 0 on success.
+ * \retval -1 if generating, compiling or loading failed.
+ */
+int statem_jit_compile(struct statem_jit *jit);
+
+/**
+ * \brief Compile the dispatcher in a background thread
+ *
+ * Events are handled by statem_handle_event() until the compiled dispatcher
+ * is swapped in.
+ *
+ * \retval 0 if the thread was started.
+ * \retval -1 otherwise.
+ */
+int statem_jit_compile_async(struct statem_jit *jit);
+
+/**
+ * \brief Get the compilation status
+ *
+ * \return #statem_jit_status
+ */
+int statem_jit_status(struct statem_jit *jit);
+
+/**
+ * \brief Pass an event to a state machine using the compiled dispatcher
+ *
+ * \return #statem_handle_event_return_vals
+ */
+int statem_jit_handle_event(struct statem_jit *jit, struct state_machine *state_machine,
+                            struct event *event);
+
+/**
+ * \brief Wait for a background compilation and release all resources
+ */
+void statem_jit_free(struct statem_jit *jit);
+
+#endif // __STATE_MACHINE_JIT_H
+
+/**
+ * @}
+ */
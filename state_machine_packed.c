@@ -0,0 +1,453 @@
+#include <string.h>
+#include "state_machine_packed.h"
+#include "state_machine_port.h"
+
+// 查找回调函数在表中的索引，不存在则追加，NULL对应空索引
+#define TABLE_INDEX(index, table, nums, fn)     \
+    do                                          \
+    {                                           \
+        uint16_t i_;                            \
+        (index) = STATEM_PACKED_NONE;           \
+        if (!(fn))                              \
+        {                                       \
+            break;                              \
+        }                                       \
+        for (i_ = 0; i_ < (nums); ++i_)         \
+        {                                       \
+            if ((table)[i_] == (fn))            \
+            {                                   \
+                break;                          \
+            }                                   \
+        }                                       \
+        if (i_ == (nums))                       \
+        {                                       \
+            (table)[(nums)++] = (fn);           \
+        }                                       \
+        (index) = i_;                           \
+    } while (0)
+
+static void go_to_state_error(struct statem_packed_machine *fsm, struct event *const event);
+static const struct statem_packed_transition *get_transition(const struct statem_packed *graph,
+                                                             uint16_t state, uint16_t event_type,
+                                                             struct event *const event);
+static int transition_run(struct statem_packed_machine *fsm, uint16_t event_type, struct event *event);
+#if STATEM_COMPLETION_HOPS_MAX > 0
+static int completion_run(struct statem_packed_machine *fsm, struct event *event, uint16_t state_origin);
+#endif
+
+// 收集状态图，状态表空间不足时加倍重试
+static struct state **graph_collect(struct statem_graph *graph, struct state *state_init,
+                                    struct state *state_error)
+{
+    size_t state_max;
+
+    for (state_max = 64; state_max <= STATEM_PACKED_NONE + 1u; state_max *= 2)
+    {
+        struct state **states = STATEM_MALLOC(state_max * sizeof(*states));
+
+        if (!states)
+        {
+            return NULL;
+        }
+
+        if (!statem_graph_build(graph, states, state_max, state_init, state_error))
+        {
+            return states;
+        }
+
+        STATEM_FREE(states);
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief 将指针形式的状态图转换为紧凑形式
+ *
+ * 所有数组在一块内存中分配：指针数组在前保证对齐，
+ * 分发时访问的状态数组和转换数组在后并且相邻
+ *
+ * @param packed        紧凑状态图
+ * @param state_init    初始状态
+ * @param state_error   错误状态
+ * @return int          0：成功   -1：失败
+ */
+int statem_packed_build(struct statem_packed *packed, struct state *state_init,
+                        struct state *state_error)
+{
+    struct statem_graph graph;
+    struct state **states;
+    size_t transition_nums = 0;
+    size_t i, j, size;
+    uint16_t guard_nums = 0, action_nums = 0, state_action_nums = 0;
+    uint16_t transition_index = 0;
+    uint8_t *block;
+
+    if (!packed || !state_init)
+    {
+        return -1;
+    }
+
+    states = graph_collect(&graph, state_init, state_error);
+    if (!states)
+    {
+        return -1;
+    }
+
+    // 检查是否超出16位表示范围
+    for (i = 0; i < graph.state_nums; ++i)
+    {
+        // 紧凑格式没有推迟缓冲区，推迟事件的状态会静默丢弃这些事件
+        if (graph.states[i]->deferred_nums)
+        {
+            STATEM_FREE(states);
+            return -1;
+        }
+
+        for (j = 0; j < graph.states[i]->transition_nums; ++j)
+        {
+            const struct transition *t = &graph.states[i]->transitions[j];
+            int event_type = t->event_type;
+
+            // 紧凑格式只保存单个事件类型，不支持范围和通配转换
+            if (t->event_span || (event_type != STATEM_EVENT_COMPLETION
+                                  && (event_type < 0 || event_type >= (int)STATEM_PACKED_COMPLETION)))
+            {
+                STATEM_FREE(states);
+                return -1;
+            }
+        }
+        transition_nums += graph.states[i]->transition_nums;
+    }
+
+    if (graph.state_nums >= STATEM_PACKED_NONE || transition_nums >= STATEM_PACKED_NONE)
+    {
+        STATEM_FREE(states);
+        return -1;
+    }
+
+    size = transition_nums * sizeof(*packed->conditions)
+         + graph.state_nums * sizeof(*packed->data)
+         + transition_nums * sizeof(*packed->guards)
+         + transition_nums * sizeof(*packed->actions)
+         + graph.state_nums * 2 * sizeof(*packed->state_actions)
+         + graph.state_nums * sizeof(*packed->states)
+         + transition_nums * sizeof(*packed->transitions);
+
+    block = STATEM_MALLOC(size ? size : 1);
+    if (!block)
+    {
+        STATEM_FREE(states);
+        return -1;
+    }
+
+    packed->conditions = (void **)block;
+    block += transition_nums * sizeof(*packed->conditions);
+    packed->data = (void **)block;
+    block += graph.state_nums * sizeof(*packed->data);
+    packed->guards = (void *)block;
+    block += transition_nums * sizeof(*packed->guards);
+    packed->actions = (void *)block;
+    block += transition_nums * sizeof(*packed->actions);
+    packed->state_actions = (void *)block;
+    block += graph.state_nums * 2 * sizeof(*packed->state_actions);
+    packed->states = (struct statem_packed_state *)block;
+    block += graph.state_nums * sizeof(*packed->states);
+    packed->transitions = (struct statem_packed_transition *)block;
+
+    for (i = 0; i < graph.state_nums; ++i)
+    {
+        struct state *state = graph.states[i];
+        struct statem_packed_state *ps = &packed->states[i];
+
+        ps->state_parent = state->state_parent ? (uint16_t)state->state_parent->id : STATEM_PACKED_NONE;
+        ps->transition_first = transition_index;
+        ps->transition_nums = (uint16_t)state->transition_nums;
+        ps->flags = (!state->transition_nums && !state->state_parent) ? STATEM_PACKED_FINAL : 0;
+        TABLE_INDEX(ps->action_entry, packed->state_actions, state_action_nums, state->action_entry);
+        TABLE_INDEX(ps->action_exti, packed->state_actions, state_action_nums, state->action_exti);
+        packed->data[i] = state->data;
+
+        for (j = 0; j < state->transition_nums; ++j, ++transition_index)
+        {
+            struct transition *t = &state->transitions[j];
+            struct statem_packed_transition *pt = &packed->transitions[transition_index];
+            struct state *state_next = t->state_next;
+
+            // 预先沿入口状态向下解析，分发时无需再遍历
+            while (state_next && state_next->state_entry)
+            {
+                state_next = state_next->state_entry;
+            }
+
+            pt->event_type = (t->event_type == STATEM_EVENT_COMPLETION) ? STATEM_PACKED_COMPLETION
+                                                                        : (uint16_t)t->event_type;
+            pt->state_next = state_next ? (uint16_t)state_next->id : STATEM_PACKED_NONE;
+            TABLE_INDEX(pt->guard, packed->guards, guard_nums, t->guard);
+            TABLE_INDEX(pt->action, packed->actions, action_nums, t->action);
+            packed->conditions[transition_index] = t->condition;
+        }
+    }
+
+    // 状态链上有无事件转换的状态，进入后才需要查找无事件转换
+    for (i = 0; i < graph.state_nums; ++i)
+    {
+        struct state *state;
+
+        for (state = graph.states[i]; state; state = state->state_parent)
+        {
+            for (j = 0; j < state->transition_nums; ++j)
+            {
+                if (state->transitions[j].event_type == STATEM_EVENT_COMPLETION)
+                {
+                    packed->states[i].flags |= STATEM_PACKED_COMPLETION_CHAIN;
+                }
+            }
+        }
+    }
+
+    packed->state_nums = (uint16_t)graph.state_nums;
+    packed->transition_nums = (uint16_t)transition_nums;
+    packed->state_init = (uint16_t)state_init->id;
+    packed->state_error = state_error ? (uint16_t)state_error->id : STATEM_PACKED_NONE;
+
+    STATEM_FREE(states);
+
+    return 0;
+}
+
+void statem_packed_free(struct statem_packed *packed)
+{
+    if (!packed || !packed->conditions)
+    {
+        return;
+    }
+
+    // 所有数组在一块内存中，首地址为conditions
+    STATEM_FREE(packed->conditions);
+    memset(packed, 0, sizeof(*packed));
+}
+
+/**
+ * @brief 初始化紧凑状态机
+ *
+ * @param fsm       状态机
+ * @param packed    紧凑状态图
+ * @return int      0：成功   -1：失败
+ */
+int statem_packed_init(struct statem_packed_machine *fsm, const struct statem_packed *packed)
+{
+    if (!fsm || !packed || !packed->states)
+    {
+        return -1;
+    }
+
+    fsm->graph = packed;
+    fsm->state_current = packed->state_init;
+    fsm->state_previous = STATEM_PACKED_NONE;
+
+    return 0;
+}
+
+/**
+ * @brief 紧凑状态机处理事件
+ *
+ * 与statem_handle_event()的处理流程和返回值完全一致
+ *
+ * @param fsm       状态机
+ * @param event     事件
+ * @return int
+ */
+int statem_packed_handle_event(struct statem_packed_machine *fsm, struct event *event)
+{
+    uint16_t event_type;
+
+    if (!fsm || !event || !fsm->graph)
+    {
+        return STATEM_ERR_ARG;
+    }
+
+    if (fsm->state_current == STATEM_PACKED_NONE)
+    {
+        go_to_state_error(fsm, event);
+        return STATEM_ERR_STATE_RECHED;
+    }
+
+    if (fsm->graph->states[fsm->state_current].flags & STATEM_PACKED_FINAL)
+    {
+        return STATEM_STATE_NOCHANGE;
+    }
+
+    // 事件类型超出16位，不可能匹配
+    if (event->type == STATEM_EVENT_COMPLETION)
+    {
+        event_type = STATEM_PACKED_COMPLETION;
+    }
+    else if (event->type < 0 || event->type >= (int)STATEM_PACKED_COMPLETION)
+    {
+        return STATEM_STATE_NOCHANGE;
+    }
+    else
+    {
+        event_type = (uint16_t)event->type;
+    }
+
+#if STATEM_COMPLETION_HOPS_MAX > 0
+    uint16_t state_origin = fsm->state_current;
+    int ret = transition_run(fsm, event_type, event);
+
+    if (ret == STATEM_STATE_CHANGED
+        && (fsm->graph->states[fsm->state_current].flags & STATEM_PACKED_COMPLETION_CHAIN))
+    {
+        ret = completion_run(fsm, event, state_origin);
+    }
+
+    return ret;
+#else
+    return transition_run(fsm, event_type, event);
+#endif
+}
+
+// 查找并执行一次转换
+static int transition_run(struct statem_packed_machine *fsm, uint16_t event_type, struct event *event)
+{
+    const struct statem_packed *graph = fsm->graph;
+    const struct statem_packed_state *current = &graph->states[fsm->state_current];
+    uint16_t state;
+
+    for (state = fsm->state_current; state != STATEM_PACKED_NONE; state = graph->states[state].state_parent)
+    {
+        const struct statem_packed_transition *transition = get_transition(graph, state, event_type, event);
+        uint16_t state_next;
+
+        if (!transition)
+        {
+            continue;
+        }
+
+        if (transition->state_next == STATEM_PACKED_NONE)
+        {
+            go_to_state_error(fsm, event);
+            return STATEM_ERR_STATE_RECHED;
+        }
+
+        state_next = transition->state_next;
+
+        if (state_next != fsm->state_current && current->action_exti != STATEM_PACKED_NONE)
+        {
+            graph->state_actions[current->action_exti](graph->data[fsm->state_current], event);
+        }
+
+        if (transition->action != STATEM_PACKED_NONE)
+        {
+            graph->actions[transition->action](graph->data[fsm->state_current], event, graph->data[state_next]);
+        }
+
+        fsm->state_previous = fsm->state_current;
+
+        if (state_next != fsm->state_current && graph->states[state_next].action_entry != STATEM_PACKED_NONE)
+        {
+            graph->state_actions[graph->states[state_next].action_entry](graph->data[state_next], event);
+        }
+
+        fsm->state_current = state_next;
+
+        if (fsm->state_current == fsm->state_previous)
+        {
+            return STATEM_STATE_LOOPSELF;
+        }
+
+        if (fsm->state_current == graph->state_error)
+        {
+            return STATEM_ERR_STATE_RECHED;
+        }
+
+        if (graph->states[fsm->state_current].flags & STATEM_PACKED_FINAL)
+        {
+            return STATEM_FINAL_STATE_RECHED;
+        }
+
+        return STATEM_STATE_CHANGED;
+    }
+
+    return STATEM_STATE_NOCHANGE;
+}
+
+#if STATEM_COMPLETION_HOPS_MAX > 0
+// 执行无事件转换，与statem_handle_event()的规则一致
+static int completion_run(struct statem_packed_machine *fsm, struct event *event, uint16_t state_origin)
+{
+    struct event completion = { STATEM_EVENT_COMPLETION, event->data };
+    uint16_t visited[STATEM_COMPLETION_HOPS_MAX + 1];
+    size_t hops = 0, i;
+    int ret;
+
+    visited[0] = fsm->state_current;
+
+    while ((ret = transition_run(fsm, STATEM_PACKED_COMPLETION, &completion)) != STATEM_STATE_NOCHANGE)
+    {
+        if (ret == STATEM_ERR_STATE_RECHED || ret == STATEM_FINAL_STATE_RECHED)
+        {
+            return ret;
+        }
+
+        if (ret == STATEM_STATE_LOOPSELF || ++hops > STATEM_COMPLETION_HOPS_MAX)
+        {
+            go_to_state_error(fsm, &completion);
+            return STATEM_ERR_STATE_RECHED;
+        }
+
+        for (i = 0; i < hops; ++i)
+        {
+            if (visited[i] == fsm->state_current)
+            {
+                go_to_state_error(fsm, &completion);
+                return STATEM_ERR_STATE_RECHED;
+            }
+        }
+        visited[hops] = fsm->state_current;
+    }
+
+    return (fsm->state_current == state_origin) ? STATEM_STATE_LOOPSELF : STATEM_STATE_CHANGED;
+}
+#endif
+
+// 进入错误状态
+static void go_to_state_error(struct statem_packed_machine *fsm, struct event *const event)
+{
+    const struct statem_packed *graph = fsm->graph;
+
+    fsm->state_previous = fsm->state_current;
+    fsm->state_current = graph->state_error;
+
+    if (fsm->state_current != STATEM_PACKED_NONE
+        && graph->states[fsm->state_current].action_entry != STATEM_PACKED_NONE)
+    {
+        graph->state_actions[graph->states[fsm->state_current].action_entry](graph->data[fsm->state_current], event);
+    }
+}
+
+// 在状态的转换中查找第一个满足条件的转换
+static const struct statem_packed_transition *get_transition(const struct statem_packed *graph,
+                                                             uint16_t state, uint16_t event_type,
+                                                             struct event *const event)
+{
+    const struct statem_packed_state *ps = &graph->states[state];
+    size_t i;
+
+    for (i = ps->transition_first; i < (size_t)ps->transition_first + ps->transition_nums; ++i)
+    {
+        const struct statem_packed_transition *t = &graph->transitions[i];
+
+        if (t->event_type == event_type)
+        {
+            if (t->guard == STATEM_PACKED_NONE
+                || graph->guards[t->guard](graph->conditions[i], event))
+            {
+                return t;
+            }
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1,163 @@
+/**
+ * \addtogroup state_machine
+ * @{
+ *
+ * \file
+ * \brief Compact 16-bit index representation of a state graph
+ *
+ * The pointer based graph costs five words per transition and eight words
+ * per state on 64-bit targets. statem_packed_build() converts such a graph
+ * into two contiguous arrays: 12-byte states and 8-byte transitions that refer
+ * to states, guards and actions by 16-bit index. Guard conditions and state
+ * data are kept in separate arrays that are only touched when a callback
+ * runs, so the arrays walked during dispatch stay dense in the cache.
+ *
+ * statem_packed_handle_event() has exactly the semantics and return values of
+ * statem_handle_event().
+ *
+ * Limitations: at most 65534 states and transitions, event types must be
+ * in the range 0..65534 or be #STATEM_EVENT_COMPLETION, and neither \ref
+ * transition::event_span "ranged" or #STATEM_EVENT_ANY transitions nor \ref
+ * state::deferred_types "deferred events" are supported.
+ */
+
+#ifndef __STATE_MACHINE_PACKED_H
+#define __STATE_MACHINE_PACKED_H
+
+#include <stdint.h>
+#include "state_machine.h"
+
+// 空索引
+#define STATEM_PACKED_NONE      0xFFFFu
+
+// #STATEM_EVENT_COMPLETION在紧凑形式中的事件类型
+#define STATEM_PACKED_COMPLETION    0xFFFFu
+
+// 状态标志
+#define STATEM_PACKED_FINAL         0x01u   // 没有转换也没有父状态
+#define STATEM_PACKED_COMPLETION_CHAIN  0x02u   // 自身或父状态有无事件转换
+
+/**
+ * \brief Packed transition
+ */
+struct statem_packed_transition
+{
+    uint16_t event_type;
+
+    // 在guard表中的索引
+    uint16_t guard;
+
+    // 在action表中的索引
+    uint16_t action;
+
+    // 下一个状态的索引，已沿state_entry向下解析到最终进入的状态
+    uint16_t state_next;
+};
+
+/**
+ * \brief Packed state
+ */
+struct statem_packed_state
+{
+    uint16_t state_parent;
+
+    // 第一个转换在转换数组中的索引
+    uint16_t transition_first;
+
+    uint16_t transition_nums;
+
+    // 在状态回调表中的索引
+    uint16_t action_entry;
+    uint16_t action_exti;
+
+    // STATEM_PACKED_FINAL等标志
+    uint16_t flags;
+};
+
+/**
+ * \brief Packed state graph
+ *
+ * Created by statem_packed_build() and released by statem_packed_free().
+ * State indices are equal to the \ref state::id "ids" assigned to the
+ * original states.
+ */
+struct statem_packed
+{
+    struct statem_packed_state *states;
+    struct statem_packed_transition *transitions;
+
+    // 转换的guard参数，与transitions一一对应
+    void **conditions;
+
+    // 状态的data，与states一一对应
+    void **data;
+
+    // 回调函数表
+    bool (**guards)(void *condition, struct event *event);
+    void (**actions)(void *state_current_data, struct event *event, void *state_new_data);
+    void (**state_actions)(void *state_data, struct event *event);
+
+    uint16_t state_nums;
+    uint16_t transition_nums;
+    uint16_t state_init;
+    uint16_t state_error;
+};
+
+/**
+ * \brief State machine running on a packed graph
+ *
+ * There is no need to manipulate the members directly.
+ */
+struct statem_packed_machine
+{
+    const struct statem_packed *graph;
+    uint16_t state_current;
+    uint16_t state_previous;
+};
+
+/**
+ * \brief Convert a pointer based graph into its packed form
+ *
+ * The states are numbered with statem_graph_build() as a side effect.
+ *
+ * \param packed the packed graph to create.
+ * \param state_init the initial state.
+ * \param state_error the error state, may be NULL.
+ *
+ * \retval 0 on success.
+ * \retval -1 on invalid arguments, when the graph exceeds the 16-bit limits
+ * or uses ranged, wildcard or deferred events, or when memory could not be
+ * allocated.
+ */
+int statem_packed_build(struct statem_packed *packed, struct state *state_init,
+                        struct state *state_error);
+
+/**
+ * \brief Release the memory of a packed graph
+ */
+void statem_packed_free(struct statem_packed *packed);
+
+/**
+ * \brief Initialise a state machine on a packed graph
+ *
+ * The machine starts in the graph's initial state, just like statem_init().
+ *
+ * \retval 0 on success.
+ * \retval -1 on invalid arguments.
+ */
+int statem_packed_init(struct statem_packed_machine *state_machine,
+                       const struct statem_packed *packed);
+
+/**
+ * \brief Pass an event to a packed state machine
+ *
+ * \return #statem_handle_event_return_vals
+ */
+int statem_packed_handle_event(struct statem_packed_machine *state_machine,
+                               struct event *event);
+
+#endif // __STATE_MACHINE_PACKED_H
+
+/**
+ * @}
+ */
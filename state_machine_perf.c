@@ -0,0 +1,479 @@
+#define _GNU_SOURCE
+#include <linux/perf_event.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "state_machine_perf.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PERF_RDPMC              1
+#else
+#define PERF_RDPMC              0
+#endif
+
+// 计数器的perf_event类型和配置
+static const struct
+{
+    uint32_t type;
+    uint64_t config;
+} counter_attrs[STATEM_PERF_COUNTER_MAX] =
+{
+    [STATEM_PERF_CYCLES]        = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    [STATEM_PERF_INSTRUCTIONS]  = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    [STATEM_PERF_BRANCH_MISSES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    [STATEM_PERF_L1D_MISSES]    = { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                                                        (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                                        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    [STATEM_PERF_LLC_MISSES]    = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    [STATEM_PERF_TASK_CLOCK]    = { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+};
+
+int statem_perf_init(struct statem_perf *perf, unsigned int mask, size_t slots)
+{
+    size_t size = 1;
+
+    if (!perf || !(mask & STATEM_PERF_MASK_ALL) || !slots)
+    {
+        return -1;
+    }
+
+    while (size < slots)
+    {
+        size <<= 1;
+    }
+
+    perf->mask = mask & STATEM_PERF_MASK_ALL;
+    perf->slots = size;
+    perf->threads = NULL;
+    STATEM_LOCK_INIT(&perf->lock);
+
+    return 0;
+}
+
+void statem_perf_deinit(struct statem_perf *perf)
+{
+    struct statem_perf_thread *thread, *next;
+
+    if (!perf || !perf->slots)
+    {
+        return;
+    }
+
+    for (thread = perf->threads; thread; thread = next)
+    {
+        next = thread->next;
+        statem_perf_thread_close(thread);
+        STATEM_FREE(thread->rows);
+        STATEM_FREE(thread->used);
+        STATEM_FREE(thread);
+    }
+
+    STATEM_LOCK_DEINIT(&perf->lock);
+    perf->threads = NULL;
+    perf->slots = 0;
+}
+
+static int counter_open(enum statem_perf_counter counter, int group_fd)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = counter_attrs[counter].type;
+    attr.config = counter_attrs[counter].config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+struct statem_perf_thread *statem_perf_thread_open(struct statem_perf *perf)
+{
+    struct statem_perf_thread *thread;
+    unsigned int i;
+
+    if (!perf || !perf->slots)
+    {
+        return NULL;
+    }
+
+    thread = STATEM_MALLOC(sizeof(*thread));
+    if (!thread)
+    {
+        return NULL;
+    }
+
+    memset(thread, 0, sizeof(*thread));
+    thread->slots = perf->slots;
+    thread->rows = STATEM_MALLOC(thread->slots * sizeof(*thread->rows));
+    thread->used = STATEM_MALLOC(thread->slots * sizeof(*thread->used));
+    if (!thread->rows || !thread->used)
+    {
+        goto fail;
+    }
+    memset(thread->used, 0, thread->slots * sizeof(*thread->used));
+
+    // 第一个打开的计数器作为组长，整组一次读取
+    for (i = 0; i < STATEM_PERF_COUNTER_MAX; ++i)
+    {
+        int fd;
+
+        if (!(perf->mask & STATEM_PERF_MASK(i)))
+        {
+            continue;
+        }
+
+        fd = counter_open((enum statem_perf_counter)i, thread->fd_nums ? thread->fds[0] : -1);
+        if (fd < 0)
+        {
+            continue;
+        }
+
+        thread->pages[thread->fd_nums] = NULL;
+#if PERF_RDPMC
+        if (counter_attrs[i].type != PERF_TYPE_SOFTWARE)
+        {
+            void *page = mmap(NULL, (size_t)sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, fd, 0);
+
+            thread->pages[thread->fd_nums] = (page == MAP_FAILED) ? NULL : page;
+        }
+#endif
+        thread->fds[thread->fd_nums] = fd;
+        thread->counters[thread->fd_nums] = (enum statem_perf_counter)i;
+        thread->fd_nums++;
+        thread->mask |= STATEM_PERF_MASK(i);
+    }
+
+    if (!thread->fd_nums)
+    {
+        goto fail;
+    }
+
+    STATEM_LOCK(&perf->lock);
+    thread->next = perf->threads;
+    perf->threads = thread;
+    STATEM_UNLOCK(&perf->lock);
+
+    return thread;
+
+fail:
+    STATEM_FREE(thread->rows);
+    STATEM_FREE(thread->used);
+    STATEM_FREE(thread);
+
+    return NULL;
+}
+
+void statem_perf_thread_close(struct statem_perf_thread *thread)
+{
+    size_t i;
+
+    if (!thread)
+    {
+        return;
+    }
+
+    // 先关闭成员，最后关闭组长
+    for (i = thread->fd_nums; i-- > 0;)
+    {
+        if (thread->pages[i])
+        {
+            munmap(thread->pages[i], (size_t)sysconf(_SC_PAGESIZE));
+        }
+        close(thread->fds[i]);
+    }
+
+    thread->fd_nums = 0;
+}
+
+#if PERF_RDPMC
+static inline uint64_t rdpmc(uint32_t counter)
+{
+    uint32_t low, high;
+
+    __asm__ volatile("rdpmc" : "=a" (low), "=d" (high) : "c" (counter));
+
+    return ((uint64_t)high << 32) | low;
+}
+
+/**
+ * @brief 在用户态读取一个计数器
+ *
+ * 按内核文档的方式读取映射页，计数器未在本CPU上运行或者内核不允许时失败
+ *
+ * @param page      计数器的映射页
+ * @param value     计数值
+ * @return bool     true：成功   false：需要系统调用读取
+ */
+static bool counter_rdpmc(const volatile struct perf_event_mmap_page *page, uint64_t *value)
+{
+    uint32_t seq, index;
+    uint64_t count;
+
+    do
+    {
+        seq = page->lock;
+        __atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+        index = page->index;
+        if (!page->cap_user_rdpmc || !index)
+        {
+            return false;
+        }
+
+        count = (uint64_t)page->offset;
+        count += (uint64_t)((int64_t)(rdpmc(index - 1) << (64 - page->pmc_width)) >> (64 - page->pmc_width));
+
+        __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    } while (page->lock != seq);
+
+    *value = count;
+
+    return true;
+}
+#endif
+
+// 读取所有计数器，values的下标与fds相同
+static void counters_read(struct statem_perf_thread *thread, uint64_t *values)
+{
+    uint64_t buffer[1 + STATEM_PERF_COUNTER_MAX];
+    size_t i;
+
+#if PERF_RDPMC
+    for (i = 0; i < thread->fd_nums; ++i)
+    {
+        if (!thread->pages[i] || !counter_rdpmc(thread->pages[i], &values[i]))
+        {
+            break;
+        }
+    }
+
+    if (i == thread->fd_nums)
+    {
+        return;
+    }
+#endif
+
+    // 格式为计数器个数加上各计数值，顺序与打开顺序相同
+    if (read(thread->fds[0], buffer, sizeof(buffer)) < (ssize_t)sizeof(uint64_t))
+    {
+        memset(values, 0, thread->fd_nums * sizeof(*values));
+        return;
+    }
+
+    for (i = 0; i < thread->fd_nums; ++i)
+    {
+        values[i] = (i < buffer[0]) ? buffer[1 + i] : 0;
+    }
+}
+
+static size_t row_hash(uint32_t state_id, int event_type, uint32_t target_id)
+{
+    uint64_t key = ((uint64_t)state_id << 32) ^ ((uint64_t)target_id << 16) ^ (uint32_t)event_type;
+
+    return (size_t)((key * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+// 查找或者插入一行，表满时返回NULL
+static struct statem_perf_row *row_get(struct statem_perf_thread *thread, uint32_t state_id,
+                                       int event_type, uint32_t target_id)
+{
+    size_t mask = thread->slots - 1;
+    size_t index = row_hash(state_id, event_type, target_id) & mask;
+    size_t probes;
+
+    for (probes = 0; probes < thread->slots; ++probes, index = (index + 1) & mask)
+    {
+        struct statem_perf_row *row = &thread->rows[index];
+
+        if (!thread->used[index])
+        {
+            memset(row, 0, sizeof(*row));
+            row->state_id = state_id;
+            row->event_type = event_type;
+            row->target_id = target_id;
+
+            // 报告线程看到标记时键值已经写好
+            STATEM_ATOMIC_STORE(&thread->used[index], true);
+
+            return row;
+        }
+
+        if (row->state_id == state_id && row->event_type == event_type && row->target_id == target_id)
+        {
+            return row;
+        }
+    }
+
+    return NULL;
+}
+
+static uint32_t perf_state_id(const struct state *state)
+{
+    return state ? state->id : STATEM_PERF_STATE_NONE;
+}
+
+int statem_perf_handle_event(struct statem_perf_thread *thread, struct state_machine *fsm,
+                             struct event *event)
+{
+    uint64_t before[STATEM_PERF_COUNTER_MAX], after[STATEM_PERF_COUNTER_MAX];
+    struct statem_perf_row *row;
+    uint32_t source;
+    size_t i;
+    int ret;
+
+    if (!thread || !thread->fd_nums || !fsm || !event)
+    {
+        return statem_handle_event(fsm, event);
+    }
+
+    source = perf_state_id(fsm->state_current);
+
+    counters_read(thread, before);
+    ret = statem_handle_event(fsm, event);
+    counters_read(thread, after);
+
+    row = row_get(thread, source, event->type, perf_state_id(fsm->state_current));
+    if (!row)
+    {
+        thread->dropped++;
+        return ret;
+    }
+
+    row->events++;
+    for (i = 0; i < thread->fd_nums; ++i)
+    {
+        row->counts[thread->counters[i]] += after[i] - before[i];
+    }
+
+    return ret;
+}
+
+static int row_compare_key(const void *a, const void *b)
+{
+    const struct statem_perf_row *x = a, *y = b;
+
+    if (x->state_id != y->state_id)
+    {
+        return x->state_id < y->state_id ? -1 : 1;
+    }
+
+    if (x->event_type != y->event_type)
+    {
+        return x->event_type < y->event_type ? -1 : 1;
+    }
+
+    if (x->target_id != y->target_id)
+    {
+        return x->target_id < y->target_id ? -1 : 1;
+    }
+
+    return 0;
+}
+
+static int row_compare_count(const void *a, const void *b, void *arg)
+{
+    const struct statem_perf_row *x = a, *y = b;
+    enum statem_perf_counter sort = *(const enum statem_perf_counter *)arg;
+    uint64_t cx = x->counts[sort], cy = y->counts[sort];
+
+    if (cx != cy)
+    {
+        return cx > cy ? -1 : 1;
+    }
+
+    return row_compare_key(a, b);
+}
+
+/**
+ * @brief 汇总所有线程的计数并按计数器降序报告
+ *
+ * 先复制所有线程的行，按键值排序后合并相同的行，再按计数器排序
+ *
+ * @param perf      性能计数
+ * @param group     汇总方式
+ * @param sort      排序的计数器
+ * @param report    报告回调函数
+ * @param ctx       回调函数的参数
+ * @return int      行数，-1：失败
+ */
+int statem_perf_report(struct statem_perf *perf, enum statem_perf_group group, enum statem_perf_counter sort,
+                       void (*report)(void *ctx, const struct statem_perf_row *row), void *ctx)
+{
+    struct statem_perf_thread *thread;
+    struct statem_perf_row *rows;
+    size_t nums = 0, merged = 0, i, j;
+
+    if (!perf || !perf->slots || (unsigned int)sort >= STATEM_PERF_COUNTER_MAX || !report)
+    {
+        return -1;
+    }
+
+    STATEM_LOCK(&perf->lock);
+
+    for (thread = perf->threads; thread; thread = thread->next)
+    {
+        nums += thread->slots;
+    }
+
+    rows = STATEM_MALLOC((nums ? nums : 1) * sizeof(*rows));
+    if (!rows)
+    {
+        STATEM_UNLOCK(&perf->lock);
+        return -1;
+    }
+
+    nums = 0;
+    for (thread = perf->threads; thread; thread = thread->next)
+    {
+        for (i = 0; i < thread->slots; ++i)
+        {
+            if (!STATEM_ATOMIC_LOAD(&thread->used[i]))
+            {
+                continue;
+            }
+
+            rows[nums] = thread->rows[i];
+            if (group == STATEM_PERF_BY_STATE)
+            {
+                rows[nums].event_type = 0;
+                rows[nums].target_id = STATEM_PERF_STATE_NONE;
+            }
+            nums++;
+        }
+    }
+
+    qsort(rows, nums, sizeof(*rows), &row_compare_key);
+
+    for (i = 0; i < nums; ++i)
+    {
+        if (merged && !row_compare_key(&rows[merged - 1], &rows[i]))
+        {
+            rows[merged - 1].events += rows[i].events;
+            for (j = 0; j < STATEM_PERF_COUNTER_MAX; ++j)
+            {
+                rows[merged - 1].counts[j] += rows[i].counts[j];
+            }
+        }
+        else
+        {
+            rows[merged++] = rows[i];
+        }
+    }
+
+    STATEM_UNLOCK(&perf->lock);
+
+    qsort_r(rows, merged, sizeof(*rows), &row_compare_count, &sort);
+
+    for (i = 0; i < merged; ++i)
+    {
+        report(ctx, &rows[i]);
+    }
+
+    STATEM_FREE(rows);
+
+    return (int)merged;
+}
@@ -0,0 +1,218 @@
+/**
+ * \addtogroup state_machine
+ * @{
+ *
+ * \file
+ * \brief Hardware performance counters around dispatch
+ *
+ * Wall-clock time tells how long statem_handle_event() takes, not why. A
+ * profiler opens Linux perf_event counters (cycles, instructions, branch
+ * misses, L1 data and last-level cache misses, task clock) for each
+ * dispatching thread, reads them before and after every event passed to
+ * statem_perf_handle_event() and adds the difference to the row of the
+ * transition taken, identified by the source state, the event type and the
+ * resulting state.
+ *
+ * Each thread accumulates into its own table, so profiling takes no lock and
+ * shares no cache line. On x86 hardware counters are read in user space with
+ * rdpmc when the kernel allows it; if any opened counter cannot be read that
+ * way, e.g. the software task clock, the whole counter group is read with a
+ * single read() call instead.
+ *
+ * statem_perf_report() merges the tables of all threads and passes the rows,
+ * per transition or per state, to a callback in decreasing order of the
+ * chosen counter, e.g. to find which states miss the cache most or which
+ * guard chains mispredict.
+ *
+ * ~~~{.c}
+ * statem_perf_init(&perf, STATEM_PERF_MASK_HW, 1024);
+ *
+ * // each dispatching thread
+ * struct statem_perf_thread *thread = statem_perf_thread_open(&perf);
+ * statem_perf_handle_event(thread, &m, &event);
+ *
+ * statem_perf_report(&perf, STATEM_PERF_BY_STATE, STATEM_PERF_LLC_MISSES, &print_row, NULL);
+ * ~~~
+ *
+ * \note Only available on Linux. Counters the kernel or the hardware does
+ * not provide are left out, see \ref statem_perf_thread::mask "mask". The
+ * machines must belong to a graph numbered by statem_graph_build().
+ */
+
+#ifndef __STATE_MACHINE_PERF_H
+#define __STATE_MACHINE_PERF_H
+
+#include <stdint.h>
+#include "state_machine.h"
+#include "state_machine_port.h"
+
+// 没有当前状态，或者按状态汇总时的目标状态
+#define STATEM_PERF_STATE_NONE      UINT32_MAX
+
+/**
+ * \brief Counters
+ */
+enum statem_perf_counter
+{
+    STATEM_PERF_CYCLES,
+    STATEM_PERF_INSTRUCTIONS,
+    STATEM_PERF_BRANCH_MISSES,
+    STATEM_PERF_L1D_MISSES,
+    STATEM_PERF_LLC_MISSES,
+    /** \brief Software counter in ns, available without a hardware PMU */
+    STATEM_PERF_TASK_CLOCK,
+    STATEM_PERF_COUNTER_MAX,
+};
+
+#define STATEM_PERF_MASK(counter)   (1u << (counter))
+#define STATEM_PERF_MASK_ALL        ((1u << STATEM_PERF_COUNTER_MAX) - 1)
+
+// 硬件计数器，全部可用rdpmc读取时不需要系统调用
+#define STATEM_PERF_MASK_HW         (STATEM_PERF_MASK_ALL & ~STATEM_PERF_MASK(STATEM_PERF_TASK_CLOCK))
+
+/**
+ * \brief Grouping of report rows
+ */
+enum statem_perf_group
+{
+    /** \brief One row per source state, event type and resulting state */
+    STATEM_PERF_BY_TRANSITION,
+    /** \brief One row per source state */
+    STATEM_PERF_BY_STATE,
+};
+
+/**
+ * \brief Accumulated counts
+ */
+struct statem_perf_row
+{
+    // 源状态编号
+    uint32_t state_id;
+
+    // 处理事件后的状态编号，按状态汇总时为STATEM_PERF_STATE_NONE
+    uint32_t target_id;
+
+    // 事件类型，按状态汇总时为0
+    int event_type;
+
+    // 分发的事件数
+    uint64_t events;
+
+    // 各计数器的累计值，未打开的计数器为0
+    uint64_t counts[STATEM_PERF_COUNTER_MAX];
+};
+
+/**
+ * \brief Per-thread counters and table
+ *
+ * Returned by statem_perf_thread_open(), used only by the thread that opened
+ * it.
+ */
+struct statem_perf_thread
+{
+    struct statem_perf_thread *next;
+
+    // 成功打开的计数器
+    unsigned int mask;
+
+    // 计数器文件描述符，fds[0]为组长
+    int fds[STATEM_PERF_COUNTER_MAX];
+    size_t fd_nums;
+
+    // 每个文件描述符对应的计数器
+    enum statem_perf_counter counters[STATEM_PERF_COUNTER_MAX];
+
+    // 计数器的用户态映射页，用于rdpmc
+    void *pages[STATEM_PERF_COUNTER_MAX];
+
+    // 开放寻址哈希表
+    struct statem_perf_row *rows;
+    bool *used;
+    size_t slots;
+
+    // 哈希表满而未记录的事件数
+    uint64_t dropped;
+};
+
+/**
+ * \brief Profiler
+ *
+ * There is no need to manipulate the members directly.
+ */
+struct statem_perf
+{
+    // 请求的计数器
+    unsigned int mask;
+
+    // 每个线程哈希表的大小，2的幂
+    size_t slots;
+
+    struct statem_perf_thread *threads;
+    statem_lock_t lock;
+};
+
+/**
+ * \brief Initialise a profiler
+ *
+ * \param perf the profiler to initialise.
+ * \param mask the counters to open, see #STATEM_PERF_MASK.
+ * \param slots number of distinct rows each thread can record, rounded up to
+ * a power of two.
+ *
+ * \retval 0 on success.
+ * \retval -1 on invalid arguments.
+ */
+int statem_perf_init(struct statem_perf *perf, unsigned int mask, size_t slots);
+
+/**
+ * \brief Release a profiler and the tables of all threads
+ */
+void statem_perf_deinit(struct statem_perf *perf);
+
+/**
+ * \brief Open the counters of the calling thread
+ *
+ * The counters count the calling thread only, in user mode.
+ *
+ * \return the thread's table, or NULL if no counter could be opened or
+ * memory could not be allocated.
+ */
+struct statem_perf_thread *statem_perf_thread_open(struct statem_perf *perf);
+
+/**
+ * \brief Close the counters of a thread, its counts stay in the reports
+ */
+void statem_perf_thread_close(struct statem_perf_thread *thread);
+
+/**
+ * \brief Pass an event to a machine and count the dispatch
+ *
+ * \param thread the table of the calling thread.
+ *
+ * \return #statem_handle_event_return_vals
+ */
+int statem_perf_handle_event(struct statem_perf_thread *thread, struct state_machine *fsm,
+                             struct event *event);
+
+/**
+ * \brief Report the accumulated counts
+ *
+ * Rows are passed in decreasing order of \pn{sort}. Counts of threads still
+ * dispatching may be a few events behind.
+ *
+ * \param group how rows are merged.
+ * \param sort the counter to sort by.
+ * \param report called for every row.
+ * \param ctx argument passed to \pn{report}.
+ *
+ * \return the number of rows, or -1 on invalid arguments or if memory could
+ * not be allocated.
+ */
+int statem_perf_report(struct statem_perf *perf, enum statem_perf_group group, enum statem_perf_counter sort,
+                       void (*report)(void *ctx, const struct statem_perf_row *row), void *ctx);
+
+#endif // __STATE_MACHINE_PERF_H
+
+/**
+ * @}
+ */
@@ -0,0 +1,173 @@
+#include "state_machine_pool.h"
+
+/**
+ * @brief 初始化状态机池
+ *
+ * @param pool          状态机池
+ * @param state_init    初始状态
+ * @param state_error   错误状态
+ * @param slab_nums     每块的状态机个数
+ * @return int          0：成功   -1：失败
+ */
+int statem_pool_init(struct statem_pool *pool, struct state *state_init, struct state *state_error,
+                     size_t slab_nums)
+{
+    if (!pool || !state_init || !slab_nums)
+    {
+        return -1;
+    }
+
+    pool->state_init = state_init;
+    pool->state_error = state_error;
+    pool->slab_nums = slab_nums;
+    pool->slabs = NULL;
+    pool->free_list = NULL;
+    pool->total = 0;
+    pool->used = 0;
+    STATEM_LOCK_INIT(&pool->lock);
+
+    return 0;
+}
+
+void statem_pool_deinit(struct statem_pool *pool)
+{
+    struct statem_pool_slab *slab, *next;
+
+    if (!pool || !pool->state_init)
+    {
+        return;
+    }
+
+    for (slab = pool->slabs; slab; slab = next)
+    {
+        next = slab->next;
+        STATEM_FREE(slab);
+    }
+
+    STATEM_LOCK_DEINIT(&pool->lock);
+    pool->slabs = NULL;
+    pool->free_list = NULL;
+    pool->state_init = NULL;
+}
+
+// 分配新的一块并加入空闲链表，调用者持有锁
+static int pool_grow(struct statem_pool *pool)
+{
+    struct statem_pool_slab *slab;
+    size_t i;
+
+    slab = STATEM_MALLOC(sizeof(*slab) + pool->slab_nums * sizeof(slab->nodes[0]));
+    if (!slab)
+    {
+        return -1;
+    }
+
+    for (i = 0; i < pool->slab_nums; ++i)
+    {
+        slab->nodes[i].next = (i + 1 < pool->slab_nums) ? &slab->nodes[i + 1] : pool->free_list;
+    }
+
+    pool->free_list = &slab->nodes[0];
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+    pool->total += pool->slab_nums;
+
+    return 0;
+}
+
+struct state_machine *statem_pool_get(struct statem_pool *pool)
+{
+    union statem_pool_node *node;
+
+    if (!pool || !pool->state_init)
+    {
+        return NULL;
+    }
+
+    STATEM_LOCK(&pool->lock);
+
+    if (!pool->free_list && pool_grow(pool))
+    {
+        STATEM_UNLOCK(&pool->lock);
+        return NULL;
+    }
+
+    node = pool->free_list;
+    pool->free_list = node->next;
+    pool->used++;
+
+    STATEM_UNLOCK(&pool->lock);
+
+    statem_init(&node->fsm, pool->state_init, pool->state_error);
+
+    return &node->fsm;
+}
+
+void statem_pool_put(struct statem_pool *pool, struct state_machine *fsm)
+{
+    union statem_pool_node *node = (union statem_pool_node *)fsm;
+
+    if (!pool || !fsm)
+    {
+        return;
+    }
+
+    STATEM_LOCK(&pool->lock);
+
+    node->next = pool->free_list;
+    pool->free_list = node;
+    pool->used--;
+
+    STATEM_UNLOCK(&pool->lock);
+}
+
+void statem_pool_usage(struct statem_pool *pool, size_t *used, size_t *total)
+{
+    if (!pool)
+    {
+        return;
+    }
+
+    STATEM_LOCK(&pool->lock);
+
+    if (used)
+    {
+        *used = pool->used;
+    }
+
+    if (total)
+    {
+        *total = pool->total;
+    }
+
+    STATEM_UNLOCK(&pool->lock);
+}
+
+// 注册表收到新编号的第一个事件时从池中取出状态机
+static struct state_machine *pool_create(void *ctx, uint64_t id)
+{
+    (void)id;
+
+    return statem_pool_get(ctx);
+}
+
+// 状态机结束后放回池中
+static void pool_destroy(void *ctx, uint64_t id, struct state_machine *fsm)
+{
+    (void)id;
+
+    statem_pool_put(ctx, fsm);
+}
+
+int statem_pool_attach(struct statem_pool *pool, struct statem_registry *registry, bool reclaim_stopped)
+{
+    if (!pool || !registry)
+    {
+        return -1;
+    }
+
+    statem_registry_hooks_set(registry, &pool_create, &pool_destroy, pool);
+    statem_registry_reclaim_set(registry, reclaim_stopped);
+
+    return 0;
+}
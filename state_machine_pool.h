@@ -0,0 +1,138 @@
+/**
+ * \addtogroup state_machine
+ * @{
+ *
+ * \file
+ * \brief Slab pool of state machines materialised on first event
+ *
+ * Most sessions never leave their initial state, yet allocating and
+ * initialising a \ref state_machine for each one makes memory grow with the
+ * total number of sessions. A pool hands out machines carved from slabs
+ * allocated on demand and takes them back on a free list for reuse.
+ *
+ * statem_pool_attach() installs the pool as the create and destroy hooks of
+ * a \ref statem_registry. A session then exists only as an id until its
+ * first event reaches statem_registry_dispatch(), which takes a machine from
+ * the pool and initialises it in the pool's initial state. When the machine
+ * finishes it is removed from the registry and returned to the pool, so the
+ * memory in use follows the number of active sessions.
+ *
+ * ~~~{.c}
+ * statem_pool_init(&pool, &state_idle, &state_error, 256);
+ * statem_registry_init(&registry, 4096);
+ * statem_pool_attach(&pool, &registry, false);
+ *
+ * statem_registry_dispatch(&registry, session_id, &event);
+ * ~~~
+ *
+ * \note Slabs are only released by statem_pool_deinit().
+ */
+
+#ifndef __STATE_MACHINE_POOL_H
+#define __STATE_MACHINE_POOL_H
+
+#include "state_machine.h"
+#include "state_machine_port.h"
+#include "state_machine_registry.h"
+
+/**
+ * \brief Pool slot, a machine while in use and a free list link otherwise
+ */
+union statem_pool_node
+{
+    struct state_machine fsm;
+    union statem_pool_node *next;
+};
+
+/**
+ * \brief Block of machines allocated at once
+ */
+struct statem_pool_slab
+{
+    struct statem_pool_slab *next;
+    union statem_pool_node nodes[];
+};
+
+/**
+ * \brief Machine pool
+ *
+ * There is no need to manipulate the members directly.
+ */
+struct statem_pool
+{
+    struct state *state_init;
+    struct state *state_error;
+
+    // 每块的状态机个数
+    size_t slab_nums;
+
+    struct statem_pool_slab *slabs;
+    union statem_pool_node *free_list;
+
+    // 已分配的状态机总数和正在使用的个数
+    size_t total;
+    size_t used;
+
+    statem_lock_t lock;
+};
+
+/**
+ * \brief Initialise a pool
+ *
+ * No memory is allocated until the first machine is taken.
+ *
+ * \param pool the pool to initialise.
+ * \param state_init the initial state of the machines.
+ * \param state_error the error state of the machines, may be NULL.
+ * \param slab_nums number of machines allocated at once.
+ *
+ * \retval 0 on success.
+ * \retval -1 on invalid arguments.
+ */
+int statem_pool_init(struct statem_pool *pool, struct state *state_init, struct state *state_error,
+                     size_t slab_nums);
+
+/**
+ * \brief Release every slab of a pool
+ *
+ * All machines taken from the pool become invalid.
+ */
+void statem_pool_deinit(struct statem_pool *pool);
+
+/**
+ * \brief Take a machine and initialise it with statem_init()
+ *
+ * \retval the machine.
+ * \retval NULL if memory could not be allocated.
+ */
+struct state_machine *statem_pool_get(struct statem_pool *pool);
+
+/**
+ * \brief Return a machine taken with statem_pool_get()
+ */
+void statem_pool_put(struct statem_pool *pool, struct state_machine *fsm);
+
+/**
+ * \brief Get the number of machines in use and allocated
+ */
+void statem_pool_usage(struct statem_pool *pool, size_t *used, size_t *total);
+
+/**
+ * \brief Materialise the machines of a registry from the pool
+ *
+ * Sets the registry's create and destroy hooks, see
+ * statem_registry_hooks_set(), and its reclaim policy, see
+ * statem_registry_reclaim_set().
+ *
+ * \param reclaim_stopped also return machines that have stopped.
+ *
+ * \retval 0 on success.
+ * \retval -1 on invalid arguments.
+ */
+int statem_pool_attach(struct statem_pool *pool, struct statem_registry *registry, bool reclaim_stopped);
+
+#endif // __STATE_MACHINE_POOL_H
+
+/**
+ * @}
+ */
@@ -0,0 +1,107 @@
+/**
+ * \addtogroup state_machine
+ * @{
+ *
+ * \file
+ * \brief Platform glue used by the optional state machine modules
+ *
+ * The core state machine does not depend on any operating system. The
+ * optional modules (recording, replay, ...) need a clock, a delay, memory
+ * allocation and a mutex, and the atomic operations of
+ * state_machine_atomic.h, which this header includes. On RT-Thread the kernel
+ * services are used, elsewhere POSIX. Every macro may be overridden by
+ * defining it before this header is included, for instance to use a cycle
+ * counter as #STATEM_CLOCK_GET.
+ */
+
+#ifndef __STATE_MACHINE_PORT_H
+#define __STATE_MACHINE_PORT_H
+
+#include <stdint.h>
+#include "state_machine_atomic.h"
+
+#ifdef __RTTHREAD__
+#include <rtthread.h>
+
+// 系统节拍，单位：tick
+#ifndef STATEM_TICK_GET
+#define STATEM_TICK_GET()       ((uint32_t)rt_tick_get())
+#endif
+
+// 高精度时钟，用于测量耗时，默认使用系统节拍
+#ifndef STATEM_CLOCK_GET
+#define STATEM_CLOCK_GET()      ((uint64_t)rt_tick_get())
+#endif
+
+#ifndef STATEM_DELAY
+#define STATEM_DELAY(tick)      rt_thread_delay((rt_tick_t)(tick))
+#endif
+
+#ifndef STATEM_MALLOC
+#define STATEM_MALLOC(size)     rt_malloc(size)
+#define STATEM_FREE(ptr)        rt_free(ptr)
+#endif
+
+#ifndef STATEM_LOCK
+typedef struct rt_mutex statem_lock_t;
+#define STATEM_LOCK_INIT(lock)      rt_mutex_init(lock, "statem", RT_IPC_FLAG_PRIO)
+#define STATEM_LOCK_DEINIT(lock)    rt_mutex_detach(lock)
+#define STATEM_LOCK(lock)           rt_mutex_take(lock, RT_WAITING_FOREVER)
+#define STATEM_UNLOCK(lock)         rt_mutex_release(lock)
+#endif
+
+#else /* POSIX */
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+static inline uint64_t statem_port_clock_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static inline void statem_port_delay_ms(uint32_t ms)
+{
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000L };
+
+    nanosleep(&ts, NULL);
+}
+
+// 系统节拍，单位：ms
+#ifndef STATEM_TICK_GET
+#define STATEM_TICK_GET()       ((uint32_t)(statem_port_clock_ns() / 1000000u))
+#endif
+
+// 高精度时钟，单位：ns
+#ifndef STATEM_CLOCK_GET
+#define STATEM_CLOCK_GET()      statem_port_clock_ns()
+#endif
+
+#ifndef STATEM_DELAY
+#define STATEM_DELAY(tick)      statem_port_delay_ms(tick)
+#endif
+
+#ifndef STATEM_MALLOC
+#define STATEM_MALLOC(size)     malloc(size)
+#define STATEM_FREE(ptr)        free(ptr)
+#endif
+
+#ifndef STATEM_LOCK
+typedef pthread_mutex_t statem_lock_t;
+#define STATEM_LOCK_INIT(lock)      pthread_mutex_init(lock, NULL)
+#define STATEM_LOCK_DEINIT(lock)    pthread_mutex_destroy(lock)
+#define STATEM_LOCK(lock)           pthread_mutex_lock(lock)
+#define STATEM_UNLOCK(lock)         pthread_mutex_unlock(lock)
+#endif
+
+#endif /* __RTTHREAD__ */
+
+#endif // __STATE_MACHINE_PORT_H
+
+/**
+ * @}
+ */
@@ -0,0 +1,364 @@
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "state_machine_reactor.h"
+#include "state_machine_port.h"
+
+// 加入就绪链表末尾
+static void ready_push(struct statem_reactor *reactor, struct statem_reactor_source *source)
+{
+    source->ready = true;
+    source->ready_next = NULL;
+
+    if (reactor->ready_tail)
+    {
+        reactor->ready_tail->ready_next = source;
+    }
+    else
+    {
+        reactor->ready_head = source;
+    }
+    reactor->ready_tail = source;
+}
+
+// 取出就绪链表的第一个源
+static struct statem_reactor_source *ready_pop(struct statem_reactor *reactor)
+{
+    struct statem_reactor_source *source = reactor->ready_head;
+
+    if (source)
+    {
+        reactor->ready_head = source->ready_next;
+        if (!reactor->ready_head)
+        {
+            reactor->ready_tail = NULL;
+        }
+        source->ready = false;
+        source->ready_next = NULL;
+    }
+
+    return source;
+}
+
+// 从就绪链表中删除
+static void ready_unlink(struct statem_reactor *reactor, struct statem_reactor_source *source)
+{
+    struct statem_reactor_source **link;
+    struct statem_reactor_source *prev = NULL;
+
+    for (link = &reactor->ready_head; *link; prev = *link, link = &(*link)->ready_next)
+    {
+        if (*link == source)
+        {
+            *link = source->ready_next;
+            if (reactor->ready_tail == source)
+            {
+                reactor->ready_tail = prev;
+            }
+            break;
+        }
+    }
+
+    source->ready = false;
+    source->ready_next = NULL;
+}
+
+/**
+ * @brief 初始化反应器
+ *
+ * @param reactor   反应器
+ * @param event_max 每次epoll_wait()获取的就绪通知数
+ * @param budget    每个源每轮最多分发的事件数，0表示不限制
+ * @return int      0：成功   -1：失败
+ */
+int statem_reactor_init(struct statem_reactor *reactor, size_t event_max, unsigned int budget)
+{
+    struct epoll_event ev;
+
+    if (!reactor || !event_max)
+    {
+        return -1;
+    }
+
+    memset(reactor, 0, sizeof(*reactor));
+    reactor->event_max = event_max;
+    reactor->budget = budget;
+
+    reactor->events = STATEM_MALLOC(event_max * sizeof(*reactor->events));
+    if (!reactor->events)
+    {
+        return -1;
+    }
+
+    reactor->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    reactor->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (reactor->epoll_fd < 0 || reactor->wake_fd < 0)
+    {
+        goto fail;
+    }
+
+    // 唤醒描述符的data为NULL，与源区分
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->wake_fd, &ev))
+    {
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+    if (reactor->epoll_fd >= 0)
+    {
+        close(reactor->epoll_fd);
+    }
+    if (reactor->wake_fd >= 0)
+    {
+        close(reactor->wake_fd);
+    }
+    STATEM_FREE(reactor->events);
+    reactor->events = NULL;
+
+    return -1;
+}
+
+void statem_reactor_deinit(struct statem_reactor *reactor)
+{
+    if (!reactor || !reactor->events)
+    {
+        return;
+    }
+
+    close(reactor->wake_fd);
+    close(reactor->epoll_fd);
+    STATEM_FREE(reactor->events);
+    reactor->events = NULL;
+}
+
+int statem_reactor_add(struct statem_reactor *reactor, struct statem_reactor_source *source, int fd,
+                       struct state_machine *fsm, statem_decode_t decode, void *ctx)
+{
+    struct epoll_event ev;
+
+    if (!reactor || !reactor->events || !source || fd < 0 || !fsm || !decode)
+    {
+        return -1;
+    }
+
+    source->fd = fd;
+    source->fsm = fsm;
+    source->decode = decode;
+    source->ctx = ctx;
+    source->ready = false;
+    source->ready_next = NULL;
+
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = source;
+
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, fd, &ev))
+    {
+        source->fd = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+int statem_reactor_remove(struct statem_reactor *reactor, struct statem_reactor_source *source)
+{
+    if (!reactor || !reactor->events || !source || source->fd < 0)
+    {
+        return -1;
+    }
+
+    epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, source->fd, NULL);
+
+    if (source->ready)
+    {
+        ready_unlink(reactor, source);
+    }
+
+    source->fd = -1;
+
+    if (source == reactor->dispatching)
+    {
+        reactor->dispatching_removed = true;
+    }
+
+    return 0;
+}
+
+// 移除源并通知用户
+static void source_drop(struct statem_reactor *reactor, struct statem_reactor_source *source)
+{
+    statem_reactor_remove(reactor, source);
+
+    if (source->close)
+    {
+        source->close(source);
+    }
+}
+
+/**
+ * @brief 分发一个源的事件
+ *
+ * 边沿触发要求读到没有数据为止，超出预算时放回就绪链表，下一轮继续。
+ * 解码函数和回调中可能移除并释放该源，每次调用后先检查反应器中的标记，
+ * 已移除则不再访问该源
+ *
+ * @param reactor   反应器
+ * @param source    源
+ * @return int      分发的事件数
+ */
+static int source_dispatch(struct statem_reactor *reactor, struct statem_reactor_source *source)
+{
+    unsigned int nums = 0;
+    bool more = true;
+
+    reactor->dispatching = source;
+    reactor->dispatching_removed = false;
+
+    while (!reactor->budget || nums < reactor->budget)
+    {
+        struct event event;
+        int ret = source->decode(source, &event);
+
+        if (reactor->dispatching_removed || ret == STATEM_DECODE_AGAIN)
+        {
+            more = false;
+            break;
+        }
+
+        if (ret != STATEM_DECODE_EVENT)
+        {
+            source_drop(reactor, source);
+            more = false;
+            break;
+        }
+
+        nums++;
+        ret = statem_handle_event(source->fsm, &event);
+
+        // 回调中移除了该源
+        if (reactor->dispatching_removed)
+        {
+            more = false;
+            break;
+        }
+
+        if (ret == STATEM_FINAL_STATE_RECHED)
+        {
+            source_drop(reactor, source);
+            more = false;
+            break;
+        }
+    }
+
+    reactor->dispatching = NULL;
+
+    if (more)
+    {
+        ready_push(reactor, source);
+    }
+
+    return (int)nums;
+}
+
+/**
+ * @brief 等待一次就绪的描述符并分发事件
+ *
+ * @param reactor   反应器
+ * @param timeout   最长等待时间，单位：ms，-1表示一直等待
+ * @return int      分发的事件数，-1：失败
+ */
+int statem_reactor_run_once(struct statem_reactor *reactor, int timeout)
+{
+    struct statem_reactor_source *source;
+    int i, n, dispatched = 0;
+    size_t nums = 0;
+
+    if (!reactor || !reactor->events)
+    {
+        return -1;
+    }
+
+    // 还有未读完的源时不等待
+    n = epoll_wait(reactor->epoll_fd, reactor->events, (int)reactor->event_max,
+                   reactor->ready_head ? 0 : timeout);
+    if (n < 0)
+    {
+        return (errno == EINTR) ? 0 : -1;
+    }
+
+    for (i = 0; i < n; ++i)
+    {
+        source = reactor->events[i].data.ptr;
+
+        // 清除唤醒计数，读取失败说明计数已经为0
+        if (!source)
+        {
+            uint64_t value;
+            ssize_t ret = read(reactor->wake_fd, &value, sizeof(value));
+
+            (void)ret;
+            continue;
+        }
+
+        if (!source->ready && source->fd >= 0)
+        {
+            ready_push(reactor, source);
+        }
+    }
+
+    // 本轮只处理当前在链表中的源，超出预算放回的源留到下一轮
+    for (source = reactor->ready_head; source; source = source->ready_next)
+    {
+        nums++;
+    }
+
+    while (nums-- && (source = ready_pop(reactor)))
+    {
+        dispatched += source_dispatch(reactor, source);
+    }
+
+    return dispatched;
+}
+
+int statem_reactor_run(struct statem_reactor *reactor)
+{
+    if (!reactor || !reactor->events)
+    {
+        return -1;
+    }
+
+    while (!STATEM_ATOMIC_LOAD(&reactor->stopped))
+    {
+        if (statem_reactor_run_once(reactor, -1) < 0)
+        {
+            return -1;
+        }
+    }
+
+    STATEM_ATOMIC_STORE(&reactor->stopped, false);
+
+    return 0;
+}
+
+void statem_reactor_stop(struct statem_reactor *reactor)
+{
+    uint64_t value = 1;
+    ssize_t ret;
+
+    if (!reactor || !reactor->events)
+    {
+        return;
+    }
+
+    STATEM_ATOMIC_STORE(&reactor->stopped, true);
+
+    // 计数溢出时写入失败，此时描述符一定可读，无需处理
+    ret = write(reactor->wake_fd, &value, sizeof(value));
+    (void)ret;
+}
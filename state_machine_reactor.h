@@ -0,0 +1,206 @@
+/**
+ * \addtogroup state_machine
+ * @{
+ *
+ * \file
+ * \brief epoll reactor driving state machines from file descriptors
+ *
+ * A source binds a file descriptor, such as a socket, a pipe or a timerfd,
+ * to a state machine and a decoder. The decoder reads from the descriptor
+ * into its own buffer and fills in a \ref event; the reactor passes the
+ * event straight to statem_handle_event() on the same thread, so there is
+ * no reader thread, no queue and no copy between reading and dispatching.
+ *
+ * Descriptors are registered edge-triggered. After a wakeup the reactor
+ * calls the decoder of a ready source repeatedly until it reports that the
+ * descriptor is drained, so a single epoll_wait() may dispatch many events.
+ * To stay fair, at most \ref statem_reactor::budget "budget" events are
+ * taken from one source per turn; a source with data left is kept on a
+ * ready list and continued on the next turn without waiting for epoll.
+ *
+ * ~~~{.c}
+ * static int decode(struct statem_reactor_source *source, struct event *event)
+ * {
+ *     struct conn *conn = source->ctx;
+ *     ssize_t n = read(source->fd, conn->buf, sizeof(conn->buf));
+ *
+ *     if (n < 0 && errno == EAGAIN)
+ *         return STATEM_DECODE_AGAIN;
+ *     if (n <= 0)
+ *         return STATEM_DECODE_CLOSED;
+ *
+ *     event->type = EVENT_KEYBOARD;
+ *     event->data = (void *)(intptr_t)conn->buf[0];
+ *     return STATEM_DECODE_EVENT;
+ * }
+ *
+ * statem_reactor_init(&reactor, 64, 16);
+ * statem_reactor_add(&reactor, &conn.source, fd, &conn.fsm, &decode, &conn);
+ * statem_reactor_run(&reactor);
+ * ~~~
+ *
+ * \note Only available on Linux. Descriptors must be non-blocking.
+ */
+
+#ifndef __STATE_MACHINE_REACTOR_H
+#define __STATE_MACHINE_REACTOR_H
+
+#include <sys/epoll.h>
+#include "state_machine.h"
+
+/**
+ * \brief Decoder return values
+ */
+enum statem_decode_return_vals
+{
+    /** \brief The descriptor has no more data, wait for the next edge */
+    STATEM_DECODE_AGAIN = 0,
+    /** \brief An event was decoded */
+    STATEM_DECODE_EVENT = 1,
+    /** \brief The descriptor was closed by the peer or failed */
+    STATEM_DECODE_CLOSED = -1,
+};
+
+struct statem_reactor_source;
+
+/**
+ * \brief Decode the next event from a source
+ *
+ * The event, including the memory its data points to, only has to stay
+ * valid until the decoder is called again.
+ *
+ * \return #statem_decode_return_vals
+ */
+typedef int (*statem_decode_t)(struct statem_reactor_source *source, struct event *event);
+
+/**
+ * \brief File descriptor bound to a state machine
+ *
+ * Allocated by the user, typically embedded in a connection object. Set
+ * \ref close before adding it if the user needs to know when the reactor
+ * drops it.
+ */
+struct statem_reactor_source
+{
+    int fd;
+    struct state_machine *fsm;
+    statem_decode_t decode;
+
+    // 解码器的参数
+    void *ctx;
+
+    // 源因对端关闭或状态机到达终止状态被移除后调用，可以为NULL
+    void (*close)(struct statem_reactor_source *source);
+
+    // 就绪链表，用户无需设置
+    struct statem_reactor_source *ready_next;
+    bool ready;
+};
+
+/**
+ * \brief Reactor
+ *
+ * There is no need to manipulate the members directly.
+ */
+struct statem_reactor
+{
+    int epoll_fd;
+
+    // 用于从其他线程唤醒statem_reactor_run()
+    int wake_fd;
+
+    struct epoll_event *events;
+    size_t event_max;
+
+    // 每个源每轮最多分发的事件数
+    unsigned int budget;
+
+    // 还有数据未读完的源
+    struct statem_reactor_source *ready_head;
+    struct statem_reactor_source *ready_tail;
+
+    // 正在分发的源，及其是否已在回调中被移除。移除后源可能已被释放，不能再访问
+    struct statem_reactor_source *dispatching;
+    bool dispatching_removed;
+
+    bool stopped;
+};
+
+/**
+ * \brief Initialise a reactor
+ *
+ * \param reactor the reactor to initialise.
+ * \param event_max number of readiness notifications fetched per epoll_wait().
+ * \param budget events dispatched from one source per turn, 0 for no limit.
+ *
+ * \retval 0 on success.
+ * \retval -1 on invalid arguments or on failure.
+ */
+int statem_reactor_init(struct statem_reactor *reactor, size_t event_max, unsigned int budget);
+
+/**
+ * \brief Release a reactor
+ *
+ * The descriptors of the sources are not closed.
+ */
+void statem_reactor_deinit(struct statem_reactor *reactor);
+
+/**
+ * \brief Bind a descriptor to a machine
+ *
+ * \param source the source, it must stay valid until it is removed. It may
+ * be freed right after statem_reactor_remove(), even from a callback of its
+ * own machine or from its decoder, or in its close hook.
+ * \param fd a non-blocking descriptor.
+ * \param fsm the machine the decoded events are passed to.
+ * \param decode the decoder.
+ * \param ctx argument stored in \ref statem_reactor_source::ctx "ctx".
+ *
+ * \retval 0 on success.
+ * \retval -1 on invalid arguments or if epoll refused the descriptor.
+ */
+int statem_reactor_add(struct statem_reactor *reactor, struct statem_reactor_source *source, int fd,
+                       struct state_machine *fsm, statem_decode_t decode, void *ctx);
+
+/**
+ * \brief Unbind a source
+ *
+ * May be called from a state machine callback or a decoder. The close hook
+ * is not called and the descriptor is not closed.
+ *
+ * \retval 0 on success.
+ * \retval -1 on invalid arguments.
+ */
+int statem_reactor_remove(struct statem_reactor *reactor, struct statem_reactor_source *source);
+
+/**
+ * \brief Wait for ready descriptors once and dispatch their events
+ *
+ * A source is removed and its close hook called when its decoder returns
+ * #STATEM_DECODE_CLOSED or its machine returns #STATEM_FINAL_STATE_RECHED.
+ *
+ * \param timeout maximum time to wait in milliseconds, -1 to wait forever.
+ * Ignored while sources are on the ready list.
+ *
+ * \return the number of events dispatched, or -1 if epoll_wait() failed.
+ */
+int statem_reactor_run_once(struct statem_reactor *reactor, int timeout);
+
+/**
+ * \brief Dispatch events until statem_reactor_stop() is called
+ *
+ * \retval 0 when stopped.
+ * \retval -1 if epoll_wait() failed.
+ */
+int statem_reactor_run(struct statem_reactor *reactor);
+
+/**
+ * \brief Make statem_reactor_run() return, may be called from any thread
+ */
+void statem_reactor_stop(struct statem_reactor *reactor);
+
+#endif // __STATE_MACHINE_REACTOR_H
+
+/**
+ * @}
+ */
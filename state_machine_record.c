@@ -0,0 +1,298 @@
+#include <string.h>
+#include "state_machine_record.h"
+#include "state_machine_port.h"
+
+// 负载按4字节对齐，保证下一条记录对齐
+#define RECORD_ALIGN(len)       (((len) + 3u) & ~(size_t)3u)
+
+// 单条记录最大占用空间
+#define RECORD_SIZE_MAX         (sizeof(struct statem_record_entry) + RECORD_ALIGN(STATEM_RECORD_PAYLOAD_MAX))
+
+static size_t encode_pointer(void *ctx, const struct event *event, void *buf, size_t size);
+
+/**
+ * @brief 初始化事件记录器
+ *
+ * @param rec       记录器
+ * @param buffer    记录缓冲区
+ * @param size      缓冲区大小
+ * @param write     写出函数
+ * @param ctx       回调函数参数
+ * @return int      0：成功   -1：失败
+ */
+int statem_record_init(struct statem_recorder *rec, void *buffer, size_t size,
+                       int (*write)(void *ctx, const void *buf, size_t len), void *ctx)
+{
+    struct statem_record_header header = {
+        STATEM_RECORD_MAGIC, STATEM_RECORD_VERSION, 0,
+    };
+
+    if (!rec || !buffer || !write || size < sizeof(header) + RECORD_SIZE_MAX)
+    {
+        return -1;
+    }
+
+    rec->buffer = buffer;
+    rec->size = size;
+    rec->write = write;
+    rec->encode = &encode_pointer;
+    rec->ctx = ctx;
+    rec->lost = 0;
+    rec->pending = 0;
+
+    memcpy(rec->buffer, &header, sizeof(header));
+    rec->used = sizeof(header);
+
+    return 0;
+}
+
+void statem_record_encoder_set(struct statem_recorder *rec,
+                               size_t (*encode)(void *ctx, const struct event *event,
+                                                void *buf, size_t size))
+{
+    if (!rec)
+    {
+        return;
+    }
+
+    rec->encode = encode ? encode : &encode_pointer;
+}
+
+/**
+ * @brief 记录事件并交给状态机处理
+ *
+ * 记录直接在缓冲区中构造：先预留记录头，负载由编码函数直接写入缓冲区，
+ * 处理完事件后再补齐结果状态，不产生额外的拷贝
+ *
+ * @param rec           记录器
+ * @param machine_id    状态机编号
+ * @param fsm           状态机
+ * @param event         事件
+ * @return int          statem_handle_event()的返回值
+ */
+int statem_record_handle_event(struct statem_recorder *rec, uint32_t machine_id,
+                               struct state_machine *fsm, struct event *event)
+{
+    struct statem_record_entry entry;
+    uint8_t *record;
+    size_t payload_len;
+    int ret;
+
+    if (!rec || !event)
+    {
+        return statem_handle_event(fsm, event);
+    }
+
+    entry.timestamp = STATEM_TICK_GET();
+
+    // 剩余空间不足一条最大记录，先写出
+    if (rec->size - rec->used < RECORD_SIZE_MAX)
+    {
+        statem_record_flush(rec);
+    }
+
+    record = rec->buffer + rec->used;
+
+    payload_len = rec->encode(rec->ctx, event, record + sizeof(entry), STATEM_RECORD_PAYLOAD_MAX);
+    if (payload_len > STATEM_RECORD_PAYLOAD_MAX)
+    {
+        payload_len = STATEM_RECORD_PAYLOAD_MAX;
+    }
+
+    ret = statem_handle_event(fsm, event);
+
+    entry.machine_id = machine_id;
+    entry.event_type = event->type;
+    entry.state_id = (fsm && fsm->state_current) ? (uint32_t)fsm->state_current->id
+                                                 : STATEM_RECORD_STATE_NONE;
+    entry.result = (int8_t)ret;
+    entry.payload_len = (uint8_t)payload_len;
+    entry.reserved = 0;
+    memcpy(record, &entry, sizeof(entry));
+
+    // 填充字节清零，避免把缓冲区中的旧数据写入日志
+    memset(record + sizeof(entry) + payload_len, 0, RECORD_ALIGN(payload_len) - payload_len);
+
+    rec->used += sizeof(entry) + RECORD_ALIGN(payload_len);
+    rec->pending++;
+
+    return ret;
+}
+
+// 写出缓冲区中的所有记录，写出失败则丢弃并计数
+int statem_record_flush(struct statem_recorder *rec)
+{
+    int ret = 0;
+
+    if (!rec)
+    {
+        return -1;
+    }
+
+    if (rec->used && rec->write(rec->ctx, rec->buffer, rec->used))
+    {
+        rec->lost += rec->pending;
+        ret = -1;
+    }
+
+    rec->used = 0;
+    rec->pending = 0;
+
+    return ret;
+}
+
+// 默认负载编码：记录event->data指针本身的值
+static size_t encode_pointer(void *ctx, const struct event *event, void *buf, size_t size)
+{
+    (void)ctx;
+
+    if (!event->data || size < sizeof(event->data))
+    {
+        return 0;
+    }
+
+    memcpy(buf, &event->data, sizeof(event->data));
+
+    return sizeof(event->data);
+}
+
+// 默认负载解码：还原指针值
+static void *decode_pointer(const void *payload, size_t len)
+{
+    void *data = NULL;
+
+    if (len == sizeof(data))
+    {
+        memcpy(&data, payload, sizeof(data));
+    }
+
+    return data;
+}
+
+/**
+ * @brief 重放事件日志
+ *
+ * @param replay    重放配置
+ * @param log       日志
+ * @param len       日志长度
+ * @param stats     重放统计
+ * @return int      0：成功   -1：失败
+ */
+int statem_replay_run(const struct statem_replay *replay, const void *log, size_t len,
+                      struct statem_replay_stats *stats)
+{
+    const uint8_t *pos = log;
+    const uint8_t *end = pos + len;
+    struct statem_record_header header;
+    uint32_t tick_first = 0, tick_start = 0;
+    uint64_t clock_start;
+
+    if (!replay || !replay->machine_get || !log || !stats)
+    {
+        return -1;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    stats->divergence_first = UINT32_MAX;
+    stats->latency_min = UINT64_MAX;
+
+    if (len < sizeof(header))
+    {
+        return -1;
+    }
+
+    memcpy(&header, pos, sizeof(header));
+    if (header.magic != STATEM_RECORD_MAGIC || header.version != STATEM_RECORD_VERSION)
+    {
+        return -1;
+    }
+    pos += sizeof(header);
+
+    clock_start = STATEM_CLOCK_GET();
+
+    while (pos < end)
+    {
+        struct statem_record_entry entry;
+        struct state_machine *fsm;
+        struct event event;
+        uint64_t clock_event, latency;
+        uint32_t state_id;
+        int ret;
+
+        // 记录被截断，日志损坏
+        if ((size_t)(end - pos) < sizeof(entry))
+        {
+            break;
+        }
+        memcpy(&entry, pos, sizeof(entry));
+        pos += sizeof(entry);
+
+        if ((size_t)(end - pos) < RECORD_ALIGN(entry.payload_len))
+        {
+            break;
+        }
+
+        fsm = replay->machine_get(replay->ctx, entry.machine_id);
+        if (!fsm)
+        {
+            break;
+        }
+
+        event.type = entry.event_type;
+        event.data = replay->decode ? replay->decode(replay->ctx, entry.event_type, pos, entry.payload_len)
+                                    : decode_pointer(pos, entry.payload_len);
+        pos += RECORD_ALIGN(entry.payload_len);
+
+        // 按原始时间间隔重放
+        if (replay->mode == STATEM_REPLAY_TIMED)
+        {
+            if (!stats->events)
+            {
+                tick_first = entry.timestamp;
+                tick_start = STATEM_TICK_GET();
+            }
+            else
+            {
+                int32_t wait = (int32_t)((entry.timestamp - tick_first) - (STATEM_TICK_GET() - tick_start));
+
+                if (wait > 0)
+                {
+                    STATEM_DELAY((uint32_t)wait);
+                }
+            }
+        }
+
+        clock_event = STATEM_CLOCK_GET();
+        ret = statem_handle_event(fsm, &event);
+        latency = STATEM_CLOCK_GET() - clock_event;
+
+        state_id = fsm->state_current ? (uint32_t)fsm->state_current->id : STATEM_RECORD_STATE_NONE;
+        if (ret != entry.result || state_id != entry.state_id)
+        {
+            if (!stats->divergences)
+            {
+                stats->divergence_first = stats->events;
+            }
+            stats->divergences++;
+        }
+
+        if (latency < stats->latency_min)
+        {
+            stats->latency_min = latency;
+        }
+        if (latency > stats->latency_max)
+        {
+            stats->latency_max = latency;
+        }
+        stats->latency_total += latency;
+        stats->events++;
+    }
+
+    stats->elapsed = STATEM_CLOCK_GET() - clock_start;
+    if (!stats->events)
+    {
+        stats->latency_min = 0;
+    }
+
+    return pos == end ? 0 : -1;
+}
@@ -0,0 +1,235 @@
+/**
+ * \addtogroup state_machine
+ * @{
+ *
+ * \file
+ * \brief Event log capture and deterministic replay
+ *
+ * A recorder appends every event handed to statem_record_handle_event() to a
+ * compact binary log: machine id, event type, timestamp, payload and the
+ * resulting state. Records are built in place in a user supplied buffer and
+ * handed to a write callback only when the buffer is full, so recording costs
+ * one memcpy-free encode per event.
+ *
+ * statem_replay_run() feeds a log back into fresh state machines, either with
+ * the original timing or as fast as possible, and reports throughput,
+ * per-event latency and any divergence from the recorded state sequence.
+ *
+ * Both sides identify states by their \ref state::id "id", so the graph must
+ * be numbered with statem_graph_build() before recording and before replaying.
+ */
+
+#ifndef __STATE_MACHINE_RECORD_H
+#define __STATE_MACHINE_RECORD_H
+
+#include <stdint.h>
+#include "state_machine.h"
+
+#define STATEM_RECORD_MAGIC         0x474C4D53u     // "SMLG"
+#define STATEM_RECORD_VERSION       2
+
+// 处理事件后当前状态为空
+#define STATEM_RECORD_STATE_NONE    0xFFFFFFFFu
+
+// 单条记录允许的最大负载长度
+#define STATEM_RECORD_PAYLOAD_MAX   0xFFu
+
+/**
+ * \brief Log header, written once at the start of a log
+ */
+struct statem_record_header
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+};
+
+/**
+ * \brief One log record
+ *
+ * The record is followed by #payload_len bytes of payload, padded with zero
+ * bytes to a multiple of four bytes so the next record stays aligned. Equal
+ * runs therefore produce byte-identical logs.
+ */
+struct statem_record_entry
+{
+    // 状态机编号，由用户定义
+    uint32_t machine_id;
+
+    // 事件类型
+    int32_t event_type;
+
+    // 事件到达时的系统节拍
+    uint32_t timestamp;
+
+    // 处理事件后的状态编号
+    uint32_t state_id;
+
+    // statem_handle_event()的返回值
+    int8_t result;
+
+    // 负载长度
+    uint8_t payload_len;
+
+    // 保留，写入0
+    uint16_t reserved;
+};
+
+/**
+ * \brief Event recorder
+ *
+ * There is no need to manipulate the members directly.
+ */
+struct statem_recorder
+{
+    // 记录缓冲区
+    uint8_t *buffer;
+
+    // 缓冲区大小
+    size_t size;
+
+    // 缓冲区已用长度
+    size_t used;
+
+    // 缓冲区满或者刷新时，将数据写出，成功返回0
+    int (*write)(void *ctx, const void *buf, size_t len);
+
+    // 将事件负载直接编码进日志，返回编码长度，默认记录 event->data 指针值
+    size_t (*encode)(void *ctx, const struct event *event, void *buf, size_t size);
+
+    // 回调函数的参数
+    void *ctx;
+
+    // 写出失败而丢失的记录数
+    uint32_t lost;
+
+    // 缓冲区中尚未写出的记录数
+    uint32_t pending;
+};
+
+/**
+ * \brief Initialise a recorder
+ *
+ * The log header is placed at the start of \pn{buffer}.
+ *
+ * \param recorder the recorder to initialise.
+ * \param buffer the record buffer.
+ * \param size size of \pn{buffer}, at least room for the header and one
+ * record with a full payload.
+ * \param write callback receiving full buffers.
+ * \param ctx argument passed to \pn{write} and to the encoder.
+ *
+ * \retval 0 on success.
+ * \retval -1 on invalid arguments.
+ */
+int statem_record_init(struct statem_recorder *recorder, void *buffer, size_t size,
+                       int (*write)(void *ctx, const void *buf, size_t len), void *ctx);
+
+/**
+ * \brief Set a payload encoder
+ *
+ * The encoder writes at most \pn{size} bytes describing \pn{event}'s payload
+ * directly into the log and returns the number of bytes written. Without an
+ * encoder the value of \ref event::data "data" itself is recorded, which is
+ * sufficient for payloads that carry an integer.
+ */
+void statem_record_encoder_set(struct statem_recorder *recorder,
+                               size_t (*encode)(void *ctx, const struct event *event,
+                                                void *buf, size_t size));
+
+/**
+ * \brief Record an event and pass it to the state machine
+ *
+ * Recording never changes how the event is handled. If the log cannot be
+ * written the record is counted in \ref statem_recorder::lost "lost".
+ *
+ * \param recorder the recorder.
+ * \param machine_id user defined id of \pn{state_machine}.
+ * \param state_machine the state machine to pass the event to.
+ * \param event the event to be handled.
+ *
+ * \return the return value of statem_handle_event().
+ */
+int statem_record_handle_event(struct statem_recorder *recorder, uint32_t machine_id,
+                               struct state_machine *state_machine, struct event *event);
+
+/**
+ * \brief Write all buffered records
+ *
+ * \retval 0 on success.
+ * \retval -1 if the write callback failed.
+ */
+int statem_record_flush(struct statem_recorder *recorder);
+
+/**
+ * \brief Replay speed
+ */
+enum statem_replay_mode
+{
+    /** \brief Feed events as fast as possible */
+    STATEM_REPLAY_FAST,
+    /** \brief Keep the recorded spacing between events */
+    STATEM_REPLAY_TIMED,
+};
+
+/**
+ * \brief Replay configuration
+ */
+struct statem_replay
+{
+    enum statem_replay_mode mode;
+
+    // 根据编号返回状态机，第一次引用某编号时应返回一个新初始化的状态机
+    struct state_machine *(*machine_get)(void *ctx, uint32_t machine_id);
+
+    // 由日志中的负载还原event->data，payload指向日志内部，为空时还原指针值
+    void *(*decode)(void *ctx, int event_type, const void *payload, size_t len);
+
+    // 回调函数的参数
+    void *ctx;
+};
+
+/**
+ * \brief Replay statistics
+ *
+ * Times are in #STATEM_CLOCK_GET units.
+ */
+struct statem_replay_stats
+{
+    // 重放的事件数
+    uint32_t events;
+
+    // 结果与日志不一致的事件数
+    uint32_t divergences;
+
+    // 第一次不一致的事件序号，没有不一致时为UINT32_MAX
+    uint32_t divergence_first;
+
+    // 重放总耗时
+    uint64_t elapsed;
+
+    // 单个事件处理耗时
+    uint64_t latency_min;
+    uint64_t latency_max;
+    uint64_t latency_total;
+};
+
+/**
+ * \brief Replay a recorded log
+ *
+ * \param replay the replay configuration.
+ * \param log the log, as produced by a recorder.
+ * \param len length of \pn{log}.
+ * \param stats filled with the replay statistics, also on failure.
+ *
+ * \retval 0 on success.
+ * \retval -1 on invalid arguments, a malformed log or an unknown machine id.
+ */
+int statem_replay_run(const struct statem_replay *replay, const void *log, size_t len,
+                      struct statem_replay_stats *stats);
+
+#endif // __STATE_MACHINE_RECORD_H
+
+/**
+ * @}
+ */
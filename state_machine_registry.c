@@ -0,0 +1,355 @@
+#include <string.h>
+#include "state_machine_registry.h"
+
+#define KEY_EMPTY               0
+
+// 存储的键值为编号加1，空槽为0
+#define KEY_OF(id)              ((id) + 1)
+
+// 64位整数散列（splitmix64）
+static size_t key_hash(uint64_t key)
+{
+    key ^= key >> 30;
+    key *= 0xBF58476D1CE4E5B9ull;
+    key ^= key >> 27;
+    key *= 0x94D049BB133111EBull;
+    key ^= key >> 31;
+
+    return (size_t)key;
+}
+
+/**
+ * @brief 初始化注册表
+ *
+ * @param reg       注册表
+ * @param capacity  槽位数，向上取整为2的幂
+ * @return int      0：成功   -1：失败
+ */
+int statem_registry_init(struct statem_registry *reg, size_t capacity)
+{
+    size_t size = 4;
+
+    if (!reg || !capacity)
+    {
+        return -1;
+    }
+
+    while (size < capacity)
+    {
+        size <<= 1;
+    }
+
+    reg->slots = STATEM_MALLOC(size * sizeof(*reg->slots));
+    if (!reg->slots)
+    {
+        return -1;
+    }
+    memset(reg->slots, 0, size * sizeof(*reg->slots));
+
+    reg->mask = size - 1;
+    reg->count = 0;
+    reg->version = 0;
+    reg->create = NULL;
+    reg->destroy = NULL;
+    reg->ctx = NULL;
+    reg->reclaim_stopped = false;
+    STATEM_LOCK_INIT(&reg->lock);
+
+    return 0;
+}
+
+void statem_registry_deinit(struct statem_registry *reg)
+{
+    if (!reg || !reg->slots)
+    {
+        return;
+    }
+
+    STATEM_LOCK_DEINIT(&reg->lock);
+    STATEM_FREE(reg->slots);
+    reg->slots = NULL;
+}
+
+void statem_registry_hooks_set(struct statem_registry *reg,
+                               struct state_machine *(*create)(void *ctx, uint64_t id),
+                               void (*destroy)(void *ctx, uint64_t id, struct state_machine *fsm),
+                               void *ctx)
+{
+    if (!reg)
+    {
+        return;
+    }
+
+    reg->create = create;
+    reg->destroy = destroy;
+    reg->ctx = ctx;
+}
+
+void statem_registry_reclaim_set(struct statem_registry *reg, bool stopped)
+{
+    if (!reg)
+    {
+        return;
+    }
+
+    reg->reclaim_stopped = stopped;
+}
+
+// 沿查找链查找一次，读取状态机指针后再次确认键值，防止槽位在读取期间被删除并复用
+static struct state_machine *slot_find(struct statem_registry *reg, uint64_t key)
+{
+    size_t i, n;
+
+    for (i = key_hash(key) & reg->mask, n = 0; n <= reg->mask; i = (i + 1) & reg->mask, ++n)
+    {
+        struct statem_registry_slot *slot = &reg->slots[i];
+        uint64_t slot_key = STATEM_ATOMIC_LOAD(&slot->key);
+
+        if (slot_key == KEY_EMPTY)
+        {
+            return NULL;
+        }
+
+        if (slot_key == key)
+        {
+            struct state_machine *fsm = STATEM_ATOMIC_LOAD(&slot->fsm);
+
+            if (STATEM_ATOMIC_LOAD(&slot->key) != key)
+            {
+                return NULL;
+            }
+
+            return fsm;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief 无锁查找
+ *
+ * 删除时会把后面的条目向前移动，移动期间的查找可能错过被移动的条目。
+ * 没有找到时检查版本号，读取期间发生过删除则重新查找。重试次数有上限，
+ * 单核抢占式系统上高优先级线程不会空等被抢占的删除线程
+ *
+ * @param reg   注册表
+ * @param id    状态机编号
+ * @return struct state_machine*
+ */
+struct state_machine *statem_registry_lookup(struct statem_registry *reg, uint64_t id)
+{
+    struct state_machine *fsm;
+    uint64_t key = KEY_OF(id);
+    size_t version;
+    unsigned int retries = 0;
+
+    if (!reg || !reg->slots || key == KEY_EMPTY)
+    {
+        return NULL;
+    }
+
+    do
+    {
+        version = STATEM_ATOMIC_LOAD(&reg->version);
+
+        fsm = slot_find(reg, key);
+    } while (!fsm && ((version & 1u) || STATEM_ATOMIC_LOAD(&reg->version) != version)
+             && retries++ < STATEM_REGISTRY_RETRY_MAX);
+
+    return fsm;
+}
+
+// 插入，调用者持有锁
+static int registry_insert_locked(struct statem_registry *reg, uint64_t key, struct state_machine *fsm)
+{
+    struct statem_registry_slot *slot;
+    size_t i;
+
+    if (reg->count + 1 > (reg->mask + 1) / 4 * 3)
+    {
+        return -1;
+    }
+
+    // 负载不超过3/4，查找链一定在空槽处结束
+    for (i = key_hash(key) & reg->mask; reg->slots[i].key != KEY_EMPTY; i = (i + 1) & reg->mask)
+    {
+        if (reg->slots[i].key == key)
+        {
+            return -1;
+        }
+    }
+
+    // 先写状态机再发布键值，读者看到键值时状态机一定有效
+    slot = &reg->slots[i];
+    STATEM_ATOMIC_STORE(&slot->fsm, fsm);
+    STATEM_ATOMIC_STORE(&slot->key, key);
+    STATEM_ATOMIC_STORE(&reg->count, reg->count + 1);
+
+    return 0;
+}
+
+int statem_registry_insert(struct statem_registry *reg, uint64_t id, struct state_machine *fsm)
+{
+    uint64_t key = KEY_OF(id);
+    int ret;
+
+    if (!reg || !reg->slots || !fsm || key == KEY_EMPTY)
+    {
+        return -1;
+    }
+
+    STATEM_LOCK(&reg->lock);
+    ret = registry_insert_locked(reg, key, fsm);
+    STATEM_UNLOCK(&reg->lock);
+
+    return ret;
+}
+
+// 清空槽位，先清键值，读者不会读到键值对应错误的状态机
+static void slot_clear(struct statem_registry_slot *slot)
+{
+    STATEM_ATOMIC_STORE(&slot->key, KEY_EMPTY);
+    STATEM_ATOMIC_STORE(&slot->fsm, NULL);
+}
+
+/**
+ * @brief 删除
+ *
+ * 不使用删除标记：删除后把查找链上后续的条目向前移入空出的槽位（backward shift），
+ * 直到遇到空槽或者条目已在其散列位置与空槽之间。槽位只被有效条目占用，
+ * 会话反复创建和结束也不会使查找链变长或者使表被填满
+ *
+ * @param reg   注册表
+ * @param id    状态机编号
+ * @return struct state_machine*
+ */
+struct state_machine *statem_registry_remove(struct statem_registry *reg, uint64_t id)
+{
+    struct state_machine *fsm = NULL;
+    uint64_t key = KEY_OF(id);
+    size_t i, j;
+
+    if (!reg || !reg->slots || key == KEY_EMPTY)
+    {
+        return NULL;
+    }
+
+    STATEM_LOCK(&reg->lock);
+
+    for (i = key_hash(key) & reg->mask; reg->slots[i].key != KEY_EMPTY; i = (i + 1) & reg->mask)
+    {
+        if (reg->slots[i].key == key)
+        {
+            fsm = reg->slots[i].fsm;
+            break;
+        }
+    }
+
+    if (fsm)
+    {
+        // 版本号为奇数期间查找链可能断开，没有找到的读者重新查找
+        STATEM_ATOMIC_STORE(&reg->version, reg->version + 1);
+        STATEM_ATOMIC_FENCE_RELEASE();
+
+        slot_clear(&reg->slots[i]);
+
+        for (j = (i + 1) & reg->mask; reg->slots[j].key != KEY_EMPTY; j = (j + 1) & reg->mask)
+        {
+            size_t home = key_hash(reg->slots[j].key) & reg->mask;
+
+            // 散列位置在(i, j]之间的条目不能移到i之前
+            if (((j - home) & reg->mask) < ((j - i) & reg->mask))
+            {
+                continue;
+            }
+
+            STATEM_ATOMIC_STORE(&reg->slots[i].fsm, reg->slots[j].fsm);
+            STATEM_ATOMIC_STORE(&reg->slots[i].key, reg->slots[j].key);
+            slot_clear(&reg->slots[j]);
+            i = j;
+        }
+
+        STATEM_ATOMIC_STORE(&reg->version, reg->version + 1);
+        STATEM_ATOMIC_STORE(&reg->count, reg->count - 1);
+    }
+
+    STATEM_UNLOCK(&reg->lock);
+
+    return fsm;
+}
+
+size_t statem_registry_count(struct statem_registry *reg)
+{
+    return reg ? STATEM_ATOMIC_LOAD(&reg->count) : 0;
+}
+
+// 状态机已经停止：没有当前状态，或者当前状态没有转换
+static bool machine_stopped(struct state_machine *fsm)
+{
+    return !statem_state_current(fsm) || statem_stopped(fsm) == 1;
+}
+
+/**
+ * @brief 按编号将事件分发给状态机
+ *
+ * @param reg       注册表
+ * @param id        状态机编号
+ * @param event     事件
+ * @return int
+ */
+int statem_registry_dispatch(struct statem_registry *reg, uint64_t id, struct event *event)
+{
+    struct state_machine *fsm;
+    int ret;
+
+    if (!reg || !event)
+    {
+        return STATEM_ERR_ARG;
+    }
+
+    if (KEY_OF(id) == KEY_EMPTY)
+    {
+        return STATEM_REGISTRY_NOT_FOUND;
+    }
+
+    fsm = statem_registry_lookup(reg, id);
+
+    // 第一次收到该编号的事件，创建状态机
+    if (!fsm && reg->create)
+    {
+        STATEM_LOCK(&reg->lock);
+
+        fsm = statem_registry_lookup(reg, id);
+        if (!fsm)
+        {
+            fsm = reg->create(reg->ctx, id);
+            if (fsm && registry_insert_locked(reg, KEY_OF(id), fsm))
+            {
+                if (reg->destroy)
+                {
+                    reg->destroy(reg->ctx, id, fsm);
+                }
+                fsm = NULL;
+            }
+        }
+
+        STATEM_UNLOCK(&reg->lock);
+    }
+
+    if (!fsm)
+    {
+        return STATEM_REGISTRY_NOT_FOUND;
+    }
+
+    ret = statem_handle_event(fsm, event);
+
+    // 到达终止状态，移除状态机
+    if ((ret == STATEM_FINAL_STATE_RECHED || (reg->reclaim_stopped && machine_stopped(fsm)))
+        && statem_registry_remove(reg, id) == fsm && reg->destroy)
+    {
+        reg->destroy(reg->ctx, id, fsm);
+    }
+
+    return ret;
+}
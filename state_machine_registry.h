@@ -0,0 +1,184 @@
+/**
+ * \addtogroup state_machine
+ * @{
+ *
+ * \file
+ * \brief Registry routing events to state machines by 64-bit id
+ *
+ * An open-addressing hash table with linear probing maps machine ids, such as
+ * session ids, to state machines. Lookups never take a lock, so the ingress
+ * path that routes every event stays lock free. Inserts and removals only
+ * happen when a session starts or ends and are serialised by a mutex.
+ *
+ * statem_registry_dispatch() looks up the machine for an event, creates it
+ * through a user hook on the first event of an unknown id and removes it
+ * through another hook once it returns #STATEM_FINAL_STATE_RECHED, or, if
+ * enabled with statem_registry_reclaim_set(), once statem_stopped() reports
+ * that it has stopped.
+ *
+ * The table does not grow. Size it for the expected number of live machines;
+ * at most three quarters of the slots are used. Removals leave no tombstones,
+ * the following entries of the probe chain are shifted back instead, so
+ * sessions that start and end all the time neither fill the table nor
+ * lengthen the chains. A lookup that races with such a shift and misses
+ * retries at most #STATEM_REGISTRY_RETRY_MAX times and then reports the id
+ * as not found, so it never waits for a remover that has been preempted;
+ * statem_registry_dispatch() confirms such a miss under the mutex before
+ * it creates a machine.
+ *
+ * \note All events of one id must be dispatched from one thread at a time,
+ * as with any state machine. The destroy hook runs while other threads may
+ * still be looking the machine up; defer freeing it if lookups can race with
+ * the final event.
+ */
+
+#ifndef __STATE_MACHINE_REGISTRY_H
+#define __STATE_MACHINE_REGISTRY_H
+
+#include <stdint.h>
+#include "state_machine.h"
+#include "state_machine_port.h"
+
+/**
+ * \brief Retries of a lookup that missed while a removal moved entries
+ */
+#ifndef STATEM_REGISTRY_RETRY_MAX
+#define STATEM_REGISTRY_RETRY_MAX   8
+#endif
+
+/**
+ * \brief Extra statem_registry_dispatch() return values
+ */
+enum statem_registry_return_vals
+{
+    /** \brief No machine for the id and it could not be created */
+    STATEM_REGISTRY_NOT_FOUND = -3,
+};
+
+/**
+ * \brief Hash table slot
+ */
+struct statem_registry_slot
+{
+    // 机器编号加1，0表示空。删除时后面的条目前移，没有删除标记
+    uint64_t key;
+    struct state_machine *fsm;
+};
+
+/**
+ * \brief Machine registry
+ *
+ * There is no need to manipulate the members directly.
+ */
+struct statem_registry
+{
+    struct statem_registry_slot *slots;
+    size_t mask;
+
+    // 有效条目数
+    size_t count;
+
+    // 删除时加2，移动条目期间为奇数，供无锁查找判断是否需要重新查找
+    size_t version;
+
+    statem_lock_t lock;
+
+    // 第一次收到某编号的事件时创建状态机，返回NULL表示不创建
+    struct state_machine *(*create)(void *ctx, uint64_t id);
+
+    // 状态机到达终止状态并从注册表移除后调用
+    void (*destroy)(void *ctx, uint64_t id, struct state_machine *fsm);
+
+    // 当前状态没有转换（statem_stopped()）时也移除状态机
+    bool reclaim_stopped;
+
+    // 回调函数的参数
+    void *ctx;
+};
+
+/**
+ * \brief Initialise a registry
+ *
+ * \param registry the registry to initialise.
+ * \param capacity number of slots, rounded up to a power of two.
+ *
+ * \retval 0 on success.
+ * \retval -1 on invalid arguments or if memory could not be allocated.
+ */
+int statem_registry_init(struct statem_registry *registry, size_t capacity);
+
+/**
+ * \brief Release the memory of a registry
+ *
+ * The registered machines are not destroyed.
+ */
+void statem_registry_deinit(struct statem_registry *registry);
+
+/**
+ * \brief Set the create and destroy hooks used by statem_registry_dispatch()
+ */
+void statem_registry_hooks_set(struct statem_registry *registry,
+                               struct state_machine *(*create)(void *ctx, uint64_t id),
+                               void (*destroy)(void *ctx, uint64_t id, struct state_machine *fsm),
+                               void *ctx);
+
+/**
+ * \brief Also remove machines that have stopped
+ *
+ * By default statem_registry_dispatch() only removes a machine that returns
+ * #STATEM_FINAL_STATE_RECHED. With \pn{stopped} set it also removes a machine
+ * whose current state has no transitions of its own (see statem_stopped())
+ * or that has no current state left. Only enable it if no state of the
+ * graph relies solely on the transitions of its parents.
+ */
+void statem_registry_reclaim_set(struct statem_registry *registry, bool stopped);
+
+/**
+ * \brief Find the machine registered for an id, without locking
+ *
+ * \retval the machine.
+ * \retval NULL if no machine is registered for \pn{id}, or, rarely, if
+ * removals kept moving entries during #STATEM_REGISTRY_RETRY_MAX retries.
+ */
+struct state_machine *statem_registry_lookup(struct statem_registry *registry, uint64_t id);
+
+/**
+ * \brief Register a machine
+ *
+ * \param id the machine id. UINT64_MAX is reserved.
+ *
+ * \retval 0 on success.
+ * \retval -1 on invalid arguments, if \pn{id} is already registered or if the
+ * table is full.
+ */
+int statem_registry_insert(struct statem_registry *registry, uint64_t id, struct state_machine *fsm);
+
+/**
+ * \brief Unregister a machine
+ *
+ * \retval the machine that was registered for \pn{id}.
+ * \retval NULL if there was none.
+ */
+struct state_machine *statem_registry_remove(struct statem_registry *registry, uint64_t id);
+
+/**
+ * \brief Get the number of registered machines
+ */
+size_t statem_registry_count(struct statem_registry *registry);
+
+/**
+ * \brief Route an event to the machine registered for an id
+ *
+ * Creates the machine with the create hook if none is registered, and
+ * removes it and calls the destroy hook once a final state is reached or,
+ * see statem_registry_reclaim_set(), once it has stopped.
+ *
+ * \return #statem_handle_event_return_vals or #STATEM_REGISTRY_NOT_FOUND
+ */
+int statem_registry_dispatch(struct statem_registry *registry, uint64_t id, struct event *event);
+
+#endif // __STATE_MACHINE_REGISTRY_H
+
+/**
+ * @}
+ */
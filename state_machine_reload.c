@@ -0,0 +1,342 @@
+#include <string.h>
+#include "state_machine_reload.h"
+#include "state_machine_port.h"
+
+// 工作线程处于空闲状态，不阻止回收
+#define EPOCH_OFFLINE           UINT64_MAX
+
+// 默认键值比较：data作为字符串比较
+static bool key_equal_data(void *ctx, const struct state *state_old, const struct state *state_new)
+{
+    (void)ctx;
+
+    if (!state_old->data || !state_new->data)
+    {
+        return state_old->data == state_new->data;
+    }
+
+    return !strcmp(state_old->data, state_new->data);
+}
+
+/**
+ * @brief 初始化热更新域
+ *
+ * @param reload        热更新域
+ * @param definition    第一个版本
+ * @param worker_nums   工作线程个数
+ * @return int          0：成功   -1：失败
+ */
+int statem_reload_init(struct statem_reload *reload, struct statem_definition *definition,
+                       size_t worker_nums)
+{
+    if (!reload || !definition || !definition->state_init || !definition->graph || !worker_nums)
+    {
+        return -1;
+    }
+
+    reload->worker_epochs = STATEM_MALLOC(worker_nums * sizeof(*reload->worker_epochs));
+    if (!reload->worker_epochs)
+    {
+        return -1;
+    }
+
+    // 初始认为所有工作线程都在运行，直到它们报告静止点
+    memset(reload->worker_epochs, 0, worker_nums * sizeof(*reload->worker_epochs));
+    reload->worker_nums = worker_nums;
+
+    definition->refs = 0;
+    definition->retired_next = NULL;
+
+    reload->current = definition;
+    reload->key_equal = &key_equal_data;
+    reload->fallback = STATEM_RELOAD_FALLBACK_INIT;
+    reload->fallback_get = NULL;
+    reload->ctx = NULL;
+    reload->epoch = 0;
+    reload->retired = NULL;
+
+    return 0;
+}
+
+void statem_reload_deinit(struct statem_reload *reload)
+{
+    if (!reload || !reload->worker_epochs)
+    {
+        return;
+    }
+
+    // 所有状态机都已解除绑定，旧版本可以直接回收
+    while (reload->retired)
+    {
+        struct statem_definition *definition = reload->retired;
+
+        reload->retired = definition->retired_next;
+        if (definition->release)
+        {
+            definition->release(definition);
+        }
+    }
+
+    STATEM_FREE(reload->worker_epochs);
+    reload->worker_epochs = NULL;
+}
+
+void statem_reload_key_set(struct statem_reload *reload,
+                           bool (*key_equal)(void *ctx, const struct state *state_old,
+                                             const struct state *state_new),
+                           void *ctx)
+{
+    if (!reload)
+    {
+        return;
+    }
+
+    reload->key_equal = key_equal ? key_equal : &key_equal_data;
+    reload->ctx = ctx;
+}
+
+void statem_reload_fallback_set(struct statem_reload *reload, enum statem_reload_fallback fallback,
+                                struct state *(*fallback_get)(void *ctx,
+                                                              const struct statem_definition *definition,
+                                                              const struct state *state_old))
+{
+    if (!reload)
+    {
+        return;
+    }
+
+    reload->fallback = fallback;
+    reload->fallback_get = fallback_get;
+}
+
+/**
+ * @brief 发布新版本
+ *
+ * 先替换当前版本再增加全局周期，工作线程看到新周期时一定能看到新版本
+ *
+ * @param reload        热更新域
+ * @param definition    新版本
+ * @return int          0：成功   -1：失败
+ */
+int statem_reload_publish(struct statem_reload *reload, struct statem_definition *definition)
+{
+    struct statem_definition *old;
+
+    if (!reload || !definition || !definition->state_init || !definition->graph)
+    {
+        return -1;
+    }
+
+    definition->refs = 0;
+    definition->retired_next = NULL;
+
+    old = reload->current;
+    STATEM_ATOMIC_STORE(&reload->current, definition);
+
+    old->retire_epoch = reload->epoch + 1;
+    old->retired_next = reload->retired;
+    reload->retired = old;
+
+    STATEM_ATOMIC_STORE(&reload->epoch, reload->epoch + 1);
+
+    return 0;
+}
+
+/**
+ * @brief 回收不再使用的旧版本
+ *
+ * 所有工作线程在旧版本被替换之后都经过了静止点，并且没有状态机绑定在旧版本上，才能回收
+ *
+ * @param reload    热更新域
+ * @return size_t   仍在等待回收的版本个数
+ */
+size_t statem_reload_reclaim(struct statem_reload *reload)
+{
+    struct statem_definition **link;
+    uint64_t epoch_min = EPOCH_OFFLINE;
+    size_t i, pending = 0;
+
+    if (!reload)
+    {
+        return 0;
+    }
+
+    for (i = 0; i < reload->worker_nums; ++i)
+    {
+        uint64_t epoch = STATEM_ATOMIC_LOAD(&reload->worker_epochs[i]);
+
+        if (epoch < epoch_min)
+        {
+            epoch_min = epoch;
+        }
+    }
+
+    link = &reload->retired;
+    while (*link)
+    {
+        struct statem_definition *definition = *link;
+
+        if (definition->retire_epoch <= epoch_min && !STATEM_ATOMIC_LOAD(&definition->refs))
+        {
+            *link = definition->retired_next;
+            if (definition->release)
+            {
+                definition->release(definition);
+            }
+            continue;
+        }
+
+        pending++;
+        link = &definition->retired_next;
+    }
+
+    return pending;
+}
+
+void statem_reload_quiescent(struct statem_reload *reload, size_t worker)
+{
+    if (!reload || worker >= reload->worker_nums)
+    {
+        return;
+    }
+
+    STATEM_ATOMIC_STORE(&reload->worker_epochs[worker], STATEM_ATOMIC_LOAD(&reload->epoch));
+}
+
+void statem_reload_offline(struct statem_reload *reload, size_t worker)
+{
+    if (!reload || worker >= reload->worker_nums)
+    {
+        return;
+    }
+
+    STATEM_ATOMIC_STORE(&reload->worker_epochs[worker], EPOCH_OFFLINE);
+}
+
+int statem_reload_machine_init(struct statem_reload *reload, struct statem_reload_machine *machine)
+{
+    struct statem_definition *definition;
+
+    if (!reload || !machine)
+    {
+        return -1;
+    }
+
+    definition = STATEM_ATOMIC_LOAD(&reload->current);
+    STATEM_ATOMIC_ADD(&definition->refs, 1);
+    machine->definition = definition;
+
+    return statem_init(&machine->fsm, definition->state_init, definition->state_error);
+}
+
+void statem_reload_machine_release(struct statem_reload_machine *machine)
+{
+    if (!machine || !machine->definition)
+    {
+        return;
+    }
+
+    STATEM_ATOMIC_ADD(&machine->definition->refs, (uint32_t)-1);
+    machine->definition = NULL;
+}
+
+// 在新版本中查找与旧状态对应的状态
+static struct state *state_map(struct statem_reload *reload, const struct statem_definition *definition,
+                               const struct state *state_old)
+{
+    const struct statem_graph *graph = definition->graph;
+    size_t i;
+
+    if (!state_old)
+    {
+        return NULL;
+    }
+
+    for (i = 0; i < graph->state_nums; ++i)
+    {
+        if (reload->key_equal(reload->ctx, state_old, graph->states[i]))
+        {
+            struct state *state = graph->states[i];
+
+            // 新版本中该状态变成了组状态，进入其入口状态
+            while (state->state_entry)
+            {
+                state = state->state_entry;
+            }
+
+            return state;
+        }
+    }
+
+    return NULL;
+}
+
+// 将状态机迁移到新版本
+static void machine_migrate(struct statem_reload *reload, struct statem_reload_machine *machine,
+                            struct statem_definition *definition)
+{
+    struct state_machine *fsm = &machine->fsm;
+    struct state *state_current = state_map(reload, definition, fsm->state_current);
+    struct state *state_previous = state_map(reload, definition, fsm->state_previous);
+
+    if (!state_current && fsm->state_current)
+    {
+        switch (reload->fallback)
+        {
+        case STATEM_RELOAD_FALLBACK_ERROR:
+            state_current = definition->state_error;
+            break;
+
+        case STATEM_RELOAD_FALLBACK_CUSTOM:
+            if (reload->fallback_get)
+            {
+                state_current = reload->fallback_get(reload->ctx, definition, fsm->state_current);
+                break;
+            }
+            // fall through
+
+        default:
+            state_current = definition->state_init;
+            break;
+        }
+    }
+
+    // 状态映射完成后才能解除与旧版本的绑定
+    STATEM_ATOMIC_ADD(&definition->refs, 1);
+    STATEM_ATOMIC_ADD(&machine->definition->refs, (uint32_t)-1);
+    machine->definition = definition;
+
+    fsm->state_current = state_current;
+    fsm->state_previous = state_previous;
+    fsm->state_error = definition->state_error;
+    statem_publish(fsm);
+}
+
+/**
+ * @brief 热更新域中的状态机处理事件
+ *
+ * 在事件边界检查是否有新版本，有则先迁移再处理事件
+ *
+ * @param reload    热更新域
+ * @param machine   状态机
+ * @param event     事件
+ * @return int
+ */
+int statem_reload_handle_event(struct statem_reload *reload, struct statem_reload_machine *machine,
+                               struct event *event)
+{
+    struct statem_definition *definition;
+
+    if (!reload || !machine || !machine->definition)
+    {
+        return STATEM_ERR_ARG;
+    }
+
+    definition = STATEM_ATOMIC_LOAD(&reload->current);
+    if (definition != machine->definition)
+    {
+        machine_migrate(reload, machine, definition);
+    }
+
+    return statem_handle_event(&machine->fsm, event);
+}
@@ -0,0 +1,227 @@
+/**
+ * \addtogroup state_machine
+ * @{
+ *
+ * \file
+ * \brief Hot reload of state graph definitions
+ *
+ * A reload domain holds the current definition of a state graph. A new
+ * definition is published with statem_reload_publish() while dispatch keeps
+ * running. Every machine moves to the new graph at its next event boundary:
+ * its current and previous states are mapped to the states of the new graph
+ * with the same key, by default the state's \ref state::data "data" compared
+ * as a string. States that no longer exist are handled by a configurable
+ * fallback.
+ *
+ * Old definitions are reclaimed RCU style. Workers report quiescent points
+ * with statem_reload_quiescent(), typically between two events, and a
+ * definition is released only after every worker has passed a quiescent
+ * point since it was retired and no machine is bound to it any more.
+ *
+ * \note statem_reload_publish() and statem_reload_reclaim() must be called
+ * from a single control thread. Each worker owns its machines.
+ *
+ * ~~~{.c}
+ * // worker
+ * while (1)
+ * {
+ *     statem_reload_offline(&domain, worker);
+ *     rt_mq_recv(mq, &e, sizeof(e), RT_WAITING_FOREVER);
+ *     statem_reload_quiescent(&domain, worker);
+ *     statem_reload_handle_event(&domain, &machine, &e);
+ * }
+ *
+ * // control thread
+ * statem_reload_publish(&domain, &definition_v2);
+ * while (statem_reload_reclaim(&domain))
+ *     rt_thread_delay(10);
+ * ~~~
+ */
+
+#ifndef __STATE_MACHINE_RELOAD_H
+#define __STATE_MACHINE_RELOAD_H
+
+#include <stdint.h>
+#include "state_machine.h"
+
+/**
+ * \brief What happens to machines whose state was removed
+ */
+enum statem_reload_fallback
+{
+    /** \brief Move to the new definition's initial state */
+    STATEM_RELOAD_FALLBACK_INIT,
+    /** \brief Move to the new definition's error state */
+    STATEM_RELOAD_FALLBACK_ERROR,
+    /** \brief Ask \ref statem_reload::fallback_get "fallback_get" */
+    STATEM_RELOAD_FALLBACK_CUSTOM,
+};
+
+/**
+ * \brief One version of a state graph
+ *
+ * Set #state_init, #state_error, #graph and optionally #release, the other
+ * members are managed by the domain.
+ */
+struct statem_definition
+{
+    struct state *state_init;
+    struct state *state_error;
+
+    // 该版本的状态图，用于按键值查找状态
+    const struct statem_graph *graph;
+
+    // 回收时调用，用于释放该版本状态图的内存，可以为NULL
+    void (*release)(struct statem_definition *definition);
+
+    // 绑定在该版本上的状态机个数
+    uint32_t refs;
+
+    // 被替换时的全局周期
+    uint64_t retire_epoch;
+
+    struct statem_definition *retired_next;
+};
+
+/**
+ * \brief Reload domain
+ *
+ * There is no need to manipulate the members directly.
+ */
+struct statem_reload
+{
+    // 当前版本
+    struct statem_definition *current;
+
+    // 判断新旧状态是否对应同一个状态，默认按字符串比较data
+    bool (*key_equal)(void *ctx, const struct state *state_old, const struct state *state_new);
+
+    // 旧状态在新版本中不存在时的处理
+    enum statem_reload_fallback fallback;
+    struct state *(*fallback_get)(void *ctx, const struct statem_definition *definition,
+                                  const struct state *state_old);
+
+    // 回调函数的参数
+    void *ctx;
+
+    // 全局周期，每次发布新版本加1
+    uint64_t epoch;
+
+    // 每个工作线程最近一次经过静止点时看到的周期
+    uint64_t *worker_epochs;
+    size_t worker_nums;
+
+    // 等待回收的旧版本
+    struct statem_definition *retired;
+};
+
+/**
+ * \brief State machine bound to a reload domain
+ */
+struct statem_reload_machine
+{
+    struct state_machine fsm;
+    struct statem_definition *definition;
+};
+
+/**
+ * \brief Initialise a reload domain
+ *
+ * \param reload the domain to initialise.
+ * \param definition the first definition.
+ * \param worker_nums number of worker threads dispatching events.
+ *
+ * \retval 0 on success.
+ * \retval -1 on invalid arguments or if memory could not be allocated.
+ */
+int statem_reload_init(struct statem_reload *reload, struct statem_definition *definition,
+                       size_t worker_nums);
+
+/**
+ * \brief Release the resources of a reload domain
+ *
+ * All machines must have been released.
+ */
+void statem_reload_deinit(struct statem_reload *reload);
+
+/**
+ * \brief Set how states are matched between two versions
+ *
+ * \param key_equal returns true if both states are the same state, NULL to
+ * compare \ref state::data "data" as strings.
+ * \param ctx argument passed to \pn{key_equal} and to the fallback.
+ */
+void statem_reload_key_set(struct statem_reload *reload,
+                           bool (*key_equal)(void *ctx, const struct state *state_old,
+                                             const struct state *state_new),
+                           void *ctx);
+
+/**
+ * \brief Set what happens to machines whose state was removed
+ *
+ * \param fallback_get only used with #STATEM_RELOAD_FALLBACK_CUSTOM.
+ */
+void statem_reload_fallback_set(struct statem_reload *reload, enum statem_reload_fallback fallback,
+                                struct state *(*fallback_get)(void *ctx,
+                                                              const struct statem_definition *definition,
+                                                              const struct state *state_old));
+
+/**
+ * \brief Publish a new definition
+ *
+ * The previous definition is retired and reclaimed by statem_reload_reclaim().
+ *
+ * \retval 0 on success.
+ * \retval -1 on invalid arguments.
+ */
+int statem_reload_publish(struct statem_reload *reload, struct statem_definition *definition);
+
+/**
+ * \brief Release retired definitions that are no longer in use
+ *
+ * \return the number of retired definitions still waiting.
+ */
+size_t statem_reload_reclaim(struct statem_reload *reload);
+
+/**
+ * \brief Report a quiescent point of a worker
+ *
+ * The worker must not hold any state pointer of a retired definition
+ * across this call.
+ */
+void statem_reload_quiescent(struct statem_reload *reload, size_t worker);
+
+/**
+ * \brief Mark a worker as idle
+ *
+ * An idle worker does not hold back reclamation, for instance while it waits
+ * for the next event. statem_reload_quiescent() brings it back online.
+ */
+void statem_reload_offline(struct statem_reload *reload, size_t worker);
+
+/**
+ * \brief Initialise a machine on the domain's current definition
+ *
+ * \retval 0 on success.
+ * \retval -1 on invalid arguments.
+ */
+int statem_reload_machine_init(struct statem_reload *reload, struct statem_reload_machine *machine);
+
+/**
+ * \brief Unbind a machine from its definition
+ */
+void statem_reload_machine_release(struct statem_reload_machine *machine);
+
+/**
+ * \brief Pass an event to a machine, moving it to the current definition first
+ *
+ * \return #statem_handle_event_return_vals
+ */
+int statem_reload_handle_event(struct statem_reload *reload, struct statem_reload_machine *machine,
+                               struct event *event);
+
+#endif // __STATE_MACHINE_RELOAD_H
+
+/**
+ * @}
+ */
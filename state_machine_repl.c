@@ -0,0 +1,603 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include "state_machine_repl.h"
+#include "state_machine_port.h"
+
+// 没有当前状态
+#define STATE_NONE              UINT32_MAX
+
+// 每次读取的确认数
+#define ACK_BATCH               64
+
+static int fd_nonblock(int fd)
+{
+    int flags = fcntl(fd, F_GETFL);
+
+    return (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) ? -1 : 0;
+}
+
+static void stats_lag(struct statem_repl_stats *stats, uint64_t timestamp)
+{
+    uint64_t now = STATEM_CLOCK_GET();
+
+    stats->lag_last = (now > timestamp) ? now - timestamp : 0;
+    if (stats->lag_last > stats->lag_max)
+    {
+        stats->lag_max = stats->lag_last;
+    }
+}
+
+/**
+ * @brief 发送环形缓冲区中尚未发送的记录
+ *
+ * 已分配但未确认的记录不会被覆盖，因此可以在锁外读取
+ *
+ * @param primary   主机
+ * @return int      0：成功或者暂时不可写   -1：失败
+ */
+static int repl_send(struct statem_repl_primary *primary)
+{
+    const uint8_t *data;
+    size_t index, nums, bytes, total;
+    ssize_t ret;
+
+    pthread_mutex_lock(&primary->lock);
+
+    if (primary->seq_sent == primary->seq)
+    {
+        pthread_mutex_unlock(&primary->lock);
+        return 0;
+    }
+
+    // 只发送到环形缓冲区末尾为止的连续部分
+    index = (size_t)((primary->seq_sent + 1) % primary->capacity);
+    nums = (size_t)(primary->seq - primary->seq_sent);
+    if (nums > primary->capacity - index)
+    {
+        nums = primary->capacity - index;
+    }
+
+    data = (const uint8_t *)&primary->ring[index] + primary->sent_partial;
+    bytes = nums * sizeof(*primary->ring) - primary->sent_partial;
+
+    pthread_mutex_unlock(&primary->lock);
+
+    ret = write(primary->fd, data, bytes);
+    if (ret < 0)
+    {
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+    }
+
+    pthread_mutex_lock(&primary->lock);
+
+    total = primary->sent_partial + (size_t)ret;
+    primary->seq_sent += total / sizeof(*primary->ring);
+    primary->sent_partial = total % sizeof(*primary->ring);
+    primary->stats.records += total / sizeof(*primary->ring);
+
+    pthread_mutex_unlock(&primary->lock);
+
+    return 0;
+}
+
+/**
+ * @brief 接收备机的确认
+ *
+ * 确认是备机已应用的最后序号，只需处理本次读到的最后一个
+ *
+ * @param primary   主机
+ * @return int      0：成功或者暂时没有数据   -1：连接关闭或者确认无效
+ */
+static int repl_receive(struct statem_repl_primary *primary)
+{
+    uint8_t buffer[ACK_BATCH * sizeof(uint64_t)];
+    size_t nums = primary->ack_nums, count;
+    uint64_t ack;
+    ssize_t ret;
+
+    memcpy(buffer, primary->ack, nums);
+
+    ret = read(primary->fd, buffer + nums, sizeof(buffer) - nums);
+    if (ret == 0)
+    {
+        return -1;
+    }
+    if (ret < 0)
+    {
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+    }
+
+    nums += (size_t)ret;
+    count = nums / sizeof(ack);
+    primary->ack_nums = nums % sizeof(ack);
+    memcpy(primary->ack, buffer + count * sizeof(ack), primary->ack_nums);
+
+    if (!count)
+    {
+        return 0;
+    }
+
+    memcpy(&ack, buffer + (count - 1) * sizeof(ack), sizeof(ack));
+
+    pthread_mutex_lock(&primary->lock);
+
+    if (ack > primary->seq_sent)
+    {
+        pthread_mutex_unlock(&primary->lock);
+        return -1;
+    }
+
+    if (ack > primary->seq_acked)
+    {
+        stats_lag(&primary->stats, primary->ring[ack % primary->capacity].timestamp);
+        primary->seq_acked = ack;
+        primary->stats.seq = ack;
+        pthread_cond_broadcast(&primary->cond);
+    }
+
+    pthread_mutex_unlock(&primary->lock);
+
+    return 0;
+}
+
+/**
+ * @brief 发送线程
+ *
+ * 同时等待套接字可写、确认到达和新记录的唤醒，发送不等待确认，实现流水线
+ *
+ * @param parameter 主机
+ * @return void*
+ */
+static void *repl_thread(void *parameter)
+{
+    struct statem_repl_primary *primary = parameter;
+    bool failed = false;
+
+    pthread_mutex_lock(&primary->lock);
+
+    while (!failed && (primary->running || primary->seq_acked < primary->seq))
+    {
+        struct pollfd fds[2];
+        bool sending = primary->seq_sent < primary->seq;
+
+        pthread_mutex_unlock(&primary->lock);
+
+        fds[0].fd = primary->fd;
+        fds[0].events = POLLIN | (sending ? POLLOUT : 0);
+        fds[1].fd = primary->wake_fd[0];
+        fds[1].events = POLLIN;
+
+        if (poll(fds, 2, -1) < 0)
+        {
+            failed = (errno != EINTR);
+        }
+        else
+        {
+            if (fds[1].revents & POLLIN)
+            {
+                uint8_t drain[64];
+
+                while (read(primary->wake_fd[0], drain, sizeof(drain)) > 0)
+                {
+                }
+            }
+
+            if ((fds[0].revents & (POLLIN | POLLHUP | POLLERR)) && repl_receive(primary))
+            {
+                failed = true;
+            }
+
+            if (!failed && (fds[0].revents & POLLOUT) && repl_send(primary))
+            {
+                failed = true;
+            }
+        }
+
+        pthread_mutex_lock(&primary->lock);
+    }
+
+    if (failed)
+    {
+        primary->failed = true;
+    }
+    pthread_cond_broadcast(&primary->cond);
+
+    pthread_mutex_unlock(&primary->lock);
+
+    return NULL;
+}
+
+// 唤醒发送线程，管道已满说明已经有未处理的唤醒
+static void repl_wake(struct statem_repl_primary *primary)
+{
+    uint8_t value = 1;
+    ssize_t ret = write(primary->wake_fd[1], &value, sizeof(value));
+
+    (void)ret;
+}
+
+/**
+ * @brief 开始向备机复制
+ *
+ * @param primary   主机
+ * @param fd        已连接的流套接字
+ * @param capacity  未确认记录的最大个数
+ * @return int      0：成功   -1：失败
+ */
+int statem_repl_primary_open(struct statem_repl_primary *primary, int fd, size_t capacity)
+{
+    if (!primary || fd < 0 || !capacity)
+    {
+        return -1;
+    }
+
+    memset(primary, 0, sizeof(*primary));
+    primary->fd = fd;
+    primary->capacity = capacity;
+
+    primary->ring = STATEM_MALLOC(capacity * sizeof(*primary->ring));
+    if (!primary->ring)
+    {
+        return -1;
+    }
+
+    if (fd_nonblock(fd) || pipe(primary->wake_fd))
+    {
+        STATEM_FREE(primary->ring);
+        primary->ring = NULL;
+        return -1;
+    }
+
+    if (fd_nonblock(primary->wake_fd[0]) || fd_nonblock(primary->wake_fd[1]))
+    {
+        goto fail;
+    }
+
+    pthread_mutex_init(&primary->lock, NULL);
+    pthread_cond_init(&primary->cond, NULL);
+    primary->running = true;
+
+    if (pthread_create(&primary->thread, NULL, &repl_thread, primary))
+    {
+        pthread_cond_destroy(&primary->cond);
+        pthread_mutex_destroy(&primary->lock);
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+    close(primary->wake_fd[0]);
+    close(primary->wake_fd[1]);
+    STATEM_FREE(primary->ring);
+    primary->ring = NULL;
+
+    return -1;
+}
+
+int statem_repl_primary_close(struct statem_repl_primary *primary)
+{
+    bool failed;
+
+    if (!primary || !primary->ring)
+    {
+        return -1;
+    }
+
+    pthread_mutex_lock(&primary->lock);
+    primary->running = false;
+    pthread_mutex_unlock(&primary->lock);
+
+    repl_wake(primary);
+    pthread_join(primary->thread, NULL);
+
+    failed = primary->failed;
+    pthread_cond_destroy(&primary->cond);
+    pthread_mutex_destroy(&primary->lock);
+    close(primary->wake_fd[0]);
+    close(primary->wake_fd[1]);
+    STATEM_FREE(primary->ring);
+    primary->ring = NULL;
+
+    return failed ? -1 : 0;
+}
+
+int statem_repl_handle_event(struct statem_repl_primary *primary, uint64_t machine_id,
+                             struct state_machine *fsm, struct event *event)
+{
+    struct statem_repl_record *record;
+    struct state *state;
+    bool wake;
+    int ret;
+
+    if (!primary || !primary->ring)
+    {
+        return STATEM_ERR_ARG;
+    }
+
+    ret = statem_handle_event(fsm, event);
+    if (ret == STATEM_STATE_NOCHANGE || ret == STATEM_ERR_ARG)
+    {
+        return ret;
+    }
+
+    state = statem_state_current(fsm);
+
+    pthread_mutex_lock(&primary->lock);
+
+    // 未确认的记录已满，等待备机确认
+    while (primary->seq - primary->seq_acked == primary->capacity && !primary->failed)
+    {
+        pthread_cond_wait(&primary->cond, &primary->lock);
+    }
+
+    if (!primary->failed)
+    {
+        wake = (primary->seq_sent == primary->seq);
+
+        record = &primary->ring[(primary->seq + 1) % primary->capacity];
+        record->seq = primary->seq + 1;
+        record->machine_id = machine_id;
+        record->event_type = event->type;
+        record->state_id = state ? state->id : STATE_NONE;
+        record->timestamp = STATEM_CLOCK_GET();
+        primary->seq++;
+
+        if (wake)
+        {
+            repl_wake(primary);
+        }
+    }
+    else
+    {
+        // 状态已经改变但无法复制，不能让调用者当作成功处理
+        ret = STATEM_REPL_FAILED;
+    }
+
+    pthread_mutex_unlock(&primary->lock);
+
+    return ret;
+}
+
+uint64_t statem_repl_seq(struct statem_repl_primary *primary)
+{
+    uint64_t seq;
+
+    if (!primary || !primary->ring)
+    {
+        return 0;
+    }
+
+    pthread_mutex_lock(&primary->lock);
+    seq = primary->seq;
+    pthread_mutex_unlock(&primary->lock);
+
+    return seq;
+}
+
+int statem_repl_wait(struct statem_repl_primary *primary, uint64_t seq)
+{
+    bool failed;
+
+    if (!primary || !primary->ring)
+    {
+        return -1;
+    }
+
+    pthread_mutex_lock(&primary->lock);
+
+    while (primary->seq_acked < seq && !primary->failed)
+    {
+        pthread_cond_wait(&primary->cond, &primary->lock);
+    }
+    failed = primary->failed;
+
+    pthread_mutex_unlock(&primary->lock);
+
+    return failed ? -1 : 0;
+}
+
+void statem_repl_primary_stats(struct statem_repl_primary *primary, struct statem_repl_stats *stats)
+{
+    if (!primary || !primary->ring || !stats)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&primary->lock);
+    *stats = primary->stats;
+    pthread_mutex_unlock(&primary->lock);
+}
+
+int statem_repl_standby_init(struct statem_repl_standby *standby, int fd, const struct statem_graph *graph,
+                             struct state_machine *(*machine_get)(void *ctx, uint64_t machine_id),
+                             void *ctx, size_t batch)
+{
+    if (!standby || fd < 0 || !graph || !machine_get || !batch)
+    {
+        return -1;
+    }
+
+    memset(standby, 0, sizeof(*standby));
+
+    standby->buffer = STATEM_MALLOC(batch * sizeof(*standby->buffer));
+    if (!standby->buffer)
+    {
+        return -1;
+    }
+
+    standby->fd = fd;
+    standby->graph = graph;
+    standby->machine_get = machine_get;
+    standby->ctx = ctx;
+    standby->buffer_max = batch;
+
+    return 0;
+}
+
+void statem_repl_standby_deinit(struct statem_repl_standby *standby)
+{
+    if (!standby || !standby->buffer)
+    {
+        return;
+    }
+
+    STATEM_FREE(standby->buffer);
+    standby->buffer = NULL;
+}
+
+// 应用一条记录，不执行guard和action
+static int record_apply(struct statem_repl_standby *standby, const struct statem_repl_record *record)
+{
+    struct state_machine *fsm;
+    struct state *state = NULL;
+
+    if (record->seq != standby->stats.seq + 1)
+    {
+        return -1;
+    }
+
+    if (record->state_id != STATE_NONE)
+    {
+        state = statem_graph_state(standby->graph, record->state_id);
+        if (!state)
+        {
+            return -1;
+        }
+    }
+
+    fsm = standby->machine_get(standby->ctx, record->machine_id);
+    if (fsm)
+    {
+        fsm->state_previous = fsm->state_current;
+        fsm->state_current = state;
+        statem_publish(fsm);
+    }
+
+    standby->stats.seq = record->seq;
+    standby->stats.records++;
+
+    return 0;
+}
+
+/**
+ * @brief 发送最后应用的序号
+ *
+ * 确认可能只写出一部分，剩余字节保留到下次继续写，写完后才放入更新的序号，
+ * 保证数据流中的确认完整；多个未发送的确认合并为最新的一个
+ *
+ * @param standby   备机
+ * @return int      0：已发送或者需要稍后继续   -1：失败
+ */
+static int ack_flush(struct statem_repl_standby *standby)
+{
+    while (1)
+    {
+        ssize_t ret;
+
+        if (!standby->ack_nums)
+        {
+            if (standby->ack_seq == standby->stats.seq)
+            {
+                return 0;
+            }
+
+            standby->ack_seq = standby->stats.seq;
+            memcpy(standby->ack, &standby->ack_seq, sizeof(standby->ack));
+            standby->ack_nums = sizeof(standby->ack);
+        }
+
+        ret = write(standby->fd, standby->ack + sizeof(standby->ack) - standby->ack_nums, standby->ack_nums);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+
+        standby->ack_nums -= (size_t)ret;
+    }
+}
+
+/**
+ * @brief 读取、应用并确认套接字上的记录
+ *
+ * 每次读取只发送一个确认，携带最后应用的序号。上次未发送完的确认先继续发送
+ *
+ * @param standby   备机
+ * @return int      应用的记录数，-1：失败
+ */
+int statem_repl_standby_run_once(struct statem_repl_standby *standby)
+{
+    size_t i, nums, rest;
+    ssize_t ret;
+
+    if (!standby || !standby->buffer)
+    {
+        return -1;
+    }
+
+    if (ack_flush(standby))
+    {
+        return -1;
+    }
+
+    ret = read(standby->fd, (uint8_t *)standby->buffer + standby->buffer_bytes,
+               standby->buffer_max * sizeof(*standby->buffer) - standby->buffer_bytes);
+    if (ret == 0)
+    {
+        return -1;
+    }
+    if (ret < 0)
+    {
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+    }
+
+    standby->buffer_bytes += (size_t)ret;
+    nums = standby->buffer_bytes / sizeof(*standby->buffer);
+
+    for (i = 0; i < nums; ++i)
+    {
+        if (record_apply(standby, &standby->buffer[i]))
+        {
+            return -1;
+        }
+    }
+
+    if (nums)
+    {
+        stats_lag(&standby->stats, standby->buffer[nums - 1].timestamp);
+
+        if (ack_flush(standby))
+        {
+            return -1;
+        }
+    }
+
+    // 保留末尾不完整的记录
+    rest = standby->buffer_bytes - nums * sizeof(*standby->buffer);
+    memmove(standby->buffer, (uint8_t *)standby->buffer + nums * sizeof(*standby->buffer), rest);
+    standby->buffer_bytes = rest;
+
+    return (int)nums;
+}
+
+bool statem_repl_standby_ack_pending(struct statem_repl_standby *standby)
+{
+    return standby && (standby->ack_nums || standby->ack_seq != standby->stats.seq);
+}
+
+void statem_repl_standby_stats(struct statem_repl_standby *standby, struct statem_repl_stats *stats)
+{
+    if (!standby || !stats)
+    {
+        return;
+    }
+
+    *stats = standby->stats;
+}
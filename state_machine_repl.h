@@ -0,0 +1,256 @@
+/**
+ * \addtogroup state_machine
+ * @{
+ *
+ * \file
+ * \brief Hot-standby replication of transitions over a stream socket
+ *
+ * The primary wraps statem_handle_event() with statem_repl_handle_event(),
+ * which appends a compact record (sequence number, machine id, event type
+ * and the \ref state::id "id" of the new state) for every accepted event to
+ * a ring. A sender thread streams the ring to a standby over a connected
+ * UNIX or TCP socket without waiting for each record to be acknowledged, so
+ * many records are in flight at once. The ring holds the records that are
+ * not yet acknowledged; when it is full the primary waits.
+ *
+ * The standby reads whatever is available, applies every complete record by
+ * setting the machine's current state directly, without running guards or
+ * actions, and acknowledges the last applied sequence number once per read.
+ *
+ * Both sides report replication lag from the record timestamps, which is
+ * meaningful when both processes share #STATEM_CLOCK_GET, e.g. on one host.
+ *
+ * \note Only available on POSIX systems. Records are sent in host byte
+ * order; primary and standby must run on the same architecture and be built
+ * from the same graph definition.
+ */
+
+#ifndef __STATE_MACHINE_REPL_H
+#define __STATE_MACHINE_REPL_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include "state_machine.h"
+
+/**
+ * \brief Return values of statem_repl_handle_event() besides
+ * #statem_handle_event_return_vals
+ */
+enum statem_repl_return_vals
+{
+    /**
+     * \brief The machine handled the event but the stream has failed
+     *
+     * The new state was not replicated and the standby is behind. Every later
+     * event fails the same way.
+     */
+    STATEM_REPL_FAILED = -3,
+};
+
+/**
+ * \brief Replication record
+ */
+struct statem_repl_record
+{
+    // 序号，从1开始连续递增
+    uint64_t seq;
+
+    uint64_t machine_id;
+    int32_t event_type;
+
+    // 转换后的状态编号，UINT32_MAX表示没有当前状态
+    uint32_t state_id;
+
+    // 主机追加记录的时间，单位：ns
+    uint64_t timestamp;
+};
+
+/**
+ * \brief Replication statistics
+ */
+struct statem_repl_stats
+{
+    // 主机：已发送的记录数；备机：已应用的记录数
+    uint64_t records;
+
+    // 主机：已确认的最后序号；备机：已应用的最后序号
+    uint64_t seq;
+
+    // 最近一次和最大的复制延迟，单位：ns
+    uint64_t lag_last;
+    uint64_t lag_max;
+};
+
+/**
+ * \brief Primary side
+ *
+ * There is no need to manipulate the members directly.
+ */
+struct statem_repl_primary
+{
+    int fd;
+
+    // 唤醒发送线程的管道
+    int wake_fd[2];
+
+    // 未确认记录的环形缓冲区，序号seq的记录位于seq % capacity
+    struct statem_repl_record *ring;
+    size_t capacity;
+
+    // 最后分配、完整发送和已确认的序号
+    uint64_t seq;
+    uint64_t seq_sent;
+    uint64_t seq_acked;
+
+    // 下一条待发送记录已经发送的字节数
+    size_t sent_partial;
+
+    // 接收确认的缓冲区
+    uint8_t ack[sizeof(uint64_t)];
+    size_t ack_nums;
+
+    bool running;
+    bool failed;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+
+    struct statem_repl_stats stats;
+};
+
+/**
+ * \brief Standby side
+ *
+ * There is no need to manipulate the members directly.
+ */
+struct statem_repl_standby
+{
+    int fd;
+    const struct statem_graph *graph;
+
+    // 按编号获取状态机，返回NULL则跳过该记录
+    struct state_machine *(*machine_get)(void *ctx, uint64_t machine_id);
+    void *ctx;
+
+    // 接收缓冲区，可能以不完整的记录结尾
+    struct statem_repl_record *buffer;
+    size_t buffer_max;
+    size_t buffer_bytes;
+
+    // 正在发送的确认及其剩余字节数，ack_seq为最后放入的序号。
+    // 套接字写满时保留，下次调用时继续发送
+    uint8_t ack[sizeof(uint64_t)];
+    size_t ack_nums;
+    uint64_t ack_seq;
+
+    struct statem_repl_stats stats;
+};
+
+/**
+ * \brief Start replicating to a standby
+ *
+ * \param primary the primary to start.
+ * \param fd a connected stream socket, switched to non-blocking mode. It is
+ * not closed by statem_repl_primary_close().
+ * \param capacity maximum number of records not yet acknowledged.
+ *
+ * \retval 0 on success.
+ * \retval -1 on invalid arguments or on failure.
+ */
+int statem_repl_primary_open(struct statem_repl_primary *primary, int fd, size_t capacity);
+
+/**
+ * \brief Wait until every record is acknowledged and stop replicating
+ *
+ * \retval 0 on success.
+ * \retval -1 if the stream failed before every record was acknowledged.
+ */
+int statem_repl_primary_close(struct statem_repl_primary *primary);
+
+/**
+ * \brief Pass an event to a machine and replicate the result
+ *
+ * Nothing is replicated if the machine returned #STATEM_STATE_NOCHANGE or
+ * #STATEM_ERR_ARG. The machine must belong to a graph numbered by
+ * statem_graph_build().
+ *
+ * \return #statem_handle_event_return_vals, or #STATEM_REPL_FAILED if the
+ * event changed the machine but could not be replicated.
+ */
+int statem_repl_handle_event(struct statem_repl_primary *primary, uint64_t machine_id,
+                             struct state_machine *fsm, struct event *event);
+
+/**
+ * \brief Get the sequence number of the last appended record
+ */
+uint64_t statem_repl_seq(struct statem_repl_primary *primary);
+
+/**
+ * \brief Wait until the standby has acknowledged a sequence number
+ *
+ * \retval 0 on success.
+ * \retval -1 if the stream failed.
+ */
+int statem_repl_wait(struct statem_repl_primary *primary, uint64_t seq);
+
+/**
+ * \brief Get the primary statistics, the lag is measured up to the ack
+ */
+void statem_repl_primary_stats(struct statem_repl_primary *primary, struct statem_repl_stats *stats);
+
+/**
+ * \brief Initialise the standby side
+ *
+ * \param standby the standby to initialise.
+ * \param fd a connected stream socket.
+ * \param graph the numbered graph of the replicated machines.
+ * \param machine_get returns the machine for an id, or NULL to skip it.
+ * \param ctx argument passed to \pn{machine_get}.
+ * \param batch number of records read at most at once.
+ *
+ * \retval 0 on success.
+ * \retval -1 on invalid arguments or if memory could not be allocated.
+ */
+int statem_repl_standby_init(struct statem_repl_standby *standby, int fd, const struct statem_graph *graph,
+                             struct state_machine *(*machine_get)(void *ctx, uint64_t machine_id),
+                             void *ctx, size_t batch);
+
+/**
+ * \brief Release the standby side, the socket is not closed
+ */
+void statem_repl_standby_deinit(struct statem_repl_standby *standby);
+
+/**
+ * \brief Read, apply and acknowledge the records available on the socket
+ *
+ * Blocks until at least some data arrives if the socket is blocking. On a
+ * non-blocking socket an acknowledgement that does not fit into the socket
+ * buffer is kept and sent by the next call; see
+ * statem_repl_standby_ack_pending().
+ *
+ * \return the number of records applied, 0 if the read was interrupted or
+ * would block, or -1 when the primary closed the stream, a sequence number
+ * is missing or a state id is not in the graph.
+ */
+int statem_repl_standby_run_once(struct statem_repl_standby *standby);
+
+/**
+ * \brief Check whether an acknowledgement is waiting for the socket
+ *
+ * An event loop should then also wait for the socket to become writable and
+ * call statem_repl_standby_run_once() when it is, otherwise the primary may
+ * wait for the acknowledgement while the standby waits for data.
+ */
+bool statem_repl_standby_ack_pending(struct statem_repl_standby *standby);
+
+/**
+ * \brief Get the standby statistics, the lag is measured up to the apply
+ */
+void statem_repl_standby_stats(struct statem_repl_standby *standby, struct statem_repl_stats *stats);
+
+#endif // __STATE_MACHINE_REPL_H
+
+/**
+ * @}
+ */
@@ -0,0 +1,354 @@
+#include <string.h>
+#include "state_machine_sched.h"
+
+// 考虑回绕的时间比较
+#define TICK_BEFORE(a, b)       ((int32_t)((uint32_t)(a) - (uint32_t)(b)) < 0)
+
+static void heap_swap(struct statem_sched *sched, size_t i, size_t j)
+{
+    struct statem_sched_machine *tmp = sched->heap[i];
+
+    sched->heap[i] = sched->heap[j];
+    sched->heap[j] = tmp;
+    sched->heap[i]->heap_index = i;
+    sched->heap[j]->heap_index = j;
+}
+
+static void heap_up(struct statem_sched *sched, size_t i)
+{
+    while (i > 0 && TICK_BEFORE(sched->heap[i]->key, sched->heap[(i - 1) / 2]->key))
+    {
+        heap_swap(sched, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void heap_down(struct statem_sched *sched, size_t i)
+{
+    for (;;)
+    {
+        size_t left = 2 * i + 1, right = left + 1, min = i;
+
+        if (left < sched->heap_nums && TICK_BEFORE(sched->heap[left]->key, sched->heap[min]->key))
+        {
+            min = left;
+        }
+
+        if (right < sched->heap_nums && TICK_BEFORE(sched->heap[right]->key, sched->heap[min]->key))
+        {
+            min = right;
+        }
+
+        if (min == i)
+        {
+            break;
+        }
+
+        heap_swap(sched, i, min);
+        i = min;
+    }
+}
+
+static void heap_push(struct statem_sched *sched, struct statem_sched_machine *machine)
+{
+    machine->heap_index = sched->heap_nums;
+    machine->heaped = true;
+    sched->heap[sched->heap_nums++] = machine;
+    heap_up(sched, machine->heap_index);
+}
+
+static void heap_remove(struct statem_sched *sched, struct statem_sched_machine *machine)
+{
+    size_t i = machine->heap_index;
+
+    machine->heaped = false;
+    sched->heap_nums--;
+
+    if (i == sched->heap_nums)
+    {
+        return;
+    }
+
+    sched->heap[i] = sched->heap[sched->heap_nums];
+    sched->heap[i]->heap_index = i;
+    heap_up(sched, i);
+    heap_down(sched, sched->heap[i]->heap_index);
+}
+
+// 重新计算队列中最早的截止时间
+static void key_update(struct statem_sched_machine *machine)
+{
+    size_t i;
+
+    machine->key = machine->queue[machine->queue_head].deadline;
+
+    for (i = 1; i < machine->queue_nums; ++i)
+    {
+        uint32_t deadline = machine->queue[(machine->queue_head + i) % machine->queue_max].deadline;
+
+        if (TICK_BEFORE(deadline, machine->key))
+        {
+            machine->key = deadline;
+        }
+    }
+}
+
+/**
+ * @brief 初始化调度器
+ *
+ * @param sched         调度器
+ * @param machine_max   状态机的最大个数
+ * @param budget        每个状态机每轮最多分发的事件数
+ * @return int          0：成功   -1：失败
+ */
+int statem_sched_init(struct statem_sched *sched, size_t machine_max, unsigned int budget)
+{
+    if (!sched || !machine_max || !budget)
+    {
+        return -1;
+    }
+
+    memset(sched, 0, sizeof(*sched));
+
+    sched->heap = STATEM_MALLOC(machine_max * sizeof(*sched->heap));
+    if (!sched->heap)
+    {
+        return -1;
+    }
+
+    sched->heap_max = machine_max;
+    sched->budget = budget;
+    STATEM_LOCK_INIT(&sched->lock);
+
+    return 0;
+}
+
+void statem_sched_deinit(struct statem_sched *sched)
+{
+    if (!sched || !sched->heap)
+    {
+        return;
+    }
+
+    STATEM_LOCK_DEINIT(&sched->lock);
+    STATEM_FREE(sched->heap);
+    sched->heap = NULL;
+}
+
+void statem_sched_notify_set(struct statem_sched *sched, void (*notify)(void *ctx), void *ctx)
+{
+    if (!sched)
+    {
+        return;
+    }
+
+    STATEM_LOCK(&sched->lock);
+    sched->notify = notify;
+    sched->ctx = ctx;
+    STATEM_UNLOCK(&sched->lock);
+}
+
+int statem_sched_machine_init(struct statem_sched *sched, struct statem_sched_machine *machine,
+                              struct state_machine *fsm, size_t queue_max, uint32_t deadline)
+{
+    if (!sched || !sched->heap || !machine || !fsm || !queue_max)
+    {
+        return -1;
+    }
+
+    memset(machine, 0, sizeof(*machine));
+
+    machine->queue = STATEM_MALLOC(queue_max * sizeof(*machine->queue));
+    if (!machine->queue)
+    {
+        return -1;
+    }
+
+    machine->fsm = fsm;
+    machine->queue_max = queue_max;
+    machine->deadline = deadline;
+
+    STATEM_LOCK(&sched->lock);
+
+    if (sched->machine_nums == sched->heap_max)
+    {
+        STATEM_UNLOCK(&sched->lock);
+        STATEM_FREE(machine->queue);
+        machine->queue = NULL;
+        return -1;
+    }
+    sched->machine_nums++;
+
+    STATEM_UNLOCK(&sched->lock);
+
+    return 0;
+}
+
+void statem_sched_machine_deinit(struct statem_sched *sched, struct statem_sched_machine *machine)
+{
+    if (!sched || !sched->heap || !machine || !machine->queue)
+    {
+        return;
+    }
+
+    STATEM_LOCK(&sched->lock);
+
+    if (machine->heaped)
+    {
+        heap_remove(sched, machine);
+    }
+    sched->machine_nums--;
+
+    STATEM_UNLOCK(&sched->lock);
+
+    STATEM_FREE(machine->queue);
+    machine->queue = NULL;
+}
+
+int statem_sched_post_deadline(struct statem_sched *sched, struct statem_sched_machine *machine,
+                               struct event *event, uint32_t deadline)
+{
+    struct statem_sched_entry *entry;
+    bool wake = false;
+
+    if (!sched || !sched->heap || !machine || !machine->queue || !event)
+    {
+        return -1;
+    }
+
+    STATEM_LOCK(&sched->lock);
+
+    if (machine->queue_nums == machine->queue_max)
+    {
+        STATEM_UNLOCK(&sched->lock);
+        return -1;
+    }
+
+    entry = &machine->queue[(machine->queue_head + machine->queue_nums++) % machine->queue_max];
+    entry->event = *event;
+    entry->deadline = STATEM_TICK_GET() + deadline;
+
+    // 更紧急的事件提前整个状态机，正在运行的状态机在本轮结束后再放回堆中
+    if (machine->queue_nums == 1 || TICK_BEFORE(entry->deadline, machine->key))
+    {
+        machine->key = entry->deadline;
+
+        if (machine->heaped)
+        {
+            heap_up(sched, machine->heap_index);
+        }
+        else if (!machine->running)
+        {
+            heap_push(sched, machine);
+            wake = true;
+        }
+    }
+
+    STATEM_UNLOCK(&sched->lock);
+
+    if (wake && sched->notify)
+    {
+        sched->notify(sched->ctx);
+    }
+
+    return 0;
+}
+
+int statem_sched_post(struct statem_sched *sched, struct statem_sched_machine *machine,
+                      struct event *event)
+{
+    if (!machine)
+    {
+        return -1;
+    }
+
+    return statem_sched_post_deadline(sched, machine, event, machine->deadline);
+}
+
+/**
+ * @brief 运行最紧急的状态机一轮
+ *
+ * 取出堆顶的状态机，按投递顺序分发最多budget个事件，分发时已经超过截止时间的记为错过。
+ * 分发在锁外进行，期间可以继续向该状态机投递事件
+ *
+ * @param sched     调度器
+ * @return int      分发的事件数
+ */
+int statem_sched_run_once(struct statem_sched *sched)
+{
+    struct statem_sched_machine *machine;
+    unsigned int nums = 0;
+
+    if (!sched || !sched->heap)
+    {
+        return 0;
+    }
+
+    STATEM_LOCK(&sched->lock);
+
+    if (!sched->heap_nums)
+    {
+        STATEM_UNLOCK(&sched->lock);
+        return 0;
+    }
+
+    machine = sched->heap[0];
+    heap_remove(sched, machine);
+    machine->running = true;
+
+    while (nums < sched->budget && machine->queue_nums)
+    {
+        struct statem_sched_entry entry = machine->queue[machine->queue_head];
+        uint32_t now;
+
+        machine->queue_head = (machine->queue_head + 1) % machine->queue_max;
+        machine->queue_nums--;
+
+        STATEM_UNLOCK(&sched->lock);
+
+        now = STATEM_TICK_GET();
+        statem_handle_event(machine->fsm, &entry.event);
+        nums++;
+
+        STATEM_LOCK(&sched->lock);
+
+        machine->dispatched++;
+        sched->stats.dispatched++;
+
+        if (TICK_BEFORE(entry.deadline, now))
+        {
+            machine->misses++;
+            sched->stats.misses++;
+
+            if (now - entry.deadline > sched->stats.lateness_max)
+            {
+                sched->stats.lateness_max = now - entry.deadline;
+            }
+        }
+    }
+
+    machine->running = false;
+
+    // 还有事件，按剩余事件中最早的截止时间放回堆中
+    if (machine->queue_nums)
+    {
+        key_update(machine);
+        heap_push(sched, machine);
+    }
+
+    STATEM_UNLOCK(&sched->lock);
+
+    return (int)nums;
+}
+
+void statem_sched_stats_get(struct statem_sched *sched, struct statem_sched_stats *stats)
+{
+    if (!sched || !stats)
+    {
+        return;
+    }
+
+    STATEM_LOCK(&sched->lock);
+    *stats = sched->stats;
+    STATEM_UNLOCK(&sched->lock);
+}
@@ -0,0 +1,205 @@
+/**
+ * \addtogroup state_machine
+ * @{
+ *
+ * \file
+ * \brief Earliest-deadline-first scheduling of state machines
+ *
+ * With one queue per worker, a burst of events for one busy machine delays
+ * every machine queued behind it. The scheduler instead keeps a bounded
+ * event queue per machine and a min-heap of the machines that have events,
+ * ordered by the earliest deadline among their queued events. A worker calling
+ * statem_sched_run_once() takes the most urgent machine and dispatches at
+ * most \ref statem_sched::budget "budget" of its events before putting it
+ * back, so no machine can monopolise a worker.
+ *
+ * Deadlines are relative to the time an event is posted, in
+ * #STATEM_TICK_GET ticks; a shorter deadline acts as a higher priority. The
+ * events of one machine are always dispatched in the order they were
+ * posted, an urgent event raises the priority of the events queued before
+ * it. An event dispatched after its deadline is counted as a miss.
+ *
+ * A machine is run by one worker at a time, so several workers may call
+ * statem_sched_run_once() on the same scheduler.
+ *
+ * ~~~{.c}
+ * statem_sched_init(&sched, 64, 8);
+ * statem_sched_notify_set(&sched, &wake_workers, NULL);
+ * statem_sched_machine_init(&sched, &bulk, &m_bulk, 1024, 1000);
+ * statem_sched_machine_init(&sched, &ui, &m_ui, 16, 10);
+ *
+ * statem_sched_post(&sched, &ui, &(struct event){ EVENT_KEYBOARD, data });
+ *
+ * // worker thread
+ * while (1)
+ *     if (!statem_sched_run_once(&sched))
+ *         wait_for_wake();
+ * ~~~
+ */
+
+#ifndef __STATE_MACHINE_SCHED_H
+#define __STATE_MACHINE_SCHED_H
+
+#include <stdint.h>
+#include "state_machine.h"
+#include "state_machine_port.h"
+
+/**
+ * \brief Queued event
+ */
+struct statem_sched_entry
+{
+    struct event event;
+
+    // 截止时间，单位：tick
+    uint32_t deadline;
+};
+
+/**
+ * \brief A machine managed by the scheduler
+ *
+ * Allocated by the user and set up by statem_sched_machine_init(). The
+ * counters may be read at any time.
+ */
+struct statem_sched_machine
+{
+    struct state_machine *fsm;
+
+    // 事件环形队列
+    struct statem_sched_entry *queue;
+    size_t queue_max;
+    size_t queue_head;
+    size_t queue_nums;
+
+    // 默认的相对截止时间，单位：tick
+    uint32_t deadline;
+
+    // 队列中最早的截止时间，即在堆中的排序键值
+    uint32_t key;
+    size_t heap_index;
+    bool heaped;
+    bool running;
+
+    // 分发的事件数和超过截止时间才分发的事件数
+    uint32_t dispatched;
+    uint32_t misses;
+};
+
+/**
+ * \brief Scheduler statistics
+ */
+struct statem_sched_stats
+{
+    uint64_t dispatched;
+    uint64_t misses;
+
+    // 最大的超时时间，单位：tick
+    uint32_t lateness_max;
+};
+
+/**
+ * \brief Scheduler
+ *
+ * There is no need to manipulate the members directly.
+ */
+struct statem_sched
+{
+    // 有事件的状态机，按最早截止时间排序的最小堆
+    struct statem_sched_machine **heap;
+    size_t heap_nums;
+    size_t heap_max;
+
+    // 已加入的状态机个数，不超过heap_max
+    size_t machine_nums;
+
+    // 每个状态机每轮最多分发的事件数
+    unsigned int budget;
+
+    statem_lock_t lock;
+
+    // 有状态机从空闲变为就绪时调用，用于唤醒工作线程
+    void (*notify)(void *ctx);
+    void *ctx;
+
+    struct statem_sched_stats stats;
+};
+
+/**
+ * \brief Initialise a scheduler
+ *
+ * \param sched the scheduler to initialise.
+ * \param machine_max maximum number of machines.
+ * \param budget events dispatched from one machine per turn, at least 1.
+ *
+ * \retval 0 on success.
+ * \retval -1 on invalid arguments or if memory could not be allocated.
+ */
+int statem_sched_init(struct statem_sched *sched, size_t machine_max, unsigned int budget);
+
+/**
+ * \brief Release the memory of a scheduler
+ */
+void statem_sched_deinit(struct statem_sched *sched);
+
+/**
+ * \brief Set the hook that wakes the workers
+ */
+void statem_sched_notify_set(struct statem_sched *sched, void (*notify)(void *ctx), void *ctx);
+
+/**
+ * \brief Add a machine to the scheduler
+ *
+ * \param machine the scheduling entry of \pn{fsm}.
+ * \param queue_max capacity of the machine's event queue.
+ * \param deadline default relative deadline of its events in ticks.
+ *
+ * \retval 0 on success.
+ * \retval -1 on invalid arguments or if memory could not be allocated.
+ */
+int statem_sched_machine_init(struct statem_sched *sched, struct statem_sched_machine *machine,
+                              struct state_machine *fsm, size_t queue_max, uint32_t deadline);
+
+/**
+ * \brief Remove a machine from the scheduler, its queued events are dropped
+ *
+ * Must not be called while a worker runs the machine.
+ */
+void statem_sched_machine_deinit(struct statem_sched *sched, struct statem_sched_machine *machine);
+
+/**
+ * \brief Queue an event with the machine's default deadline
+ *
+ * \retval 0 on success.
+ * \retval -1 on invalid arguments or if the machine's queue is full.
+ */
+int statem_sched_post(struct statem_sched *sched, struct statem_sched_machine *machine,
+                      struct event *event);
+
+/**
+ * \brief Queue an event with its own deadline
+ *
+ * \param deadline relative deadline in ticks.
+ *
+ * \retval 0 on success.
+ * \retval -1 on invalid arguments or if the machine's queue is full.
+ */
+int statem_sched_post_deadline(struct statem_sched *sched, struct statem_sched_machine *machine,
+                               struct event *event, uint32_t deadline);
+
+/**
+ * \brief Run the most urgent machine for one turn
+ *
+ * \return the number of events dispatched, 0 if no machine had events.
+ */
+int statem_sched_run_once(struct statem_sched *sched);
+
+/**
+ * \brief Get the scheduler statistics
+ */
+void statem_sched_stats_get(struct statem_sched *sched, struct statem_sched_stats *stats);
+
+#endif // __STATE_MACHINE_SCHED_H
+
+/**
+ * @}
+ */
@@ -0,0 +1,273 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "state_machine_shm.h"
+#include "state_machine_port.h"
+
+#define STATE_NONE              0xFFFFu
+
+// 等待创建者完成初始化的次数，每次1个tick
+#define ATTACH_RETRY            1000
+
+#define RECORD_PACK(version, previous, current) \
+    (((uint64_t)(version) << 32) | ((uint64_t)(previous) << 16) | (uint64_t)(current))
+#define RECORD_VERSION(word)    ((uint32_t)((word) >> 32))
+#define RECORD_PREVIOUS(word)   ((unsigned int)(((word) >> 16) & 0xFFFFu))
+#define RECORD_CURRENT(word)    ((unsigned int)((word) & 0xFFFFu))
+
+static uint16_t state_id(struct state *state)
+{
+    return state ? (uint16_t)state->id : STATE_NONE;
+}
+
+// 创建共享内存段，并将所有状态机置为初始状态
+static int segment_create(struct statem_shm *shm, int fd, uint32_t machine_nums, struct state *state_init)
+{
+    uint32_t i;
+
+    if (ftruncate(fd, (off_t)shm->size))
+    {
+        return -1;
+    }
+
+    shm->header = mmap(NULL, shm->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (shm->header == MAP_FAILED)
+    {
+        return -1;
+    }
+    shm->records = (struct statem_shm_record *)(shm->header + 1);
+
+    for (i = 0; i < machine_nums; ++i)
+    {
+        shm->records[i].state = RECORD_PACK(0, STATE_NONE, state_init->id);
+        shm->records[i].lease = 0;
+    }
+
+    shm->header->machine_nums = machine_nums;
+    shm->header->state_nums = (uint32_t)shm->graph->state_nums;
+
+    // 最后写入魔数，其他进程看到魔数即说明初始化完成
+    STATEM_ATOMIC_STORE(&shm->header->magic, STATEM_SHM_MAGIC);
+
+    return 0;
+}
+
+// 映射已有的共享内存段，并检查是否与本进程的状态图一致
+static int segment_attach(struct statem_shm *shm, int fd, uint32_t machine_nums)
+{
+    struct stat st;
+    int retry;
+
+    for (retry = 0; retry < ATTACH_RETRY; ++retry)
+    {
+        if (fstat(fd, &st))
+        {
+            return -1;
+        }
+
+        if ((size_t)st.st_size >= shm->size)
+        {
+            break;
+        }
+        STATEM_DELAY(1);
+    }
+
+    if ((size_t)st.st_size != shm->size)
+    {
+        return -1;
+    }
+
+    shm->header = mmap(NULL, shm->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (shm->header == MAP_FAILED)
+    {
+        return -1;
+    }
+    shm->records = (struct statem_shm_record *)(shm->header + 1);
+
+    for (retry = 0; retry < ATTACH_RETRY; ++retry)
+    {
+        if (STATEM_ATOMIC_LOAD(&shm->header->magic) == STATEM_SHM_MAGIC)
+        {
+            break;
+        }
+        STATEM_DELAY(1);
+    }
+
+    if (STATEM_ATOMIC_LOAD(&shm->header->magic) != STATEM_SHM_MAGIC
+        || shm->header->machine_nums != machine_nums
+        || shm->header->state_nums != shm->graph->state_nums)
+    {
+        munmap(shm->header, shm->size);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 创建或者连接共享状态机表
+ *
+ * @param shm           共享状态机表
+ * @param name          共享内存名称
+ * @param machine_nums  状态机个数
+ * @param graph         已编号的状态图
+ * @param state_init    初始状态
+ * @param state_error   错误状态
+ * @param lease_ticks   租约时长
+ * @return int          0：成功   -1：失败
+ */
+int statem_shm_open(struct statem_shm *shm, const char *name, uint32_t machine_nums,
+                    const struct statem_graph *graph, struct state *state_init,
+                    struct state *state_error, uint32_t lease_ticks)
+{
+    int fd, ret;
+
+    if (!shm || !name || !machine_nums || !graph || !state_init
+        || graph->state_nums >= STATE_NONE || statem_graph_state(graph, state_init->id) != state_init)
+    {
+        return -1;
+    }
+
+    shm->graph = graph;
+    shm->state_error = state_error;
+    shm->owner = (uint32_t)getpid();
+    shm->lease_ticks = lease_ticks;
+    shm->size = sizeof(struct statem_shm_header) + machine_nums * sizeof(struct statem_shm_record);
+
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd >= 0)
+    {
+        ret = segment_create(shm, fd, machine_nums, state_init);
+
+        // 未完成初始化的段没有魔数，其他进程只能等待超时，删除以便重新创建
+        if (ret)
+        {
+            shm_unlink(name);
+        }
+    }
+    else if (errno == EEXIST && (fd = shm_open(name, O_RDWR, 0600)) >= 0)
+    {
+        ret = segment_attach(shm, fd, machine_nums);
+    }
+    else
+    {
+        return -1;
+    }
+
+    close(fd);
+
+    return ret;
+}
+
+void statem_shm_close(struct statem_shm *shm)
+{
+    if (!shm || !shm->header)
+    {
+        return;
+    }
+
+    munmap(shm->header, shm->size);
+    shm->header = NULL;
+    shm->records = NULL;
+}
+
+int statem_shm_unlink(const char *name)
+{
+    return shm_unlink(name) ? -1 : 0;
+}
+
+// 获取租约，租约空闲或者已过期才能获取
+static int lease_acquire(struct statem_shm *shm, struct statem_shm_record *record, uint64_t *lease)
+{
+    uint64_t expected = STATEM_ATOMIC_LOAD(&record->lease);
+    uint32_t now = STATEM_TICK_GET();
+
+    if ((expected >> 32) && (int32_t)((uint32_t)expected - now) > 0)
+    {
+        return -1;
+    }
+
+    *lease = ((uint64_t)shm->owner << 32) | (uint32_t)(now + shm->lease_ticks);
+
+    return STATEM_ATOMIC_CAS(&record->lease, &expected, *lease) ? 0 : -1;
+}
+
+// 释放租约，租约已被其他进程接管时不做任何操作
+static void lease_release(struct statem_shm_record *record, uint64_t lease)
+{
+    STATEM_ATOMIC_CAS(&record->lease, &lease, 0);
+}
+
+/**
+ * @brief 共享状态机处理事件
+ *
+ * 获取租约后由共享记录还原出本地状态机，处理事件，再以一次64位CAS提交新状态
+ *
+ * @param shm       共享状态机表
+ * @param machine   状态机序号
+ * @param event     事件
+ * @return int
+ */
+int statem_shm_handle_event(struct statem_shm *shm, uint32_t machine, struct event *event)
+{
+    struct statem_shm_record *record;
+    struct state_machine fsm;
+    uint64_t lease, word, word_new;
+    int ret;
+
+    if (!shm || !shm->records || !event || machine >= shm->header->machine_nums)
+    {
+        return STATEM_ERR_ARG;
+    }
+
+    record = &shm->records[machine];
+
+    if (lease_acquire(shm, record, &lease))
+    {
+        return STATEM_SHM_BUSY;
+    }
+
+    word = STATEM_ATOMIC_LOAD(&record->state);
+
+    // 通过statem_init()初始化，查找方法等其余成员使用默认值
+    statem_init(&fsm, statem_graph_state(shm->graph, RECORD_CURRENT(word)), shm->state_error);
+    fsm.state_previous = statem_graph_state(shm->graph, RECORD_PREVIOUS(word));
+
+    ret = statem_handle_event(&fsm, event);
+
+    word_new = RECORD_PACK(RECORD_VERSION(word) + 1, state_id(fsm.state_previous), state_id(fsm.state_current));
+
+    // 状态没有变化则无需提交
+    if ((word_new & 0xFFFFFFFFu) != (word & 0xFFFFFFFFu)
+        && !STATEM_ATOMIC_CAS(&record->state, &word, word_new))
+    {
+        ret = STATEM_SHM_CONFLICT;
+    }
+
+    lease_release(record, lease);
+
+    return ret;
+}
+
+struct state *statem_shm_state_current(struct statem_shm *shm, uint32_t machine)
+{
+    if (!shm || !shm->records || machine >= shm->header->machine_nums)
+    {
+        return NULL;
+    }
+
+    return statem_graph_state(shm->graph, RECORD_CURRENT(STATEM_ATOMIC_LOAD(&shm->records[machine].state)));
+}
+
+uint32_t statem_shm_version(struct statem_shm *shm, uint32_t machine)
+{
+    if (!shm || !shm->records || machine >= shm->header->machine_nums)
+    {
+        return 0;
+    }
+
+    return RECORD_VERSION(STATEM_ATOMIC_LOAD(&shm->records[machine].state));
+}
@@ -0,0 +1,167 @@
+/**
+ * \addtogroup state_machine
+ * @{
+ *
+ * \file
+ * \brief State machine instances in POSIX shared memory
+ *
+ * The per-instance state (current state, previous state and a version
+ * counter) of a table of machines is kept in a POSIX shared-memory segment,
+ * so several worker processes can drive and take over each other's machines.
+ *
+ * The state graph itself is immutable and built into every process. Since
+ * pointers differ between address spaces, instances refer to states by the
+ * \ref state::id "ids" assigned by statem_graph_build(), which are the same
+ * in every process built from the same graph definition. The segment header
+ * records the number of states to catch processes built from a different
+ * graph.
+ *
+ * statem_shm_handle_event() takes a per-instance lease so only one process
+ * runs callbacks for a machine at a time, then commits the new state with a
+ * single 64-bit compare-and-swap of the instance record. A lease that is not
+ * released in time (for instance because its owner crashed) expires and may
+ * be taken over by another process.
+ *
+ * \note Only available on POSIX systems. Only the current and previous state
+ * are shared, each dispatch runs on a machine without a deferred buffer, so
+ * events a state lists in \ref state::deferred_types "deferred_types" are
+ * dropped as statem_handle_event() drops them without statem_defer_set().
+ */
+
+#ifndef __STATE_MACHINE_SHM_H
+#define __STATE_MACHINE_SHM_H
+
+#include <stdint.h>
+#include "state_machine.h"
+
+#define STATEM_SHM_MAGIC        0x4D48534Du     // "MSHM"
+
+/**
+ * \brief Extra statem_shm_handle_event() return values
+ */
+enum statem_shm_return_vals
+{
+    /** \brief The machine is leased by another process */
+    STATEM_SHM_BUSY = -3,
+    /**
+     * \brief The lease expired during dispatch and another process changed
+     * the machine, the result was discarded
+     */
+    STATEM_SHM_CONFLICT = -4,
+};
+
+/**
+ * \brief Segment header
+ */
+struct statem_shm_header
+{
+    uint32_t magic;
+    uint32_t machine_nums;
+    uint32_t state_nums;
+    uint32_t reserved;
+};
+
+/**
+ * \brief Per-instance record
+ *
+ * Both words are only accessed atomically.
+ */
+struct statem_shm_record
+{
+    // 版本号(高32位) | 上一个状态编号(16位) | 当前状态编号(低16位)
+    uint64_t state;
+
+    // 租约持有者(高32位，进程号，0表示空闲) | 租约到期节拍(低32位)
+    uint64_t lease;
+};
+
+/**
+ * \brief A process' view of a shared machine table
+ *
+ * There is no need to manipulate the members directly.
+ */
+struct statem_shm
+{
+    struct statem_shm_header *header;
+    struct statem_shm_record *records;
+    size_t size;
+
+    // 本进程的状态图，状态编号必须与其他进程一致
+    const struct statem_graph *graph;
+    struct state *state_error;
+
+    // 本进程的租约标识
+    uint32_t owner;
+
+    // 租约时长，单位：tick
+    uint32_t lease_ticks;
+};
+
+/**
+ * \brief Create or attach to a shared machine table
+ *
+ * The first process to open \pn{name} creates the segment and puts every
+ * machine in \pn{state_init}. Later processes attach to it and must pass the
+ * same \pn{machine_nums} and an equally numbered \pn{graph}. If the segment
+ * cannot be sized or mapped after it was created, it is removed again so
+ * that a later call can create it instead of waiting for an uninitialised
+ * table.
+ *
+ * \param shm the table to open.
+ * \param name POSIX shared-memory object name, e.g. "/post_sessions".
+ * \param machine_nums number of machines in the table.
+ * \param graph the numbered state graph.
+ * \param state_init the initial state of all machines.
+ * \param state_error the error state.
+ * \param lease_ticks how long a lease is held at most, see #STATEM_TICK_GET.
+ *
+ * \retval 0 on success.
+ * \retval -1 on failure.
+ */
+int statem_shm_open(struct statem_shm *shm, const char *name, uint32_t machine_nums,
+                    const struct statem_graph *graph, struct state *state_init,
+                    struct state *state_error, uint32_t lease_ticks);
+
+/**
+ * \brief Detach from a shared machine table
+ */
+void statem_shm_close(struct statem_shm *shm);
+
+/**
+ * \brief Remove a shared machine table
+ *
+ * The segment is freed once every process has closed it.
+ */
+int statem_shm_unlink(const char *name);
+
+/**
+ * \brief Pass an event to a shared machine
+ *
+ * \param shm the machine table.
+ * \param machine index of the machine in the table.
+ * \param event the event to be handled.
+ *
+ * \return #statem_handle_event_return_vals or #statem_shm_return_vals
+ */
+int statem_shm_handle_event(struct statem_shm *shm, uint32_t machine, struct event *event);
+
+/**
+ * \brief Get the current state of a shared machine
+ *
+ * \retval the current state.
+ * \retval NULL on invalid arguments or if the machine has no current state.
+ */
+struct state *statem_shm_state_current(struct statem_shm *shm, uint32_t machine);
+
+/**
+ * \brief Get the version of a shared machine
+ *
+ * The version is incremented by every dispatch that changed the state.
+ */
+uint32_t statem_shm_version(struct statem_shm *shm, uint32_t machine);
+
+#endif // __STATE_MACHINE_SHM_H
+
+/**
+ * @}
+ */
@@ -0,0 +1,217 @@
+#include <string.h>
+#include "state_machine_simd.h"
+#include "state_machine_port.h"
+
+#if defined(__AVX2__) && !defined(STATEM_SIMD_SCALAR)
+#include <immintrin.h>
+#define LANES                   8
+#define SIMD_AVX2               1
+#elif defined(__SSE2__) && !defined(STATEM_SIMD_SCALAR)
+#include <emmintrin.h>
+#define LANES                   4
+#else
+#define LANES                   1
+#endif
+
+// 事件类型数组的对齐字节数
+#define TYPES_ALIGN             32
+
+#define ROUND_UP(n, a)          (((n) + (a) - 1) / (a) * (a))
+
+// 没有事件类型数组的状态，按原顺序查找
+#define OFFSET_NONE             SIZE_MAX
+
+static struct transition *simd_find(void *ctx, struct state *state, struct event *event);
+
+// 状态是否有范围或通配转换，这类转换无法按相等比较
+static bool state_ranged(const struct state *state)
+{
+    size_t j;
+
+    for (j = 0; j < state->transition_nums; ++j)
+    {
+        if (state->transitions[j].event_span || state->transitions[j].event_type == STATEM_EVENT_ANY)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief 初始化SIMD查找
+ *
+ * 每个状态的事件类型补齐到向量宽度的整数倍，补齐的部分在比较结果中被屏蔽。
+ * 有范围或通配转换的状态不生成事件类型数组
+ *
+ * @param simd      SIMD查找上下文
+ * @param graph     已编号的状态图
+ * @return int      0：成功   -1：失败
+ */
+int statem_simd_init(struct statem_simd *simd, const struct statem_graph *graph)
+{
+    size_t type_nums = 0;
+    size_t i, j;
+    uint8_t *block;
+
+    if (!simd || !graph || !graph->state_nums)
+    {
+        return -1;
+    }
+
+    for (i = 0; i < graph->state_nums; ++i)
+    {
+        if (!state_ranged(graph->states[i]))
+        {
+            type_nums += ROUND_UP(graph->states[i]->transition_nums, LANES);
+        }
+    }
+
+    block = STATEM_MALLOC(graph->state_nums * sizeof(*simd->offsets) + TYPES_ALIGN
+                          + type_nums * sizeof(*simd->types));
+    if (!block)
+    {
+        return -1;
+    }
+
+    simd->memory = block;
+    simd->offsets = (size_t *)block;
+    block += graph->state_nums * sizeof(*simd->offsets);
+    simd->types = (int32_t *)ROUND_UP((uintptr_t)block, TYPES_ALIGN);
+    memset(simd->types, 0, type_nums * sizeof(*simd->types));
+
+    type_nums = 0;
+    for (i = 0; i < graph->state_nums; ++i)
+    {
+        struct state *state = graph->states[i];
+
+        if (state_ranged(state))
+        {
+            simd->offsets[i] = OFFSET_NONE;
+            continue;
+        }
+
+        simd->offsets[i] = type_nums;
+        for (j = 0; j < state->transition_nums; ++j)
+        {
+            simd->types[type_nums + j] = (int32_t)state->transitions[j].event_type;
+        }
+        type_nums += ROUND_UP(state->transition_nums, LANES);
+    }
+
+    simd->finder.find = &simd_find;
+    simd->finder.ctx = simd;
+    simd->graph = graph;
+
+    return 0;
+}
+
+void statem_simd_free(struct statem_simd *simd)
+{
+    if (!simd || !simd->memory)
+    {
+        return;
+    }
+
+    STATEM_FREE(simd->memory);
+    simd->memory = NULL;
+    simd->types = NULL;
+    simd->offsets = NULL;
+}
+
+const struct statem_finder *statem_simd_finder(struct statem_simd *simd)
+{
+    return simd ? &simd->finder : NULL;
+}
+
+#if LANES > 1
+// 比较一组事件类型，返回相等的位掩码，第k位对应types[k]
+static inline uint32_t lanes_match(const int32_t *types, int32_t type)
+{
+#ifdef SIMD_AVX2
+    __m256i v = _mm256_load_si256((const __m256i *)types);
+
+    return (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v, _mm256_set1_epi32(type))));
+#else
+    __m128i v = _mm_load_si128((const __m128i *)types);
+
+    return (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, _mm_set1_epi32(type))));
+#endif
+}
+#endif
+
+/**
+ * @brief 按向量比较事件类型，只对类型相同的转换调用guard
+ *
+ * 按位从低到高处理匹配的转换，与顺序扫描返回相同的转换
+ *
+ * @param ctx       SIMD查找上下文
+ * @param state     状态
+ * @param event     事件
+ * @return struct transition*   找到的转换，没有则返回NULL
+ */
+static struct transition *simd_find(void *ctx, struct state *state, struct event *event)
+{
+    struct statem_simd *simd = ctx;
+    const int32_t *types;
+    size_t base, i;
+
+    // 不属于该状态图或有范围转换的状态，按原顺序查找
+    if (state->id >= simd->graph->state_nums || simd->graph->states[state->id] != state
+        || simd->offsets[state->id] == OFFSET_NONE)
+    {
+        for (i = 0; i < state->transition_nums; ++i)
+        {
+            struct transition *t = &state->transitions[i];
+
+            if (statem_transition_match(t, event->type) && (!t->guard || t->guard(t->condition, event)))
+            {
+                return t;
+            }
+        }
+
+        return NULL;
+    }
+
+    types = simd->types + simd->offsets[state->id];
+
+#if LANES == 1
+    // 标量版本直接扫描连续的事件类型数组
+    (void)base;
+    for (i = 0; i < state->transition_nums; ++i)
+    {
+        struct transition *t = &state->transitions[i];
+
+        if (types[i] == (int32_t)event->type && (!t->guard || t->guard(t->condition, event)))
+        {
+            return t;
+        }
+    }
+#else
+    for (base = 0; base < state->transition_nums; base += LANES)
+    {
+        uint32_t mask = lanes_match(types + base, (int32_t)event->type);
+
+        // 屏蔽补齐的部分
+        if (state->transition_nums - base < LANES)
+        {
+            mask &= (1u << (state->transition_nums - base)) - 1;
+        }
+
+        while (mask)
+        {
+            struct transition *t = &state->transitions[base + (size_t)__builtin_ctz(mask)];
+
+            if (!t->guard || t->guard(t->condition, event))
+            {
+                return t;
+            }
+
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    return NULL;
+}
@@ -0,0 +1,92 @@
+/**
+ * \addtogroup state_machine
+ * @{
+ *
+ * \file
+ * \brief Vectorised event type scan over a structure-of-arrays layout
+ *
+ * The default lookup reads the \ref transition::event_type "event_type" of
+ * one transition at a time, each from a different 40-byte structure. For
+ * states with many transitions, e.g. a protocol parser that handles dozens
+ * of message types, most of that work is spent on transitions that cannot
+ * match. A SIMD finder keeps a copy of the event types of every state in one
+ * contiguous, aligned int32 array and compares eight (AVX2) or four (SSE2)
+ * of them with a single instruction. Guards are then called only for the
+ * lanes whose type matched, in array order, so the first accepted
+ * transition is the one the default scan returns. States with \ref
+ * transition::event_span "ranged" or #STATEM_EVENT_ANY transitions keep the
+ * default scan.
+ *
+ * The instruction set is chosen at compile time from the compiler's target
+ * flags (`-mavx2`, SSE2 is the x86-64 baseline); other targets use a
+ * scalar scan of the same contiguous array. Define `STATEM_SIMD_SCALAR`
+ * to force the scalar version. There is no run-time CPU detection, so a
+ * default x86-64 build always uses SSE2 and never AVX2, even on a CPU
+ * that has it; build with `-mavx2` or `-march=native` to use AVX2.
+ * tests/simd_bench.c measures 8, 64 and 512 transitions per state.
+ *
+ * ~~~{.c}
+ * statem_graph_build(&graph, states, STATE_MAX, &state_idle, &state_error);
+ * statem_simd_init(&simd, &graph);
+ * statem_init(&m, &state_idle, &state_error);
+ * statem_finder_set(&m, statem_simd_finder(&simd));
+ * ~~~
+ *
+ * \note The finder only reads its tables, so any number of machines and
+ * threads may share it. Rebuild it if the graph's transitions change.
+ */
+
+#ifndef __STATE_MACHINE_SIMD_H
+#define __STATE_MACHINE_SIMD_H
+
+#include <stdint.h>
+#include "state_machine.h"
+
+/**
+ * \brief SIMD finder context
+ *
+ * There is no need to manipulate the members directly.
+ */
+struct statem_simd
+{
+    struct statem_finder finder;
+    const struct statem_graph *graph;
+
+    // 所有状态的事件类型，每个状态的起始位置按向量宽度对齐
+    int32_t *types;
+
+    // 每个状态的事件类型在types中的起始下标，下标为状态编号
+    size_t *offsets;
+
+    // 分配的内存，types按32字节对齐后位于其中
+    void *memory;
+};
+
+/**
+ * \brief Build the event type arrays of a numbered graph
+ *
+ * \param simd the context to initialise.
+ * \param graph a graph numbered by statem_graph_build().
+ *
+ * \retval 0 on success.
+ * \retval -1 on invalid arguments or if memory could not be allocated.
+ */
+int statem_simd_init(struct statem_simd *simd, const struct statem_graph *graph);
+
+/**
+ * \brief Release the memory of a SIMD finder
+ *
+ * No machine may use the finder any more.
+ */
+void statem_simd_free(struct statem_simd *simd);
+
+/**
+ * \brief Get the finder to pass to statem_finder_set()
+ */
+const struct statem_finder *statem_simd_finder(struct statem_simd *simd);
+
+#endif // __STATE_MACHINE_SIMD_H
+
+/**
+ * @}
+ */
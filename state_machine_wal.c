@@ -0,0 +1,642 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "state_machine_wal.h"
+#include "state_machine_port.h"
+
+// 没有当前状态
+#define STATE_NONE              UINT32_MAX
+
+#define WAL_KIND(kind)          ((STATEM_WAL_MAGIC << 8) | (uint32_t)(kind))
+
+// 扫描日志时每次读取的记录数
+#define WAL_SCAN_BATCH          256
+
+// FNV-1a校验，不包括check字段
+static uint32_t record_check(const struct statem_wal_record *record)
+{
+    const uint8_t *p = (const uint8_t *)record;
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < sizeof(*record); ++i)
+    {
+        if (i >= offsetof(struct statem_wal_record, check)
+            && i < offsetof(struct statem_wal_record, check) + sizeof(record->check))
+        {
+            continue;
+        }
+
+        hash = (hash ^ p[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+static bool record_valid(const struct statem_wal_record *record, uint64_t lsn_prev)
+{
+    return (record->kind >> 8) == STATEM_WAL_MAGIC
+        && (lsn_prev == 0 || record->lsn == lsn_prev + 1)
+        && record->check == record_check(record);
+}
+
+/**
+ * @brief 按顺序扫描日志中的有效记录
+ *
+ * 遇到不完整或者校验失败的记录时停止，之后的内容视为崩溃时未写完的部分
+ *
+ * @param fd        日志文件
+ * @param visit     每条有效记录的回调，返回非0停止扫描
+ * @param ctx       回调参数
+ * @param length    有效部分的长度
+ * @param lsn_last  最后一条有效记录的序号
+ * @return int      0：成功   -1：失败
+ */
+static int wal_scan(int fd, int (*visit)(void *ctx, const struct statem_wal_record *record), void *ctx,
+                    off_t *length, uint64_t *lsn_last)
+{
+    struct statem_wal_record records[WAL_SCAN_BATCH];
+    uint64_t lsn = 0;
+    off_t offset = 0;
+    ssize_t size;
+
+    if (lseek(fd, 0, SEEK_SET) < 0)
+    {
+        return -1;
+    }
+
+    while ((size = read(fd, records, sizeof(records))) > 0)
+    {
+        size_t i, nums = (size_t)size / sizeof(records[0]);
+
+        for (i = 0; i < nums; ++i)
+        {
+            if (!record_valid(&records[i], lsn))
+            {
+                goto done;
+            }
+
+            lsn = records[i].lsn;
+            offset += (off_t)sizeof(records[i]);
+
+            if (visit && visit(ctx, &records[i]))
+            {
+                goto done;
+            }
+        }
+
+        // 末尾不足一条记录
+        if ((size_t)size % sizeof(records[0]))
+        {
+            break;
+        }
+    }
+
+    if (size < 0)
+    {
+        return -1;
+    }
+
+done:
+    if (length)
+    {
+        *length = offset;
+    }
+
+    if (lsn_last)
+    {
+        *lsn_last = lsn;
+    }
+
+    return 0;
+}
+
+// 写入全部数据
+static int write_all(int fd, const void *buffer, size_t size)
+{
+    const uint8_t *p = buffer;
+
+    while (size)
+    {
+        ssize_t ret = write(fd, p, size);
+
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+
+        p += ret;
+        size -= (size_t)ret;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 同步文件所在的目录
+ *
+ * 新建的文件只有在目录项落盘后才能在崩溃后找到，否则其中已经fdatasync()的记录会随文件一起丢失
+ *
+ * @param path  文件路径
+ * @return int  0：成功   -1：失败
+ */
+static int dir_sync(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    char *dir;
+    size_t len;
+    int fd, ret;
+
+    if (!slash)
+    {
+        fd = open(".", O_RDONLY | O_DIRECTORY);
+    }
+    else
+    {
+        len = (slash == path) ? 1 : (size_t)(slash - path);
+        dir = STATEM_MALLOC(len + 1);
+        if (!dir)
+        {
+            return -1;
+        }
+        memcpy(dir, path, len);
+        dir[len] = '\0';
+
+        fd = open(dir, O_RDONLY | O_DIRECTORY);
+        STATEM_FREE(dir);
+    }
+
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    ret = fsync(fd);
+    close(fd);
+
+    return ret ? -1 : 0;
+}
+
+/**
+ * @brief 刷写线程
+ *
+ * 第一条记录到达后等待提交窗口结束或者缓冲区写满，然后交换缓冲区，
+ * 在锁外写入并执行一次fdatasync，期间到达的记录进入下一批
+ *
+ * @param parameter 日志
+ * @return void*
+ */
+static void *wal_thread(void *parameter)
+{
+    struct statem_wal *wal = parameter;
+
+    pthread_mutex_lock(&wal->lock);
+
+    while (wal->running || wal->buffer_nums)
+    {
+        struct statem_wal_record *buffer;
+        struct timespec deadline;
+        uint64_t lsn;
+        size_t nums;
+        int ret;
+
+        if (!wal->buffer_nums)
+        {
+            pthread_cond_wait(&wal->cond_flush, &wal->lock);
+            continue;
+        }
+
+        if (wal->window)
+        {
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += wal->window / 1000;
+            deadline.tv_nsec += (long)(wal->window % 1000) * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L)
+            {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+
+            while (wal->running && wal->buffer_nums < wal->capacity)
+            {
+                if (pthread_cond_timedwait(&wal->cond_flush, &wal->lock, &deadline) == ETIMEDOUT)
+                {
+                    break;
+                }
+            }
+        }
+
+        buffer = wal->buffers[wal->active];
+        nums = wal->buffer_nums;
+        lsn = wal->lsn;
+        wal->active ^= 1;
+        wal->buffer_nums = 0;
+
+        // 缓冲区已空出，唤醒等待空间的写入者
+        pthread_cond_broadcast(&wal->cond_done);
+        pthread_mutex_unlock(&wal->lock);
+
+        ret = write_all(wal->fd, buffer, nums * sizeof(*buffer));
+        if (!ret)
+        {
+            ret = fdatasync(wal->fd);
+        }
+
+        pthread_mutex_lock(&wal->lock);
+
+        if (ret)
+        {
+            wal->failed = true;
+        }
+        else
+        {
+            wal->lsn_durable = lsn;
+            wal->syncs++;
+            wal->records += nums;
+        }
+
+        pthread_cond_broadcast(&wal->cond_done);
+    }
+
+    pthread_mutex_unlock(&wal->lock);
+
+    return NULL;
+}
+
+/**
+ * @brief 打开日志并启动刷写线程
+ *
+ * @param wal       日志
+ * @param path      日志文件
+ * @param graph     已编号的状态图
+ * @param window    组提交窗口，单位：ms
+ * @param capacity  每批的记录数
+ * @return int      0：成功   -1：失败
+ */
+int statem_wal_open(struct statem_wal *wal, const char *path, const struct statem_graph *graph,
+                    uint32_t window, size_t capacity)
+{
+    off_t length;
+
+    if (!wal || !path || !graph || !capacity)
+    {
+        return -1;
+    }
+
+    memset(wal, 0, sizeof(*wal));
+    wal->graph = graph;
+    wal->window = window;
+    wal->capacity = capacity;
+
+    // 新建日志时同步目录，日志文件本身不会因崩溃而消失
+    wal->fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (wal->fd >= 0)
+    {
+        if (dir_sync(path))
+        {
+            close(wal->fd);
+            unlink(path);
+            return -1;
+        }
+    }
+    else if (errno == EEXIST)
+    {
+        wal->fd = open(path, O_RDWR);
+    }
+
+    if (wal->fd < 0)
+    {
+        return -1;
+    }
+
+    // 接着最后一条有效记录写，截掉崩溃时未写完的部分
+    if (wal_scan(wal->fd, NULL, NULL, &length, &wal->lsn) || ftruncate(wal->fd, length)
+        || lseek(wal->fd, length, SEEK_SET) < 0)
+    {
+        close(wal->fd);
+        return -1;
+    }
+    wal->lsn_durable = wal->lsn;
+
+    wal->buffers[0] = STATEM_MALLOC(2 * capacity * sizeof(*wal->buffers[0]));
+    if (!wal->buffers[0])
+    {
+        close(wal->fd);
+        return -1;
+    }
+    wal->buffers[1] = wal->buffers[0] + capacity;
+
+    pthread_mutex_init(&wal->lock, NULL);
+    pthread_cond_init(&wal->cond_flush, NULL);
+    pthread_cond_init(&wal->cond_done, NULL);
+    wal->running = true;
+
+    if (pthread_create(&wal->thread, NULL, &wal_thread, wal))
+    {
+        pthread_cond_destroy(&wal->cond_done);
+        pthread_cond_destroy(&wal->cond_flush);
+        pthread_mutex_destroy(&wal->lock);
+        STATEM_FREE(wal->buffers[0]);
+        close(wal->fd);
+        return -1;
+    }
+
+    return 0;
+}
+
+int statem_wal_close(struct statem_wal *wal)
+{
+    bool failed;
+
+    if (!wal || !wal->buffers[0])
+    {
+        return -1;
+    }
+
+    pthread_mutex_lock(&wal->lock);
+    wal->running = false;
+    pthread_cond_signal(&wal->cond_flush);
+    pthread_mutex_unlock(&wal->lock);
+
+    pthread_join(wal->thread, NULL);
+
+    failed = wal->failed;
+    pthread_cond_destroy(&wal->cond_done);
+    pthread_cond_destroy(&wal->cond_flush);
+    pthread_mutex_destroy(&wal->lock);
+    STATEM_FREE(wal->buffers[0]);
+    wal->buffers[0] = wal->buffers[1] = NULL;
+    close(wal->fd);
+
+    return failed ? -1 : 0;
+}
+
+/**
+ * @brief 追加一条记录，调用者持有锁
+ *
+ * 缓冲区已满时等待刷写线程交换缓冲区
+ *
+ * @return uint64_t 记录的序号，0：日志已失败
+ */
+static uint64_t wal_append_locked(struct statem_wal *wal, enum statem_wal_kind kind, uint64_t machine_id,
+                                  int32_t event_type, uint32_t state_id)
+{
+    struct statem_wal_record *record;
+
+    while (wal->buffer_nums == wal->capacity && !wal->failed)
+    {
+        pthread_cond_wait(&wal->cond_done, &wal->lock);
+    }
+
+    if (wal->failed)
+    {
+        return 0;
+    }
+
+    record = &wal->buffers[wal->active][wal->buffer_nums++];
+    record->kind = WAL_KIND(kind);
+    record->machine_id = machine_id;
+    record->lsn = ++wal->lsn;
+    record->event_type = event_type;
+    record->state_id = state_id;
+    record->check = record_check(record);
+
+    // 新一批的第一条记录开始计时，缓冲区写满立即刷写
+    if (wal->buffer_nums == 1 || wal->buffer_nums == wal->capacity)
+    {
+        pthread_cond_signal(&wal->cond_flush);
+    }
+
+    return record->lsn;
+}
+
+static uint32_t state_id_get(struct state_machine *fsm)
+{
+    struct state *state = statem_state_current(fsm);
+
+    return state ? state->id : STATE_NONE;
+}
+
+int statem_wal_handle_event(struct statem_wal *wal, uint64_t machine_id,
+                            struct state_machine *fsm, struct event *event)
+{
+    int ret;
+
+    if (!wal || !wal->buffers[0])
+    {
+        return STATEM_ERR_ARG;
+    }
+
+    ret = statem_handle_event(fsm, event);
+
+    // 没有被状态机接受的事件不影响状态，无需记录
+    if (ret == STATEM_STATE_NOCHANGE || ret == STATEM_ERR_ARG)
+    {
+        return ret;
+    }
+
+    pthread_mutex_lock(&wal->lock);
+    if (!wal_append_locked(wal, STATEM_WAL_EVENT, machine_id, event->type, state_id_get(fsm)))
+    {
+        // 状态已经改变但无法持久化，不能让调用者当作成功处理
+        ret = STATEM_WAL_FAILED;
+    }
+    pthread_mutex_unlock(&wal->lock);
+
+    return ret;
+}
+
+/**
+ * @brief 记录一组状态机的当前状态
+ *
+ * 快照以开始记录和结束记录包围，结束记录保存开始记录的序号，
+ * 恢复时只有完整的快照才会被使用。恢复跳过快照之前的所有记录，
+ * 因此快照必须包含所有存活的状态机
+ *
+ * @param wal           日志
+ * @param nums          状态机个数
+ * @param machine_ids   状态机编号
+ * @param machines      状态机
+ * @return int          0：成功   -1：失败
+ */
+int statem_wal_snapshot(struct statem_wal *wal, size_t nums, const uint64_t *machine_ids,
+                        struct state_machine *const *machines)
+{
+    uint64_t lsn_begin;
+    size_t i;
+    int ret = -1;
+
+    if (!wal || !wal->buffers[0] || (nums && (!machine_ids || !machines)))
+    {
+        return -1;
+    }
+
+    pthread_mutex_lock(&wal->lock);
+
+    lsn_begin = wal_append_locked(wal, STATEM_WAL_SNAPSHOT_BEGIN, 0, 0, 0);
+    if (!lsn_begin)
+    {
+        goto out;
+    }
+
+    for (i = 0; i < nums; ++i)
+    {
+        if (!wal_append_locked(wal, STATEM_WAL_SNAPSHOT_STATE, machine_ids[i], 0, state_id_get(machines[i])))
+        {
+            goto out;
+        }
+    }
+
+    if (wal_append_locked(wal, STATEM_WAL_SNAPSHOT_END, lsn_begin, 0, 0))
+    {
+        ret = 0;
+    }
+
+out:
+    pthread_mutex_unlock(&wal->lock);
+
+    return ret;
+}
+
+uint64_t statem_wal_lsn(struct statem_wal *wal)
+{
+    uint64_t lsn;
+
+    if (!wal || !wal->buffers[0])
+    {
+        return 0;
+    }
+
+    pthread_mutex_lock(&wal->lock);
+    lsn = wal->lsn;
+    pthread_mutex_unlock(&wal->lock);
+
+    return lsn;
+}
+
+int statem_wal_wait(struct statem_wal *wal, uint64_t lsn)
+{
+    bool failed;
+
+    if (!wal || !wal->buffers[0])
+    {
+        return -1;
+    }
+
+    pthread_mutex_lock(&wal->lock);
+
+    while (wal->lsn_durable < lsn && !wal->failed)
+    {
+        pthread_cond_wait(&wal->cond_done, &wal->lock);
+    }
+    failed = wal->failed;
+
+    pthread_mutex_unlock(&wal->lock);
+
+    return failed ? -1 : 0;
+}
+
+struct wal_recovery
+{
+    const struct statem_graph *graph;
+    struct state_machine *(*machine_get)(void *ctx, uint64_t machine_id);
+    void *ctx;
+
+    // 最后一个完整快照的开始序号
+    uint64_t lsn_begin;
+    int applied;
+    bool invalid;
+};
+
+// 第一遍：查找最后一个完整的快照
+static int recovery_find_snapshot(void *ctx, const struct statem_wal_record *record)
+{
+    struct wal_recovery *recovery = ctx;
+
+    if ((record->kind & 0xFF) == STATEM_WAL_SNAPSHOT_END)
+    {
+        recovery->lsn_begin = record->machine_id;
+    }
+
+    return 0;
+}
+
+// 第二遍：从快照开始恢复每个状态机的状态
+static int recovery_apply(void *ctx, const struct statem_wal_record *record)
+{
+    struct wal_recovery *recovery = ctx;
+    uint32_t kind = record->kind & 0xFF;
+    struct state_machine *fsm;
+    struct state *state = NULL;
+
+    if (record->lsn < recovery->lsn_begin || (kind != STATEM_WAL_EVENT && kind != STATEM_WAL_SNAPSHOT_STATE))
+    {
+        return 0;
+    }
+
+    if (record->state_id != STATE_NONE)
+    {
+        state = statem_graph_state(recovery->graph, record->state_id);
+        if (!state)
+        {
+            recovery->invalid = true;
+            return -1;
+        }
+    }
+
+    fsm = recovery->machine_get(recovery->ctx, record->machine_id);
+    if (fsm)
+    {
+        fsm->state_previous = NULL;
+        fsm->state_current = state;
+        statem_publish(fsm);
+        recovery->applied++;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 从日志恢复状态机
+ *
+ * @param path          日志文件
+ * @param graph         已编号的状态图
+ * @param machine_get   按编号获取状态机
+ * @param ctx           回调参数
+ * @return int          应用的记录数，-1：失败
+ */
+int statem_wal_recover(const char *path, const struct statem_graph *graph,
+                       struct state_machine *(*machine_get)(void *ctx, uint64_t machine_id),
+                       void *ctx)
+{
+    struct wal_recovery recovery = { graph, machine_get, ctx, 0, 0, false };
+    int fd, ret;
+
+    if (!path || !graph || !machine_get)
+    {
+        return -1;
+    }
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    ret = wal_scan(fd, &recovery_find_snapshot, &recovery, NULL, NULL);
+    if (!ret)
+    {
+        ret = wal_scan(fd, &recovery_apply, &recovery, NULL, NULL);
+    }
+
+    close(fd);
+
+    return (ret || recovery.invalid) ? -1 : recovery.applied;
+}
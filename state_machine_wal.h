@@ -0,0 +1,224 @@
+/**
+ * \addtogroup state_machine
+ * @{
+ *
+ * \file
+ * \brief Write-ahead event log with group commit
+ *
+ * statem_wal_handle_event() dispatches an event and, if the machine accepted
+ * it, appends the machine id, the event type and the \ref state::id "id" of
+ * the resulting state to an in-memory batch. A flusher thread writes the
+ * batch to the log file and makes it durable with a single fdatasync(), so
+ * the cost of a sync is shared by every event of the batch (group commit).
+ *
+ * The flusher waits up to the commit window after the first record of a
+ * batch arrives before syncing, or less if the batch fills up. A longer
+ * window gives larger batches and more events per second, a shorter one
+ * lower commit latency. Callers that must not acknowledge an event before it
+ * is durable wait with statem_wal_wait().
+ *
+ * statem_wal_snapshot() appends the current state of every live machine.
+ * statem_wal_recover() starts from the last complete snapshot and applies
+ * the records that follow it, restoring the state of every machine without
+ * running any callback. Everything before that snapshot is skipped, so a
+ * snapshot must list all live machines: one that is left out and has no
+ * later event is not restored. Records carry a checksum; a torn tail left by a
+ * crash is ignored by recovery and cut off by statem_wal_open().
+ *
+ * ~~~{.c}
+ * statem_wal_recover("machines.wal", &graph, &machine_get, NULL);
+ * statem_wal_open(&wal, "machines.wal", &graph, 2, 4096);
+ *
+ * ret = statem_wal_handle_event(&wal, session_id, fsm, &event);
+ * statem_wal_wait(&wal, statem_wal_lsn(&wal));
+ * ~~~
+ *
+ * \note Only available on POSIX systems. The log grows until it is removed
+ * by the user; a snapshot only shortens recovery. Only states are logged, not
+ * the contents of \ref statem_defer_set() "deferred buffers": an event
+ * answered with #STATEM_EVENT_DEFERRED is logged with the unchanged state and
+ * is lost if the process crashes before it is replayed.
+ */
+
+#ifndef __STATE_MACHINE_WAL_H
+#define __STATE_MACHINE_WAL_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include "state_machine.h"
+
+#define STATEM_WAL_MAGIC        0x4C4157u       // "WAL"
+
+/**
+ * \brief Extra statem_wal_handle_event() return values
+ */
+enum statem_wal_return_vals
+{
+    /**
+     * \brief The machine handled the event but the log has failed
+     *
+     * The new state will not be recovered. Every later event fails the same
+     * way.
+     */
+    STATEM_WAL_FAILED = -3,
+};
+
+/**
+ * \brief Record kinds
+ */
+enum statem_wal_kind
+{
+    STATEM_WAL_EVENT = 1,
+    STATEM_WAL_SNAPSHOT_BEGIN,
+    STATEM_WAL_SNAPSHOT_STATE,
+    STATEM_WAL_SNAPSHOT_END,
+};
+
+/**
+ * \brief Log record
+ */
+struct statem_wal_record
+{
+    // 高24位为STATEM_WAL_MAGIC，低8位为记录类型
+    uint32_t kind;
+
+    // 除本字段外其它字段的校验值
+    uint32_t check;
+
+    // 状态机编号，快照结束记录中为快照开始记录的序号
+    uint64_t machine_id;
+
+    // 日志序号，从1开始连续递增
+    uint64_t lsn;
+
+    int32_t event_type;
+    uint32_t state_id;
+};
+
+/**
+ * \brief Write-ahead log
+ *
+ * There is no need to manipulate the members directly.
+ */
+struct statem_wal
+{
+    int fd;
+    const struct statem_graph *graph;
+
+    // 双缓冲：一个接收新记录，另一个正在写入文件
+    struct statem_wal_record *buffers[2];
+    size_t buffer_nums;
+    size_t capacity;
+    unsigned int active;
+
+    // 最后分配的序号和已经持久化的序号
+    uint64_t lsn;
+    uint64_t lsn_durable;
+
+    // 组提交窗口，单位：ms
+    uint32_t window;
+
+    bool running;
+    bool failed;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond_flush;
+    pthread_cond_t cond_done;
+    pthread_t thread;
+
+    // 统计：fdatasync次数和写入的记录数
+    uint64_t syncs;
+    uint64_t records;
+};
+
+/**
+ * \brief Open a log for appending and start its flusher thread
+ *
+ * An existing log is continued; a torn record at its end is cut off. A new
+ * log is created and its directory synced, so that the file itself, and
+ * every record synced into it, survives a crash.
+ *
+ * \param wal the log to open.
+ * \param path the log file.
+ * \param graph the numbered graph of the machines that are logged.
+ * \param window the group commit window in milliseconds, 0 to sync as soon
+ * as the previous sync completes.
+ * \param capacity number of records per batch.
+ *
+ * \retval 0 on success.
+ * \retval -1 on invalid arguments or on failure.
+ */
+int statem_wal_open(struct statem_wal *wal, const char *path, const struct statem_graph *graph,
+                    uint32_t window, size_t capacity);
+
+/**
+ * \brief Flush the pending records, stop the flusher thread and close the log
+ *
+ * \retval 0 on success.
+ * \retval -1 if any record could not be made durable.
+ */
+int statem_wal_close(struct statem_wal *wal);
+
+/**
+ * \brief Pass an event to a machine and log the result
+ *
+ * The event is logged unless the machine returned #STATEM_STATE_NOCHANGE or
+ * #STATEM_ERR_ARG. The call does not wait for the record to be durable.
+ *
+ * \param machine_id the id the machine is recovered under.
+ *
+ * \return #statem_handle_event_return_vals, or #STATEM_WAL_FAILED if the
+ * event changed the machine but could not be logged.
+ */
+int statem_wal_handle_event(struct statem_wal *wal, uint64_t machine_id,
+                            struct state_machine *fsm, struct event *event);
+
+/**
+ * \brief Log the current state of all live machines
+ *
+ * Recovery skips every record before the last complete snapshot, so
+ * \pn{machines} must contain every machine that is to be recovered, not a
+ * subset. None of the machines may handle an event during the call.
+ *
+ * \retval 0 on success.
+ * \retval -1 on invalid arguments or if the log has failed.
+ */
+int statem_wal_snapshot(struct statem_wal *wal, size_t nums, const uint64_t *machine_ids,
+                        struct state_machine *const *machines);
+
+/**
+ * \brief Get the sequence number of the last appended record
+ */
+uint64_t statem_wal_lsn(struct statem_wal *wal);
+
+/**
+ * \brief Wait until every record up to a sequence number is durable
+ *
+ * \retval 0 on success.
+ * \retval -1 if the log has failed.
+ */
+int statem_wal_wait(struct statem_wal *wal, uint64_t lsn);
+
+/**
+ * \brief Restore machines from a log
+ *
+ * The records from the last complete snapshot on are applied in order. The
+ * current state of each machine is set directly, no callback runs.
+ *
+ * \param path the log file.
+ * \param graph the numbered graph the log was written with.
+ * \param machine_get returns the machine for an id, or NULL to skip it.
+ * \param ctx argument passed to \pn{machine_get}.
+ *
+ * \return the number of records applied, or -1 if the log could not be read
+ * or refers to states that are not in \pn{graph}.
+ */
+int statem_wal_recover(const char *path, const struct statem_graph *graph,
+                       struct state_machine *(*machine_get)(void *ctx, uint64_t machine_id),
+                       void *ctx);
+
+#endif // __STATE_MACHINE_WAL_H
+
+/**
+ * @}
+ */
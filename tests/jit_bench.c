@@ -0,0 +1,265 @@
+/**
+ * JIT分发性能测试
+ *
+ * 在示例状态图（state_machine_example.c的按键图和post_state.c的post图）上
+ * 分别用statem_handle_event()和编译后的分发函数处理同一串事件，先比较两者的
+ * 结果和状态是否一致，再比较每个事件的平均时间
+ *
+ * 在本目录下编译运行：
+ * cc -O2 -I.. jit_bench.c ../state_machine.c ../state_machine_jit.c -ldl -lpthread
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include "state_machine_jit.h"
+#include "state_machine_port.h"
+
+#define EVENTS          10000000
+#define CHECKS          300000
+#define STATE_MAX       16
+
+enum
+{
+    EVENT_KEYBOARD,
+};
+
+enum
+{
+    EVENT_POST_NULL,
+    EVENT_POST_START,
+    EVENT_POST_BREAKON,
+    EVENT_POST_BREAKOFF,
+    EVENT_POST_ANSWER,
+};
+
+static volatile unsigned int actions;
+
+static bool key_guard(void *ch, struct event *event)
+{
+    return event->type == EVENT_KEYBOARD && (intptr_t)ch == (intptr_t)event->data;
+}
+
+static bool answer_guard(void *condition, struct event *event)
+{
+    return event->type == EVENT_POST_ANSWER && (intptr_t)event->data == (intptr_t)condition;
+}
+
+static void action(void *oldstate_data, struct event *event, void *state_new_data)
+{
+    (void)oldstate_data;
+    (void)event;
+    (void)state_new_data;
+    actions++;
+}
+
+static void enter(void *state_data, struct event *event)
+{
+    (void)state_data;
+    (void)event;
+    actions++;
+}
+
+// 按键图，与state_machine_example.c相同，回调只计数
+static struct state key_group, key_idle, key_h, key_i, key_a, key_error;
+
+static struct state key_group = {
+    .state_entry = &key_idle,
+    .transitions = (struct transition[]){
+        {EVENT_KEYBOARD, (void *)(intptr_t)'!', &key_guard, &action, &key_idle},
+        {EVENT_KEYBOARD, NULL, NULL, &action, &key_idle},
+    },
+    .transition_nums = 2,
+    .action_entry = &enter,
+    .action_exti = &enter,
+};
+
+static struct state key_idle = {
+    .state_parent = &key_group,
+    .transitions = (struct transition[]){
+        {EVENT_KEYBOARD, (void *)(intptr_t)'h', &key_guard, NULL, &key_h},
+    },
+    .transition_nums = 1,
+    .action_entry = &enter,
+    .action_exti = &enter,
+};
+
+static struct state key_h = {
+    .state_parent = &key_group,
+    .transitions = (struct transition[]){
+        {EVENT_KEYBOARD, (void *)(intptr_t)'a', &key_guard, NULL, &key_a},
+        {EVENT_KEYBOARD, (void *)(intptr_t)'i', &key_guard, NULL, &key_i},
+    },
+    .transition_nums = 2,
+    .action_entry = &enter,
+    .action_exti = &enter,
+};
+
+static struct state key_i = {
+    .state_parent = &key_group,
+    .transitions = (struct transition[]){
+        {EVENT_KEYBOARD, (void *)(intptr_t)'n', &key_guard, &action, &key_idle},
+    },
+    .transition_nums = 1,
+    .action_entry = &enter,
+    .action_exti = &enter,
+};
+
+static struct state key_a = {
+    .state_parent = &key_group,
+    .transitions = (struct transition[]){
+        {EVENT_KEYBOARD, (void *)(intptr_t)'n', &key_guard, &action, &key_idle},
+    },
+    .transition_nums = 1,
+    .action_entry = &enter,
+    .action_exti = &enter,
+};
+
+static struct state key_error = {
+    .transitions = (struct transition[]){
+        {EVENT_KEYBOARD, (void *)(intptr_t)'i', &key_guard, NULL, &key_i},
+    },
+    .transition_nums = 1,
+    .action_entry = &enter,
+};
+
+// post图，与post_state.c相同，去掉了事件延迟，pass和fail加上START转换以便反复测试
+static struct state post_root, post_post, post_pass, post_fail, post_break, post_error;
+
+static struct state post_root = {
+    .transitions = (struct transition[]){
+        {EVENT_POST_START, NULL, NULL, NULL, &post_post},
+    },
+    .transition_nums = 1,
+    .action_entry = &enter,
+    .action_exti = &enter,
+};
+
+static struct state post_post = {
+    .transitions = (struct transition[]){
+        {EVENT_POST_BREAKON, NULL, NULL, &action, &post_break},
+        {EVENT_POST_ANSWER, (void *)1, &answer_guard, &action, &post_fail},
+        {EVENT_POST_ANSWER, (void *)2, &answer_guard, &action, &post_pass},
+    },
+    .transition_nums = 3,
+    .action_entry = &enter,
+    .action_exti = &enter,
+};
+
+static struct state post_pass = {
+    .transitions = (struct transition[]){
+        {EVENT_POST_START, NULL, NULL, NULL, &post_post},
+    },
+    .transition_nums = 1,
+    .action_entry = &enter,
+    .action_exti = &enter,
+};
+
+static struct state post_fail = {
+    .transitions = (struct transition[]){
+        {EVENT_POST_START, NULL, NULL, NULL, &post_post},
+    },
+    .transition_nums = 1,
+    .action_entry = &enter,
+    .action_exti = &enter,
+};
+
+static struct state post_break = {
+    .transitions = (struct transition[]){
+        {EVENT_POST_BREAKOFF, NULL, NULL, NULL, &post_post},
+    },
+    .transition_nums = 1,
+    .action_entry = &enter,
+    .action_exti = &enter,
+};
+
+static struct state post_error = {
+    .action_entry = &enter,
+};
+
+static unsigned int random_next(unsigned int *seed)
+{
+    *seed = *seed * 1103515245u + 12345u;
+
+    return *seed >> 8;
+}
+
+static void key_event(unsigned int r, struct event *event)
+{
+    static const char keys[] = "hain!xz";
+
+    event->type = EVENT_KEYBOARD;
+    event->data = (void *)(intptr_t)keys[r % (sizeof(keys) - 1)];
+}
+
+static void post_event(unsigned int r, struct event *event)
+{
+    static const int types[] = {EVENT_POST_START, EVENT_POST_BREAKON, EVENT_POST_BREAKOFF, EVENT_POST_ANSWER};
+
+    event->type = types[r % 4];
+    event->data = (void *)(intptr_t)(1 + (r >> 4) % 2);
+}
+
+static int bench(const char *name, struct state *state_init, struct state *state_error,
+                 void (*event_get)(unsigned int r, struct event *event))
+{
+    struct state *states[STATE_MAX];
+    struct statem_graph graph;
+    struct state_machine m1, m2;
+    struct statem_jit jit;
+    struct event event;
+    unsigned int seed = 1;
+    uint64_t t0, t1, t2;
+    size_t bad = 0;
+    long i;
+
+    if (statem_graph_build(&graph, states, STATE_MAX, state_init, state_error)
+        || statem_jit_init(&jit, &graph, NULL, "..") || statem_jit_compile(&jit))
+    {
+        printf("%s: compile failed\n", name);
+        return 1;
+    }
+
+    statem_init(&m1, state_init, state_error);
+    statem_init(&m2, state_init, state_error);
+
+    for (i = 0; i < CHECKS; ++i)
+    {
+        event_get(random_next(&seed), &event);
+        if (statem_handle_event(&m1, &event) != statem_jit_handle_event(&jit, &m2, &event)
+            || m1.state_current != m2.state_current)
+        {
+            bad++;
+        }
+    }
+
+    t0 = STATEM_CLOCK_GET();
+    for (i = 0; i < EVENTS; ++i)
+    {
+        event_get(random_next(&seed), &event);
+        statem_handle_event(&m1, &event);
+    }
+
+    t1 = STATEM_CLOCK_GET();
+    for (i = 0; i < EVENTS; ++i)
+    {
+        event_get(random_next(&seed), &event);
+        statem_jit_handle_event(&jit, &m2, &event);
+    }
+    t2 = STATEM_CLOCK_GET();
+
+    printf("%-8s mismatches %zu, statem_handle_event %.2f ns, jit %.2f ns, speedup %.2fx\n", name, bad,
+           (double)(t1 - t0) / EVENTS, (double)(t2 - t1) / EVENTS, (double)(t1 - t0) / (double)(t2 - t1));
+
+    statem_jit_free(&jit);
+
+    return bad ? 1 : 0;
+}
+
+int main(void)
+{
+    int ret = 0;
+
+    ret |= bench("keyboard", &key_idle, &key_error, &key_event);
+    ret |= bench("post", &post_root, &post_error, &post_event);
+
+    return ret;
+}
@@ -0,0 +1,145 @@
+/**
+ * 注册表性能测试
+ *
+ * 先插入8M个编号，再由多个线程混合执行查找和插入，直到共有10M个有效条目。
+ * 每个线程每5次操作插入一个新编号，其余查找一个已经插入的编号，
+ * 查找不能错过。状态机指针只用于比较，不会被访问
+ *
+ * 在本目录下编译运行，参数为线程数（默认4）：
+ * cc -O2 -I.. registry_bench.c ../state_machine.c ../state_machine_registry.c -lpthread
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "state_machine_registry.h"
+
+#define CAPACITY        (1u << 24)
+#define PREFILL         8000000u
+#define ENTRIES         10000000u
+#define INSERT_EVERY    5
+#define THREADS_MAX     64
+
+static struct statem_registry reg;
+
+// 下一个插入的编号，编号从0开始连续分配
+static uint64_t next_id;
+
+struct worker
+{
+    pthread_t thread;
+    unsigned int seed;
+    uint64_t lookups;
+    uint64_t inserts;
+    uint64_t misses;
+};
+
+static struct state_machine *machine_of(uint64_t id)
+{
+    return (struct state_machine *)(uintptr_t)((id + 1) * 8);
+}
+
+static uint64_t random_next(unsigned int *seed)
+{
+    *seed = *seed * 1103515245u + 12345u;
+
+    return *seed >> 4;
+}
+
+static void *worker_run(void *parameter)
+{
+    struct worker *w = parameter;
+    uint64_t n = 0;
+
+    for (;;)
+    {
+        if (++n % INSERT_EVERY == 0)
+        {
+            uint64_t id = __atomic_fetch_add(&next_id, 1, __ATOMIC_RELAXED);
+
+            if (id >= ENTRIES)
+            {
+                break;
+            }
+
+            if (statem_registry_insert(&reg, id, machine_of(id)))
+            {
+                w->misses++;
+            }
+            w->inserts++;
+        }
+        else
+        {
+            // 只查找前PREFILL个编号，它们在测试开始前已经插入
+            uint64_t id = random_next(&w->seed) % PREFILL;
+
+            if (statem_registry_lookup(&reg, id) != machine_of(id))
+            {
+                w->misses++;
+            }
+            w->lookups++;
+        }
+    }
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    struct worker workers[THREADS_MAX];
+    uint64_t t0, t1, t2, lookups = 0, inserts = 0, misses = 0, id;
+    size_t count;
+    int threads = (argc > 1) ? atoi(argv[1]) : 4, i;
+
+    if (threads < 1 || threads > THREADS_MAX || statem_registry_init(&reg, CAPACITY))
+    {
+        return 1;
+    }
+
+    t0 = STATEM_CLOCK_GET();
+    for (id = 0; id < PREFILL; ++id)
+    {
+        if (statem_registry_insert(&reg, id, machine_of(id)))
+        {
+            misses++;
+        }
+    }
+    next_id = PREFILL;
+    t1 = STATEM_CLOCK_GET();
+
+    for (i = 0; i < threads; ++i)
+    {
+        workers[i].seed = (unsigned int)i + 1;
+        workers[i].lookups = workers[i].inserts = workers[i].misses = 0;
+        pthread_create(&workers[i].thread, NULL, &worker_run, &workers[i]);
+    }
+
+    for (i = 0; i < threads; ++i)
+    {
+        pthread_join(workers[i].thread, NULL);
+        lookups += workers[i].lookups;
+        inserts += workers[i].inserts;
+        misses += workers[i].misses;
+    }
+    t2 = STATEM_CLOCK_GET();
+
+    for (id = 0; id < ENTRIES; ++id)
+    {
+        if (statem_registry_lookup(&reg, id) != machine_of(id))
+        {
+            misses++;
+        }
+    }
+
+    printf("prefill %u: %.1f ns/insert\n", PREFILL, (double)(t1 - t0) / PREFILL);
+    printf("mixed, %d threads: %llu lookups, %llu inserts, %.2f Mops/s, %.1f ns/op per thread\n", threads,
+           (unsigned long long)lookups, (unsigned long long)inserts,
+           (double)(lookups + inserts) * 1000.0 / (double)(t2 - t1),
+           (double)(t2 - t1) * threads / (double)(lookups + inserts));
+    count = statem_registry_count(&reg);
+    printf("entries %zu, errors %llu\n", count, (unsigned long long)misses);
+
+    statem_registry_deinit(&reg);
+
+    return (misses || count != ENTRIES) ? 1 : 0;
+}
@@ -0,0 +1,123 @@
+/**
+ * 注册表会话抖动测试
+ *
+ * 保持有效条目数不变，每次循环删除一个有效编号并插入一个新编号，同时另一个线程无锁查找
+ * 一组始终存在的编号。删除不留删除标记，插入不能失败，查找不能错过
+ *
+ * cc -I.. registry_churn.c ../state_machine.c ../state_machine_registry.c -lpthread
+ */
+#include <stdio.h>
+#include <pthread.h>
+#include "state_machine_registry.h"
+
+#define CAPACITY        1024
+#define LIVE            400
+#define STABLE          100
+#define ID_MAX          100000
+#define CYCLES          1000000
+
+static struct statem_registry reg;
+static struct state_machine machines[ID_MAX];
+static char live[ID_MAX];
+static unsigned int churn[LIVE - STABLE];
+static volatile int done;
+static size_t misses;
+
+static unsigned int random_next(unsigned int *seed)
+{
+    *seed = *seed * 1103515245u + 12345u;
+
+    return *seed >> 8;
+}
+
+// 查找始终存在的编号
+static void *reader(void *parameter)
+{
+    unsigned int seed = 7;
+
+    while (!done)
+    {
+        unsigned int id = random_next(&seed) % STABLE;
+
+        if (statem_registry_lookup(&reg, id) != &machines[id])
+        {
+            misses++;
+        }
+    }
+
+    return parameter;
+}
+
+int main(void)
+{
+    unsigned int seed = 1, id;
+    size_t fails = 0, errors = 0, nums = 0, count;
+    pthread_t thread;
+    long i;
+
+    if (statem_registry_init(&reg, CAPACITY))
+    {
+        return 1;
+    }
+
+    for (id = 0; id < LIVE; ++id)
+    {
+        statem_registry_insert(&reg, id, &machines[id]);
+        live[id] = id >= STABLE;
+        nums++;
+    }
+
+    // 可删除的编号，每次循环都删除其中一个
+    for (id = STABLE; id < LIVE; ++id)
+    {
+        churn[id - STABLE] = id;
+    }
+
+    pthread_create(&thread, NULL, &reader, NULL);
+
+    for (i = 0; i < CYCLES; ++i)
+    {
+        // 删除一个会话，再插入一个新的会话，有效条目数保持不变
+        unsigned int k = random_next(&seed) % (LIVE - STABLE);
+
+        id = churn[k];
+        if (statem_registry_remove(&reg, id) != &machines[id])
+        {
+            errors++;
+        }
+        live[id] = 0;
+
+        do
+        {
+            id = STABLE + random_next(&seed) % (ID_MAX - STABLE);
+        } while (live[id]);
+
+        if (statem_registry_insert(&reg, id, &machines[id]))
+        {
+            fails++;
+            nums--;
+            continue;
+        }
+        live[id] = 1;
+        churn[k] = id;
+    }
+
+    done = 1;
+    pthread_join(thread, NULL);
+
+    for (id = STABLE; id < ID_MAX; ++id)
+    {
+        if (statem_registry_lookup(&reg, id) != (live[id] ? &machines[id] : NULL))
+        {
+            errors++;
+        }
+    }
+
+    count = statem_registry_count(&reg);
+    printf("insert failures %zu, lookup misses %zu, errors %zu, count %zu/%zu\n",
+           fails, misses, errors, count, nums);
+
+    statem_registry_deinit(&reg);
+
+    return (fails || misses || errors || count != LIVE) ? 1 : 0;
+}
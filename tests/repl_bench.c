@@ -0,0 +1,222 @@
+/**
+ * 热备复制测试
+ *
+ * 主机和备机分别运行在同一台机器的两个进程中，通过UNIX流套接字连接：
+ * 1. 流式：主机在1s内尽快分发事件，不等待确认，最后等待一次
+ * 2. 逐个等待：主机每分发一个事件都等待备机确认
+ * 主机报告吞吐量和到确认为止的延迟，备机报告到应用为止的延迟。结束后备机把
+ * 各状态机的状态编号通过管道传回主机，与主机的状态比较
+ *
+ * 在本目录下编译运行：
+ * cc -O2 -I.. repl_bench.c ../state_machine.c ../state_machine_repl.c -lpthread
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "state_machine_repl.h"
+#include "state_machine_port.h"
+
+#define MACHINES        1024
+#define DURATION        1000000000ull
+#define WAIT_EVENTS     100000
+#define CAPACITY        4096
+#define BATCH           256
+
+enum
+{
+    EVENT_NEXT,
+};
+
+static struct state state_a, state_b, state_c, state_error;
+
+static struct state state_a = {
+    .transitions = (struct transition[]){
+        {EVENT_NEXT, NULL, NULL, NULL, &state_b},
+    },
+    .transition_nums = 1,
+};
+
+static struct state state_b = {
+    .transitions = (struct transition[]){
+        {EVENT_NEXT, NULL, NULL, NULL, &state_c},
+    },
+    .transition_nums = 1,
+};
+
+static struct state state_c = {
+    .transitions = (struct transition[]){
+        {EVENT_NEXT, NULL, NULL, NULL, &state_a},
+    },
+    .transition_nums = 1,
+};
+
+static struct statem_graph graph;
+static struct state_machine machines[MACHINES];
+
+static struct state_machine *machine_get(void *ctx, uint64_t machine_id)
+{
+    (void)ctx;
+
+    return (machine_id < MACHINES) ? &machines[machine_id] : NULL;
+}
+
+static unsigned int random_next(unsigned int *seed)
+{
+    *seed = *seed * 1103515245u + 12345u;
+
+    return *seed >> 8;
+}
+
+static void stats_print(const char *name, const struct statem_repl_stats *stats)
+{
+    printf("%-8s records %10llu, lag last %8.1f us, max %8.1f us\n", name, (unsigned long long)stats->records,
+           (double)stats->lag_last / 1000.0, (double)stats->lag_max / 1000.0);
+}
+
+// 备机：应用到主机关闭连接为止，再把统计和状态编号写入管道
+static int standby_run(int fd, int result_fd)
+{
+    struct statem_repl_standby standby;
+    struct statem_repl_stats stats;
+    uint32_t ids[MACHINES];
+    size_t i;
+
+    if (statem_repl_standby_init(&standby, fd, &graph, &machine_get, NULL, BATCH))
+    {
+        return 1;
+    }
+
+    while (statem_repl_standby_run_once(&standby) >= 0)
+    {
+    }
+
+    statem_repl_standby_stats(&standby, &stats);
+    statem_repl_standby_deinit(&standby);
+
+    for (i = 0; i < MACHINES; ++i)
+    {
+        ids[i] = statem_state_current(&machines[i])->id;
+    }
+
+    if (write(result_fd, &stats, sizeof(stats)) != (ssize_t)sizeof(stats)
+        || write(result_fd, ids, sizeof(ids)) != (ssize_t)sizeof(ids))
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
+static int primary_run(int fd, int result_fd)
+{
+    struct statem_repl_primary primary;
+    struct statem_repl_stats stats;
+    struct event event = {EVENT_NEXT, NULL};
+    uint32_t ids[MACHINES];
+    unsigned int seed = 1;
+    uint64_t t0, t1, events = 0;
+    size_t i, bad = 0;
+    int failed = 0;
+
+    if (statem_repl_primary_open(&primary, fd, CAPACITY))
+    {
+        return 1;
+    }
+
+    t0 = STATEM_CLOCK_GET();
+    while (!failed && STATEM_CLOCK_GET() - t0 < DURATION)
+    {
+        uint64_t id = random_next(&seed) % MACHINES;
+
+        failed = statem_repl_handle_event(&primary, id, &machines[id], &event) < 0;
+        events++;
+    }
+    failed |= statem_repl_wait(&primary, statem_repl_seq(&primary));
+    t1 = STATEM_CLOCK_GET();
+
+    statem_repl_primary_stats(&primary, &stats);
+    printf("streaming: %.0f events/s\n", (double)events * 1e9 / (double)(t1 - t0));
+    stats_print("primary", &stats);
+
+    t0 = STATEM_CLOCK_GET();
+    for (i = 0; i < WAIT_EVENTS && !failed; ++i)
+    {
+        uint64_t id = random_next(&seed) % MACHINES;
+
+        failed = statem_repl_handle_event(&primary, id, &machines[id], &event) < 0
+                 || statem_repl_wait(&primary, statem_repl_seq(&primary));
+    }
+    t1 = STATEM_CLOCK_GET();
+
+    statem_repl_primary_stats(&primary, &stats);
+    printf("waiting for every ack: %.0f events/s, %.1f us round trip\n",
+           (double)WAIT_EVENTS * 1e9 / (double)(t1 - t0), (double)(t1 - t0) / WAIT_EVENTS / 1000.0);
+    stats_print("primary", &stats);
+
+    failed |= statem_repl_primary_close(&primary);
+    shutdown(fd, SHUT_WR);
+
+    if (read(result_fd, &stats, sizeof(stats)) != (ssize_t)sizeof(stats)
+        || read(result_fd, ids, sizeof(ids)) != (ssize_t)sizeof(ids))
+    {
+        printf("standby failed\n");
+        return 1;
+    }
+    stats_print("standby", &stats);
+
+    for (i = 0; i < MACHINES; ++i)
+    {
+        if (ids[i] != statem_state_current(&machines[i])->id)
+        {
+            bad++;
+        }
+    }
+    printf("%zu of %d machines differ\n", bad, MACHINES);
+
+    return (failed || bad) ? 1 : 0;
+}
+
+int main(void)
+{
+    struct state *states[4];
+    int sv[2], result[2], status, ret;
+    pid_t pid;
+    size_t i;
+
+    if (statem_graph_build(&graph, states, 4, &state_a, &state_error)
+        || socketpair(AF_UNIX, SOCK_STREAM, 0, sv) || pipe(result))
+    {
+        return 1;
+    }
+
+    for (i = 0; i < MACHINES; ++i)
+    {
+        statem_init(&machines[i], &state_a, &state_error);
+    }
+
+    pid = fork();
+    if (pid < 0)
+    {
+        return 1;
+    }
+
+    if (pid == 0)
+    {
+        close(sv[0]);
+        close(result[0]);
+        return standby_run(sv[1], result[1]);
+    }
+
+    close(sv[1]);
+    close(result[1]);
+    ret = primary_run(sv[0], result[0]);
+
+    close(sv[0]);
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status))
+    {
+        ret = 1;
+    }
+
+    return ret;
+}
@@ -0,0 +1,237 @@
+/**
+ * 调度器延迟测试
+ *
+ * 一个工作线程服务一个批量状态机和多个交互状态机。批量状态机每轮收到一批
+ * 事件，每个事件占用5us；交互状态机每0.5ms收到一个事件，截止时间为500us。
+ * 分别用单一FIFO队列和EDF调度器分发，统计交互事件从投递到处理的延迟分布
+ *
+ * 节拍需要为us，在本目录下编译运行：
+ * cc -O2 -I.. '-DSTATEM_TICK_GET()=((uint32_t)(STATEM_CLOCK_GET() / 1000u))' \
+ *     sched_bench.c ../state_machine.c ../state_machine_sched.c -lpthread
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include "state_machine_sched.h"
+
+#define INTERACTIVE     50
+#define ROUNDS          100
+#define BULK_BURST      1500
+#define BULK_WORK       5
+#define UI_PER_ROUND    20
+#define UI_WORK         2
+#define UI_DEADLINE     500
+#define BUDGET          8
+#define FIFO_SIZE       (1u << 16)
+
+enum
+{
+    EVENT_BULK,
+    EVENT_UI,
+};
+
+static uint32_t latencies[ROUNDS * UI_PER_ROUND];
+static size_t latency_nums;
+
+static uint64_t now_us(void)
+{
+    return STATEM_CLOCK_GET() / 1000u;
+}
+
+static void spin(uint64_t us)
+{
+    uint64_t start = now_us();
+
+    while (now_us() - start < us)
+    {
+    }
+}
+
+static void action_bulk(void *oldstate_data, struct event *event, void *state_new_data)
+{
+    (void)oldstate_data;
+    (void)event;
+    (void)state_new_data;
+    spin(BULK_WORK);
+}
+
+// 事件数据为投递时间
+static void action_ui(void *oldstate_data, struct event *event, void *state_new_data)
+{
+    (void)oldstate_data;
+    (void)state_new_data;
+    latencies[latency_nums++] = (uint32_t)(now_us() - (uint64_t)(uintptr_t)event->data);
+    spin(UI_WORK);
+}
+
+static struct state state_run = {
+    .transitions = (struct transition[]){
+        {EVENT_BULK, NULL, NULL, &action_bulk, &state_run},
+        {EVENT_UI, NULL, NULL, &action_ui, &state_run},
+    },
+    .transition_nums = 2,
+};
+
+static struct state_machine m_bulk, m_ui[INTERACTIVE];
+static struct statem_sched sched;
+static struct statem_sched_machine s_bulk, s_ui[INTERACTIVE];
+static volatile int done;
+static int use_sched;
+
+// 对照组：所有状态机共用一个FIFO队列
+static struct
+{
+    struct state_machine *fsm;
+    struct event event;
+} fifo[FIFO_SIZE];
+static unsigned int fifo_head, fifo_tail;
+static pthread_mutex_t fifo_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void fifo_post(struct state_machine *fsm, struct event event)
+{
+    pthread_mutex_lock(&fifo_lock);
+    fifo[fifo_tail % FIFO_SIZE].fsm = fsm;
+    fifo[fifo_tail % FIFO_SIZE].event = event;
+    fifo_tail++;
+    pthread_mutex_unlock(&fifo_lock);
+}
+
+static int fifo_run_once(void)
+{
+    struct state_machine *fsm;
+    struct event event;
+
+    pthread_mutex_lock(&fifo_lock);
+    if (fifo_head == fifo_tail)
+    {
+        pthread_mutex_unlock(&fifo_lock);
+        return 0;
+    }
+    fsm = fifo[fifo_head % FIFO_SIZE].fsm;
+    event = fifo[fifo_head % FIFO_SIZE].event;
+    fifo_head++;
+    pthread_mutex_unlock(&fifo_lock);
+
+    statem_handle_event(fsm, &event);
+
+    return 1;
+}
+
+static void *worker(void *parameter)
+{
+    for (;;)
+    {
+        int nums = use_sched ? statem_sched_run_once(&sched) : fifo_run_once();
+
+        if (!nums)
+        {
+            if (done)
+            {
+                break;
+            }
+            sched_yield();
+        }
+    }
+
+    return parameter;
+}
+
+static void post(struct state_machine *fsm, struct statem_sched_machine *machine, struct event event)
+{
+    if (use_sched)
+    {
+        statem_sched_post(&sched, machine, &event);
+    }
+    else
+    {
+        fifo_post(fsm, event);
+    }
+}
+
+static int latency_compare(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static void bench(const char *name)
+{
+    struct statem_sched_stats stats = {0};
+    struct timespec interval = {0, UI_DEADLINE * 1000L};
+    unsigned int seed = 1;
+    pthread_t thread;
+    int round, k, i;
+
+    latency_nums = 0;
+    done = 0;
+
+    statem_init(&m_bulk, &state_run, NULL);
+    for (i = 0; i < INTERACTIVE; ++i)
+    {
+        statem_init(&m_ui[i], &state_run, NULL);
+    }
+
+    if (use_sched)
+    {
+        statem_sched_init(&sched, INTERACTIVE + 1, BUDGET);
+        statem_sched_machine_init(&sched, &s_bulk, &m_bulk, 2 * BULK_BURST, 100000);
+        for (i = 0; i < INTERACTIVE; ++i)
+        {
+            statem_sched_machine_init(&sched, &s_ui[i], &m_ui[i], 64, UI_DEADLINE);
+        }
+    }
+
+    pthread_create(&thread, NULL, &worker, NULL);
+
+    for (round = 0; round < ROUNDS; ++round)
+    {
+        for (k = 0; k < BULK_BURST; ++k)
+        {
+            post(&m_bulk, &s_bulk, (struct event){EVENT_BULK, NULL});
+        }
+
+        for (k = 0; k < UI_PER_ROUND; ++k)
+        {
+            seed = seed * 1103515245u + 12345u;
+            i = (int)((seed >> 16) % INTERACTIVE);
+            post(&m_ui[i], &s_ui[i], (struct event){EVENT_UI, (void *)(uintptr_t)now_us()});
+            nanosleep(&interval, NULL);
+        }
+    }
+
+    done = 1;
+    pthread_join(thread, NULL);
+
+    if (use_sched)
+    {
+        statem_sched_stats_get(&sched, &stats);
+        statem_sched_deinit(&sched);
+    }
+
+    qsort(latencies, latency_nums, sizeof(latencies[0]), &latency_compare);
+    printf("%-16s p50 %5u us  p99 %5u us  max %5u us", name, latencies[latency_nums / 2],
+           latencies[latency_nums * 99 / 100], latencies[latency_nums - 1]);
+    if (use_sched)
+    {
+        printf("  %llu of %llu events missed their deadline", (unsigned long long)stats.misses,
+               (unsigned long long)stats.dispatched);
+    }
+    printf("\n");
+}
+
+int main(void)
+{
+    printf("1 worker, bulk bursts of %d x %d us, %d interactive machines, deadline %d us\n",
+           BULK_BURST, BULK_WORK, INTERACTIVE, UI_DEADLINE);
+
+    use_sched = 0;
+    bench("FIFO queue");
+
+    use_sched = 1;
+    bench("EDF, budget 8");
+
+    return 0;
+}
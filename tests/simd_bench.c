@@ -0,0 +1,140 @@
+/**
+ * SIMD查找性能测试
+ *
+ * 一个状态带有N个事件类型各不相同的转换（N为8、64、512），均匀随机地分发
+ * 其中的事件，分别用默认的顺序查找和SIMD查找器处理同一串事件，先比较两者
+ * 选中的转换是否一致，再比较每个事件的平均时间
+ *
+ * 指令集在编译时选择，默认的x86-64编译只用SSE2，在本目录下编译运行：
+ * cc -O2 -I.. simd_bench.c ../state_machine.c ../state_machine_simd.c -lpthread
+ * 用AVX2时加上-mavx2，用标量版本时加上-DSTATEM_SIMD_SCALAR
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "state_machine_simd.h"
+#include "state_machine_port.h"
+
+#define EVENTS          2000000
+#define CHECKS          100000
+
+static struct state state_run, state_error;
+
+// 记录最后一次执行的转换
+static volatile intptr_t taken;
+
+static void action(void *oldstate_data, struct event *event, void *state_new_data)
+{
+    (void)oldstate_data;
+    (void)state_new_data;
+    taken = (intptr_t)event->type;
+}
+
+static unsigned int random_next(unsigned int *seed)
+{
+    *seed = *seed * 1103515245u + 12345u;
+
+    return *seed >> 8;
+}
+
+// 事件类型不连续，避免查找退化为下标访问
+static int type_of(unsigned int i)
+{
+    return (int)(i * 7u + 3u);
+}
+
+static int bench(unsigned int nums)
+{
+    struct transition *transitions = STATEM_MALLOC(nums * sizeof(struct transition));
+    struct state *states[2];
+    struct statem_graph graph;
+    struct statem_simd simd;
+    struct state_machine m1, m2;
+    struct event event = {0, NULL};
+    unsigned int seed = 1, i;
+    uint64_t t0, t1, t2;
+    size_t bad = 0;
+    long n;
+
+    if (transitions == NULL)
+    {
+        return 1;
+    }
+
+    for (i = 0; i < nums; ++i)
+    {
+        transitions[i] = (struct transition){type_of(i), NULL, NULL, &action, &state_run, 0};
+    }
+    state_run.transitions = transitions;
+    state_run.transition_nums = nums;
+
+    if (statem_graph_build(&graph, states, 2, &state_run, &state_error) || statem_simd_init(&simd, &graph))
+    {
+        STATEM_FREE(transitions);
+        return 1;
+    }
+
+    statem_init(&m1, &state_run, &state_error);
+    statem_init(&m2, &state_run, &state_error);
+    statem_finder_set(&m2, statem_simd_finder(&simd));
+
+    // 包括不存在的事件类型
+    for (n = 0; n < CHECKS; ++n)
+    {
+        int ret1, ret2;
+        intptr_t taken1;
+
+        event.type = (int)(random_next(&seed) % (nums * 7u + 8u));
+        taken = -1;
+        ret1 = statem_handle_event(&m1, &event);
+        taken1 = taken;
+        taken = -1;
+        ret2 = statem_handle_event(&m2, &event);
+        if (ret1 != ret2 || taken1 != taken || m1.state_current != m2.state_current)
+        {
+            bad++;
+        }
+    }
+
+    t0 = STATEM_CLOCK_GET();
+    for (n = 0; n < EVENTS; ++n)
+    {
+        event.type = type_of(random_next(&seed) % nums);
+        statem_handle_event(&m1, &event);
+    }
+
+    t1 = STATEM_CLOCK_GET();
+    for (n = 0; n < EVENTS; ++n)
+    {
+        event.type = type_of(random_next(&seed) % nums);
+        statem_handle_event(&m2, &event);
+    }
+    t2 = STATEM_CLOCK_GET();
+
+    printf("%3u transitions: mismatches %zu, scan %7.2f ns, simd %6.2f ns, speedup %5.2fx\n", nums, bad,
+           (double)(t1 - t0) / EVENTS, (double)(t2 - t1) / EVENTS, (double)(t1 - t0) / (double)(t2 - t1));
+
+    statem_simd_free(&simd);
+    STATEM_FREE(transitions);
+
+    return bad ? 1 : 0;
+}
+
+int main(void)
+{
+    int ret = 0;
+
+#if defined(__AVX2__) && !defined(STATEM_SIMD_SCALAR)
+    printf("instruction set: AVX2\n");
+#elif defined(__SSE2__) && !defined(STATEM_SIMD_SCALAR)
+    printf("instruction set: SSE2\n");
+#else
+    printf("instruction set: scalar\n");
+#endif
+
+    ret |= bench(8);
+    ret |= bench(64);
+    ret |= bench(512);
+
+    return ret;
+}
@@ -0,0 +1,182 @@
+/**
+ * 预写日志组提交性能测试
+ *
+ * 对不同的组提交窗口测量每秒记录的事件数和每次fdatasync()写入的记录数：
+ * 1. 同步：多个线程各自分发事件，每个事件都等待持久化后再分发下一个
+ * 2. 异步：一个线程连续分发事件，最后等待一次
+ * 日志写在参数指定的目录中（默认当前目录），应当位于本地磁盘上
+ *
+ * 在本目录下编译运行：
+ * cc -O2 -I.. wal_bench.c ../state_machine.c ../state_machine_wal.c -lpthread
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "state_machine_wal.h"
+#include "state_machine_port.h"
+
+#define THREADS         8
+#define DURATION        1000000000ull
+#define ASYNC_EVENTS    1000000
+#define CAPACITY        4096
+
+enum
+{
+    EVENT_TOGGLE = 1,
+};
+
+static struct state state_on, state_off, state_error;
+
+static struct state state_on = {
+    .transitions = (struct transition[]){
+        {EVENT_TOGGLE, NULL, NULL, NULL, &state_off},
+    },
+    .transition_nums = 1,
+};
+
+static struct state state_off = {
+    .transitions = (struct transition[]){
+        {EVENT_TOGGLE, NULL, NULL, NULL, &state_on},
+    },
+    .transition_nums = 1,
+};
+
+static struct statem_wal wal;
+static struct statem_graph graph;
+static uint64_t deadline;
+
+struct client
+{
+    pthread_t thread;
+    uint64_t id;
+    uint64_t events;
+    int failed;
+};
+
+// 每个事件都等待持久化
+static void *client_run(void *parameter)
+{
+    struct client *c = parameter;
+    struct state_machine m;
+    struct event event = {EVENT_TOGGLE, NULL};
+
+    statem_init(&m, &state_on, &state_error);
+
+    while (STATEM_CLOCK_GET() < deadline)
+    {
+        if (statem_wal_handle_event(&wal, c->id, &m, &event) < 0
+            || statem_wal_wait(&wal, statem_wal_lsn(&wal)))
+        {
+            c->failed = 1;
+            break;
+        }
+        c->events++;
+    }
+
+    return NULL;
+}
+
+static int bench_sync(const char *path, uint32_t window)
+{
+    struct client clients[THREADS];
+    uint64_t t0, t1, events = 0;
+    int i, failed = 0;
+
+    unlink(path);
+    if (statem_wal_open(&wal, path, &graph, window, CAPACITY))
+    {
+        return -1;
+    }
+
+    t0 = STATEM_CLOCK_GET();
+    deadline = t0 + DURATION;
+    for (i = 0; i < THREADS; ++i)
+    {
+        clients[i].id = (uint64_t)i;
+        clients[i].events = 0;
+        clients[i].failed = 0;
+        pthread_create(&clients[i].thread, NULL, &client_run, &clients[i]);
+    }
+
+    for (i = 0; i < THREADS; ++i)
+    {
+        pthread_join(clients[i].thread, NULL);
+        events += clients[i].events;
+        failed |= clients[i].failed;
+    }
+    t1 = STATEM_CLOCK_GET();
+
+    printf("  window %2u ms %10.0f events/s %8.1f records/sync\n", window,
+           (double)events * 1e9 / (double)(t1 - t0), wal.syncs ? (double)wal.records / (double)wal.syncs : 0.0);
+
+    failed |= statem_wal_close(&wal);
+    unlink(path);
+
+    return failed ? -1 : 0;
+}
+
+static int bench_async(const char *path, uint32_t window)
+{
+    struct state_machine m;
+    struct event event = {EVENT_TOGGLE, NULL};
+    uint64_t t0, t1;
+    int i, failed = 0;
+
+    unlink(path);
+    if (statem_wal_open(&wal, path, &graph, window, CAPACITY))
+    {
+        return -1;
+    }
+
+    statem_init(&m, &state_on, &state_error);
+
+    t0 = STATEM_CLOCK_GET();
+    for (i = 0; i < ASYNC_EVENTS; ++i)
+    {
+        if (statem_wal_handle_event(&wal, 0, &m, &event) < 0)
+        {
+            failed = 1;
+            break;
+        }
+    }
+    failed |= statem_wal_wait(&wal, statem_wal_lsn(&wal));
+    t1 = STATEM_CLOCK_GET();
+
+    printf("  window %2u ms %10.0f events/s %8.1f records/sync\n", window,
+           (double)ASYNC_EVENTS * 1e9 / (double)(t1 - t0), wal.syncs ? (double)wal.records / (double)wal.syncs : 0.0);
+
+    failed |= statem_wal_close(&wal);
+    unlink(path);
+
+    return failed ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    static const uint32_t windows[] = {0, 1, 2, 5, 10};
+    struct state *states[4];
+    char path[256];
+    size_t i;
+    int ret = 0;
+
+    snprintf(path, sizeof(path), "%s/wal_bench.log", argc > 1 ? argv[1] : ".");
+
+    if (statem_graph_build(&graph, states, 4, &state_on, &state_error))
+    {
+        return 1;
+    }
+
+    printf("%d threads waiting for durability after every event\n", THREADS);
+    for (i = 0; i < sizeof(windows) / sizeof(windows[0]); ++i)
+    {
+        ret |= bench_sync(path, windows[i]);
+    }
+
+    printf("1 thread waiting once after %d events\n", ASYNC_EVENTS);
+    for (i = 0; i < sizeof(windows) / sizeof(windows[0]); ++i)
+    {
+        ret |= bench_async(path, windows[i]);
+    }
+
+    return ret ? 1 : 0;
+}